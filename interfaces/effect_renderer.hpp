@@ -0,0 +1,66 @@
+#pragma once
+
+#include <bnb/types/full_image.hpp>
+
+#include <functional>
+#include <memory>
+#include <string>
+
+namespace bnb::interfaces
+{
+    /**
+     * The part of effect_player the offscreen effect player renders with. The default one
+     * wraps the SDK effect_player, a stand-in one lets the pipeline be measured or tested
+     * without the SDK cost. All the methods are called from the render thread with the
+     * GL context of offscreen_render_target current, draw() renders into the bound framebuffer.
+     */
+    class effect_renderer
+    {
+    public:
+        virtual ~effect_renderer() = default;
+
+        virtual void surface_created(int32_t width, int32_t height) = 0;
+
+        /**
+         * The size effect_player renders at, the effect size follows it.
+         * 
+         * Example surface_changed(960, 540)
+         */
+        virtual void surface_changed(int32_t width, int32_t height) = 0;
+
+        virtual void surface_destroyed() = 0;
+
+        virtual void push_frame(full_image_t image) = 0;
+
+        /**
+         * Render the last pushed frame.
+         * 
+         * @return a negative value while no frame is ready to be drawn
+         */
+        virtual int64_t draw() = 0;
+
+        virtual void set_max_faces(int32_t max_faces) = 0;
+
+        /**
+         * Load and activate the effect, an empty path unloads the current one.
+         * 
+         * @return false if the effect could not be loaded
+         * 
+         * Example load_effect("effects/test_BG")
+         */
+        virtual bool load_effect(const std::string& effect_path) = 0;
+
+        /**
+         * Whether draw() changes the frame. Without an effect the offscreen effect player
+         * passes the input frames through on the CPU and skips the renderer. The SDK renderer
+         * has one from the start and loses it only by an explicit load_effect("").
+         */
+        virtual bool has_effect() const = 0;
+
+        virtual void call_js_method(const std::string& method, const std::string& param) = 0;
+    };
+} // bnb::interfaces
+
+using effect_renderer_sptr = std::shared_ptr<bnb::interfaces::effect_renderer>;
+// makes a renderer with its own effect state, e.g. for every stream of the grid mode
+using effect_renderer_factory = std::function<effect_renderer_sptr()>;
@@ -4,6 +4,12 @@
 
 #include "pixel_buffer.hpp"
 
+#include <array>
+#include <future>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
 using pb_sptr = std::shared_ptr<bnb::interfaces::pixel_buffer>;
 
 namespace bnb {
@@ -18,6 +24,221 @@ namespace interfaces
         bool is_y_flip;
     };
 
+    enum class gpu_stage : uint32_t
+    {
+        effect_draw, // effect_player::draw()
+        orientation, // the orientation pass of offscreen_render_target
+        readback,    // reading of the processed frame from the GPU
+        count
+    };
+
+    // GPU time of one stage over the last frames in milliseconds
+    struct gpu_stage_stats
+    {
+        uint64_t total_samples{0};  // all samples ever measured
+        uint32_t window_samples{0}; // samples the values below are calculated of
+        double min{0};
+        double mean{0};
+        double p50{0};
+        double p90{0};
+        double p99{0};
+        double max{0};
+    };
+
+    struct gpu_stats
+    {
+        // indexed by gpu_stage
+        std::array<gpu_stage_stats, static_cast<size_t>(gpu_stage::count)> stages;
+    };
+
+    enum class processing_mode : uint32_t
+    {
+        // live capture: a frame is dropped if a newer one comes before it is rendered
+        realtime,
+        // offline processing: every frame is rendered in the submission order,
+        // process_image_async blocks while the pipeline is full
+        lossless
+    };
+
+    enum class frame_drop_reason : uint32_t
+    {
+        queue,         // a newer frame came while the frame waited for the render thread
+        locked_buffer, // the output of the previous frame is still in use by the client
+        timeout,       // the frame missed its deadline
+        count
+    };
+
+    // the processed frame, or std::nullopt and the reason the frame was dropped
+    using frame_result_cb = std::function<void(std::optional<pb_sptr> pb, std::optional<frame_drop_reason> dropped)>;
+
+    enum class pipeline_stage : uint32_t
+    {
+        queue_wait,  // from process_image_async to the start of rendering
+        render,      // push_frame and effect_player::draw()
+        orientation, // the orientation pass
+        readback,    // reading of the processed frame by the client
+        callback,    // time spent in the client callback
+        total,       // from process_image_async to the return from the callback
+        count
+    };
+
+    // CPU wall time of one pipeline stage since the start in microseconds,
+    // the percentiles are the upper bounds of the buckets they fall in
+    struct stage_latency
+    {
+        struct bucket_t
+        {
+            uint64_t upper_bound_us;
+            uint64_t count;
+        };
+
+        uint64_t count{0};
+        uint64_t sum_us{0};
+        uint64_t p50_us{0};
+        uint64_t p90_us{0};
+        uint64_t p99_us{0};
+        uint64_t p999_us{0};
+        uint64_t max_us{0};
+        // the non-empty buckets in the ascending order, for the export to other histogram formats
+        std::vector<bucket_t> buckets;
+
+        double mean_us() const { return count == 0 ? 0.0 : static_cast<double>(sum_us) / count; }
+    };
+
+    struct metrics_snapshot
+    {
+        uint64_t frames_submitted{0};
+        uint64_t frames_rendered{0};
+        // rendered frames passed through on the CPU because no effect was loaded
+        uint64_t frames_passthrough{0};
+        // indexed by frame_drop_reason
+        std::array<uint64_t, static_cast<size_t>(frame_drop_reason::count)> frames_dropped{};
+        // frames waiting for the render thread
+        int64_t queue_depth{0};
+        // CPU wall time in microseconds since the start, indexed by pipeline_stage
+        std::array<stage_latency, static_cast<size_t>(pipeline_stage::count)> latency;
+        // index of the current level of adaptive quality, 0 is the best
+        uint32_t quality_level{0};
+        uint64_t quality_steps_down{0};
+        uint64_t quality_steps_up{0};
+        // frames released by the frame pacer, the duplicates included
+        uint64_t frames_paced{0};
+        uint64_t pacer_duplicates{0};
+        // frames the pacer dropped because its jitter buffer was full
+        uint64_t pacer_drops{0};
+    };
+
+    enum class upscale_filter : uint32_t
+    {
+        bilinear,
+        bicubic_sharp // Catmull-Rom, keeps edges sharper than bilinear
+    };
+
+    struct quality_level
+    {
+        int32_t max_faces;  // faces searched by the recognizer
+        float render_scale; // size the effect renders at relative to the output size, (0, 1]
+    };
+
+    struct adaptive_quality_config
+    {
+        float target_fps{30.0f};
+        // from the best to the cheapest
+        std::vector<quality_level> levels{{1, 1.0f}, {1, 0.75f}, {1, 0.5f}};
+        // frames the render time is averaged over before a decision
+        uint32_t window_frames{30};
+        // step down when the average render time exceeds this share of the frame budget
+        float step_down_threshold{0.9f};
+        // step up when the average render time is below this share of the frame budget
+        float step_up_threshold{0.6f};
+        // consecutive windows with headroom required before a step up
+        uint32_t step_up_windows{3};
+    };
+
+    struct quality_event
+    {
+        uint64_t frame_id;
+        uint32_t from_level;
+        uint32_t to_level;
+        quality_level level;       // the new level
+        double average_render_ms; // the measurement caused the decision
+        double budget_ms;
+    };
+
+    using quality_event_cb = std::function<void(const quality_event& event)>;
+
+    struct grid_tile
+    {
+        // in pixels of the output, y counts the rows of the read back frame
+        int32_t x{0};
+        int32_t y{0};
+        int32_t width{0};
+        int32_t height{0};
+    };
+
+    struct frame_pacing_config
+    {
+        float target_fps{30.0f};
+        // frames buffered before the first release to absorb the render and capture jitter,
+        // the buffer holds twice as many; each one adds a frame period of latency
+        uint32_t jitter_frames{2};
+        // the frames are read back in this format before they are buffered
+        output_image_format format{output_image_format::nv12};
+    };
+
+    struct paced_frame_info
+    {
+        frame_timing timing;     // of the source frame
+        int64_t presentation_us; // the release tick, on frame_clock_us()
+        uint64_t sequence;       // number of the release, a tick skipped after a slow callback has none
+        bool duplicate;          // the previous frame repeated because none came in time
+    };
+
+    using paced_frame_cb = std::function<void(const full_image_t& image, const paced_frame_info& info)>;
+
+    // called on the render thread, loaded is false if the effect failed to load
+    using effect_loaded_cb = std::function<void(bool loaded)>;
+
+    struct startup_options
+    {
+        // loaded right after the effect player is created, empty loads nothing
+        std::string effect_path;
+        // invisible frames rendered after every load_effect, so the shaders and the textures
+        // of the effect are created before the first real frame; 0 turns the warm-up off
+        uint32_t warmup_frames{0};
+    };
+
+    struct startup_timings
+    {
+        // all in microseconds, the first three phases overlap
+        uint64_t utility_us{0};  // bnb::utility: the resource paths and the SDK
+        uint64_t renderer_us{0}; // creation of the effect player
+        uint64_t context_us{0};  // GL context and the render target, on the render thread
+        uint64_t surface_us{0};  // surface_created of the effect player
+        uint64_t effect_us{0};   // loading of the initial effect
+        uint64_t warmup_us{0};   // warm-up frames of the initial effect
+        // from create() until the first frame can be rendered without a hitch
+        uint64_t total_us{0};
+        // false while the startup is in progress
+        bool complete{false};
+    };
+
+    struct prefetch_stats
+    {
+        // the directory of the effect, empty if it was not found
+        std::string effect_path;
+        uint32_t files{0};
+        // files which could not be read
+        uint32_t failed{0};
+        uint64_t bytes{0};
+        uint64_t duration_us{0};
+    };
+
+    /**
+     * The methods added after process_image_async, surface_changed, load_effect, unload_effect
+     * and call_js_method have default implementations of a player without the feature: the
+     * setters do nothing, the statistics are empty and the grid mode throws std::runtime_error.
+     */
     class offscreen_effect_player
     {
     public:
@@ -28,13 +249,55 @@ namespace interfaces
          * and calling callback as a frame will be processed
          * 
          * @param image full_image_t - containing a frame for processing 
-         * @param callback calling when frame will be processed, containing pointer of pixel_buffer for get bytes
+         * @param callback calling when frame will be processed, containing pointer of pixel_buffer for get bytes,
+         * or std::nullopt and the reason if the frame was dropped
          * @param target_orient 
+         * @param timing the timestamp of the frame, pixel_buffer::get_frame_timing() returns it.
+         * With a latency budget the render thread skips the frame, calling back frame_drop_reason::timeout,
+         * if the recent render times say it can't be delivered before the timestamp plus the budget.
+         * 
+         * Example process_image_async(image_sptr, [](std::optional<pb_sptr> pb, std::optional<frame_drop_reason> dropped){},
+         *                             std::nullopt, {frame_clock_us(), 50000})
+         */
+        virtual void process_image_async(std::shared_ptr<full_image_t> image, frame_result_cb callback,
+                                         std::optional<orient_format> target_orient, frame_timing timing) = 0;
+
+        /**
+         * The same, the callback gets std::nullopt for a dropped frame whatever the reason.
+         * 
+         * Example process_image_async(image_sptr, [](std::optional<pb_sptr> pb){}, std::nullopt, {timestamp_us})
+         */
+        void process_image_async(std::shared_ptr<full_image_t> image, oep_pb_ready_cb callback,
+                                 std::optional<orient_format> target_orient, frame_timing timing)
+        {
+            auto result_cb = [callback = std::move(callback)](std::optional<pb_sptr> pb, std::optional<frame_drop_reason>) {
+                callback(std::move(pb));
+            };
+            process_image_async(std::move(image), frame_result_cb(std::move(result_cb)), target_orient, timing);
+        }
+
+        void process_image_async(std::shared_ptr<full_image_t> image, oep_pb_ready_cb callback,
+                                 std::optional<orient_format> target_orient)
+        {
+            process_image_async(std::move(image), std::move(callback), target_orient, frame_timing{});
+        }
+
+        /**
+         * Choose between dropping frames for the lowest latency and processing every frame.
+         * In the lossless mode the callbacks come in the submission order and
+         * process_image_async blocks the caller while max_frames_in_flight frames wait for
+         * the render thread, so the throughput is bound by rendering and readback only.
+         * The pixel buffer must be read within the callback in this mode, the next frame
+         * is rendered right after it returns. May be called from any thread.
+         * 
+         * @param mode realtime (default) or lossless
+         * @param max_frames_in_flight frames queued for rendering in the lossless mode
          * 
-         * Example process_image_async(image_sptr, [](pb_sptr sptr){})
+         * Example set_processing_mode(processing_mode::lossless, 2)
          */
-        virtual void process_image_async(std::shared_ptr<full_image_t> image, oep_pb_ready_cb callback,
-                                         std::optional<orient_format> target_orient) = 0;
+        virtual void set_processing_mode(processing_mode mode, uint32_t max_frames_in_flight = 2)
+        {
+        }
 
         /**
          * Notify about rendering surface being resized.
@@ -51,10 +314,16 @@ namespace interfaces
          * Load and activate effect async. May be called from any thread
          * 
          * @param effect_path Path to directory of effect
+         * @param callback called when the effect is loaded and warmed up, may be empty
          * 
-         * Example load_effect("effects/test_BG")
+         * Example load_effect("effects/test_BG", [](bool loaded){})
          */
-        virtual void load_effect(const std::string& effect_path) = 0;
+        virtual void load_effect(const std::string& effect_path, effect_loaded_cb callback) = 0;
+
+        void load_effect(const std::string& effect_path)
+        {
+            load_effect(effect_path, nullptr);
+        }
 
         /**
          * Empty effect loaded. The previous effect stays in the cache.
@@ -63,6 +332,23 @@ namespace interfaces
          */
         virtual void unload_effect() = 0;
 
+        /**
+         * Read the files of the effect into the page cache on background threads, so a later
+         * load_effect doesn't wait for the disk. May be called from any thread, e.g. for the
+         * effects next to the selected one in an effect picker.
+         * 
+         * @param effect_path Path to directory of effect, as for load_effect
+         * @return the files and bytes read and the time spent once the prefetch is done
+         * 
+         * Example prefetch_effect("effects/Afro")
+         */
+        virtual std::shared_future<prefetch_stats> prefetch_effect(const std::string& effect_path)
+        {
+            std::promise<prefetch_stats> nothing_read;
+            nothing_read.set_value(prefetch_stats{});
+            return nothing_read.get_future().share();
+        }
+
         /**
          * Call js method defined in config.js file of active effect
          * 
@@ -72,6 +358,228 @@ namespace interfaces
          * Example call_js_method("just_bg", "{ "recordDuration": 15, "rotation_vector": true }")
          */
         virtual void call_js_method(const std::string& method, const std::string& param) = 0;
+
+        /**
+         * GPU time spent by the stages of the recent frames. May be called from any thread.
+         * 
+         * @return per-stage statistics of GPU time, empty if the render target doesn't measure it
+         * 
+         * Example get_gpu_stats().stages[size_t(gpu_stage::effect_draw)].p90
+         */
+        virtual gpu_stats get_gpu_stats()
+        {
+            return {};
+        }
+
+        /**
+         * Turn on or off tracing of every frame from process_image_async to the callback.
+         * 
+         * @param enable true to record trace events
+         * 
+         * Example enable_tracing(true)
+         */
+        virtual void enable_tracing(bool enable)
+        {
+        }
+
+        /**
+         * Write recorded trace events to the file in Chrome trace JSON format
+         * to open in chrome://tracing or ui.perfetto.dev. May be called from any thread.
+         * 
+         * @param path path to the output file
+         * @return true if the file was written
+         * 
+         * Example dump_trace("/tmp/oep_trace.json")
+         */
+        virtual bool dump_trace(const std::string& path)
+        {
+            return false;
+        }
+
+        /**
+         * Frame counters and per-stage latency histograms. May be called from any thread.
+         * 
+         * Example get_metrics().frames_dropped[size_t(frame_drop_reason::queue)]
+         */
+        virtual metrics_snapshot get_metrics()
+        {
+            return {};
+        }
+
+        /**
+         * Write the metrics to the file in Prometheus text exposition format, e.g. for the
+         * textfile collector of node_exporter. The file is replaced atomically.
+         * 
+         * @param path path to the output file
+         * @return true if the file was written
+         * 
+         * Example write_metrics("/var/lib/node_exporter/oep.prom")
+         */
+        virtual bool write_metrics(const std::string& path)
+        {
+            return false;
+        }
+
+        /**
+         * Serve the metrics in Prometheus text format on the unix domain socket,
+         * every connection gets the current metrics as an HTTP response. Call with
+         * an empty path to stop serving.
+         * 
+         * @param socket_path path of the socket file, replaced if exists
+         * @return true if the socket is listening
+         * 
+         * Example serve_metrics("/tmp/oep_metrics.sock"), then
+         * curl --unix-socket /tmp/oep_metrics.sock http://localhost/metrics
+         */
+        virtual bool serve_metrics(const std::string& socket_path)
+        {
+            return false;
+        }
+
+        /**
+         * Render the effect at a reduced resolution, the orientation pass scales the frame
+         * up to the output size. The scale is applied between the frames without dropping
+         * any, the textures of the render target are not reallocated. The adaptive quality
+         * controller multiplies this scale by the render scale of its current level.
+         * May be called from any thread.
+         * 
+         * @param scale within (0, 1], 1 renders at the output size
+         * @param filter the filter of the upscale
+         * 
+         * Example set_render_scale(0.67f, upscale_filter::bicubic_sharp)
+         */
+        virtual void set_render_scale(float scale, upscale_filter filter = upscale_filter::bicubic_sharp)
+        {
+        }
+
+        /**
+         * Turn on the controller which holds the target frame rate by stepping through
+         * the quality levels: it steps down when the measured render time of a frame
+         * doesn't fit the frame budget and steps back up when there is headroom again.
+         * The face search mode is fixed when the effect player is created, so the levels
+         * trade the number of searched faces and the internal render resolution.
+         * May be called from any thread.
+         * 
+         * @param config the controller settings, the first level is applied at once;
+         * std::nullopt turns the controller off and restores the first level
+         * @param on_change called on the render thread after every change of the level
+         * 
+         * Example enable_adaptive_quality(adaptive_quality_config{24.0f}, [](const quality_event& e) {})
+         */
+        virtual void enable_adaptive_quality(std::optional<adaptive_quality_config> config, quality_event_cb on_change = nullptr)
+        {
+        }
+
+        /**
+         * Turn on the frame pacer: every processed frame is read back before its callback and
+         * queued, the reads of the client then convert the same copy. A pacer thread releases
+         * one frame per period of the target rate on the steady clock. The previous frame is
+         * repeated when the queue runs dry and the oldest queued frame is dropped when it
+         * overflows, so the output has a fixed cadence for an encoder whatever the jitter of
+         * the capture and of the rendering. The counts of the duplicates and the drops are in
+         * get_metrics(). May be called from any thread.
+         *
+         * @param config the pacer settings, std::nullopt turns the pacer off and drops the queued frames
+         * @param on_frame called on the pacer thread at every tick with the released frame
+         *
+         * Example enable_frame_pacing(frame_pacing_config{60.0f}, [](const full_image_t& image, const paced_frame_info& info) {})
+         */
+        virtual void enable_frame_pacing(std::optional<frame_pacing_config> config, paced_frame_cb on_frame = nullptr)
+        {
+        }
+
+        /**
+         * Add an input stream of the grid mode, e.g. for the gallery of a video call. Every
+         * stream has its own effect player with its own effect state, composite_grid_async()
+         * renders the last frame of every stream into its tile of one output frame, which is
+         * read back and converted once, so the GPU and the readback cost scale with the output
+         * size rather than with the number of streams. The tiles fill the output in a centered
+         * grid of ceil(sqrt(n)) columns in the order the streams are added. May be called
+         * from any thread.
+         * 
+         * @param effect_path the effect of the stream, empty loads none
+         * @return the id of the stream for the other grid methods
+         * 
+         * Example auto stream = add_grid_stream("effects/Afro")
+         */
+        virtual uint32_t add_grid_stream(const std::string& effect_path)
+        {
+            throw std::runtime_error("The grid mode is not supported");
+        }
+
+        /**
+         * Remove the stream of the grid mode, the other tiles are laid out again by the next composite.
+         * 
+         * Example remove_grid_stream(stream)
+         */
+        virtual void remove_grid_stream(uint32_t stream)
+        {
+        }
+
+        /**
+         * Load an effect of the stream of the grid mode, the other streams keep theirs.
+         * 
+         * Example load_grid_effect(stream, "effects/test_BG", [](bool loaded) {})
+         */
+        virtual void load_grid_effect(uint32_t stream, const std::string& effect_path, effect_loaded_cb callback = nullptr)
+        {
+            if (callback) {
+                callback(false);
+            }
+        }
+
+        /**
+         * Set the frame of the stream the next composite draws, a newer frame replaces the one
+         * not drawn yet. A stream keeps its last frame until a new one comes, the tile of a
+         * stream without any frame stays black. May be called from any thread.
+         * 
+         * @param target_orient the orientation of the frame in its tile, as of process_image_async
+         * 
+         * Example push_grid_frame(stream, image_sptr)
+         */
+        virtual void push_grid_frame(uint32_t stream, std::shared_ptr<full_image_t> image,
+                                     std::optional<orient_format> target_orient = std::nullopt)
+        {
+        }
+
+        /**
+         * Render every stream of the grid mode into its tile and call back with the composite
+         * frame of the output size, the pixel_buffer is read like the one of process_image_async.
+         * A composite is one frame of the processing mode: in the realtime mode it is dropped if
+         * a newer one comes before it is rendered or if it misses the latency budget of the timing,
+         * in the lossless mode the call blocks while max_frames_in_flight frames are queued.
+         * The draws of all the tiles are measured as gpu_stage::effect_draw.
+         * 
+         * Example composite_grid_async([](std::optional<pb_sptr> pb, std::optional<frame_drop_reason> dropped) {},
+         *                              {timestamp_us})
+         */
+        virtual void composite_grid_async(frame_result_cb callback, frame_timing timing)
+        {
+            throw std::runtime_error("The grid mode is not supported");
+        }
+
+        /**
+         * The same, the callback gets std::nullopt for a dropped composite whatever the reason.
+         * 
+         * Example composite_grid_async([](std::optional<pb_sptr> pb) {}, {timestamp_us})
+         */
+        void composite_grid_async(oep_pb_ready_cb callback, frame_timing timing = {})
+        {
+            auto result_cb = [callback = std::move(callback)](std::optional<pb_sptr> pb, std::optional<frame_drop_reason>) {
+                callback(std::move(pb));
+            };
+            composite_grid_async(frame_result_cb(std::move(result_cb)), timing);
+        }
+
+        /**
+         * Duration of the startup phases. May be called from any thread.
+         * 
+         * Example get_startup_timings().total_us
+         */
+        virtual startup_timings get_startup_timings()
+        {
+            return {};
+        }
     };
 }
 } // bnb::interfaces
\ No newline at end of file
@@ -29,6 +29,19 @@ namespace bnb::interfaces
          */
         virtual void surface_changed(int32_t width, int32_t height) = 0;
 
+        /**
+         * Set size of the area effect_player renders into relative to the output size.
+         * The orientation pass scales the image up to the output size. The render texture
+         * is allocated at the output size, so changing the scale doesn't reallocate it.
+         * Must be called from the render thread.
+         * 
+         * @param scale within (0, 1], 1 renders at the output size
+         * @param filter the filter of the upscale
+         * 
+         * Example set_render_scale(0.75f, upscale_filter::bilinear)
+         */
+        virtual void set_render_scale(float scale, upscale_filter filter) = 0;
+
         /**
          * Activate context for current thread
          * 
@@ -36,6 +49,15 @@ namespace bnb::interfaces
          */
         virtual void activate_context() = 0;
 
+        /**
+         * Notify that control has returned from effect_player, which may have changed the GL
+         * state bypassing the render target, e.g. after draw() or load_effect(). The render target
+         * reloads the state it caches. Must be called from the render thread.
+         *
+         * Example invalidate_gl_state()
+         */
+        virtual void invalidate_gl_state() = 0;
+
         /**
          * Preparing texture for effect_player
          * 
@@ -52,6 +74,34 @@ namespace bnb::interfaces
          */
         virtual void orient_image(orient_format orient) = 0;
 
+        /**
+         * Start a composite frame of the grid mode: the output texture is cleared to black
+         * and stays bound, so an empty grid is read back as a black frame. Does the per frame
+         * work of prepare_rendering(). Must be called from the render thread.
+         * 
+         * Example begin_composite()
+         */
+        virtual void begin_composite() = 0;
+
+        /**
+         * Preparing texture for effect_player of a tile, it renders at the tile size.
+         * Must be called between begin_composite() and compose_tile() of the tile.
+         * 
+         * Example prepare_tile_rendering()
+         */
+        virtual void prepare_tile_rendering() = 0;
+
+        /**
+         * Draws the tile rendered since prepare_tile_rendering() into its area of the output
+         * with the orientation, the rest of the output is kept.
+         * 
+         * @param orient the orientation of the tile
+         * @param tile the area of the output, effect_player rendered at its size, swapped by 90 and 270 degrees
+         * 
+         * Example compose_tile({camera_orientation::deg_0, true}, {640, 0, 640, 360})
+         */
+        virtual void compose_tile(orient_format orient, grid_tile tile) = 0;
+
         /**
          * Reading current buffer of active texture
          * 
@@ -69,5 +119,48 @@ namespace bnb::interfaces
          * Example get_pixel_buffer()
          */
         virtual void* get_pixel_buffer() = 0;
+
+        /**
+         * Copy an NV12 image into a CVPixelBufferRef in nv12 from the same pool as
+         * get_pixel_buffer, without GL, e.g. for the frames passed through without an effect.
+         * Must be called from the render thread.
+         * 
+         * @param image yuv_image_t in NV12 with tightly packed planes
+         * 
+         * Example make_pixel_buffer(image)
+         */
+        virtual void* make_pixel_buffer(const full_image_t& image) = 0;
+
+        /**
+         * Start measuring of GPU time of the stage. Stages must not overlap. A render target
+         * without timer queries keeps the defaults, which measure nothing.
+         * Must be called from the render thread.
+         * 
+         * @param stage the stage the following GPU commands belong to
+         * 
+         * Example begin_gpu_stage(gpu_stage::effect_draw)
+         */
+        virtual void begin_gpu_stage(gpu_stage stage)
+        {
+        }
+
+        /**
+         * Finish measuring of GPU time of the stage started by begin_gpu_stage.
+         * 
+         * Example end_gpu_stage(gpu_stage::effect_draw)
+         */
+        virtual void end_gpu_stage(gpu_stage stage)
+        {
+        }
+
+        /**
+         * GPU time spent by the stages of the recent frames. May be called from any thread.
+         * 
+         * Example get_gpu_stats()
+         */
+        virtual gpu_stats get_gpu_stats()
+        {
+            return {};
+        }
     };
 } // bnb::interfaces
\ No newline at end of file
@@ -2,6 +2,9 @@
 
 #include <bnb/types/full_image.hpp>
 
+#include <chrono>
+#include <memory>
+
 using oep_image_ready_cb = std::function<void(std::optional<bnb::full_image_t> image)>;
 
 // Lambda gets void* which is the CVPixelBufferRef in nv12
@@ -9,14 +12,102 @@ using oep_image_ready_pb_cb = std::function<void(void* image)>;
 
 namespace bnb::interfaces
 {
-    class pixel_buffer
+    enum class output_image_format
+    {
+        rgba,
+        nv12,
+        i420
+    };
+
+    struct frame_timing
+    {
+        // timestamp of the source frame as passed by the client, returned with the processed frame
+        int64_t capture_timestamp_us{0};
+        // the frame is dropped with frame_drop_reason::timeout in the realtime mode if its callback
+        // can't start within the budget after capture_timestamp_us, 0 renders it however late
+        int64_t latency_budget_us{0};
+    };
+
+    /**
+     * The clock of capture_timestamp_us when a latency budget is set: std::chrono::steady_clock,
+     * the host time clock of the capture session on Apple.
+     *
+     * Example frame_timing{frame_clock_us(), 50000}
+     */
+    inline int64_t frame_clock_us()
+    {
+        auto now = std::chrono::steady_clock::now().time_since_epoch();
+        return std::chrono::duration_cast<std::chrono::microseconds>(now).count();
+    }
+
+    class pixel_buffer;
+
+    /**
+     * Keeps the frame of a pixel_buffer readable while the lease lives, the RAII form of
+     * lock() and unlock(). Movable, may be passed to and destroyed on any thread. The
+     * effect player renders the next frames into other buffers meanwhile, the buffer is
+     * reused the moment its last lease is destroyed.
+     *
+     * Example auto lease = pb->lease();
+     *         worker.enqueue([lease = std::move(lease)]() { lease->get_image(output_image_format::nv12, cb); });
+     */
+    class pixel_buffer_lease
+    {
+    public:
+        pixel_buffer_lease() = default;
+        inline explicit pixel_buffer_lease(std::shared_ptr<pixel_buffer> buffer);
+        inline ~pixel_buffer_lease();
+
+        pixel_buffer_lease(pixel_buffer_lease&& other) noexcept
+            : m_buffer(std::move(other.m_buffer))
+            , m_generation(other.m_generation) {}
+
+        pixel_buffer_lease& operator=(pixel_buffer_lease&& other) noexcept
+        {
+            if (this != &other) {
+                reset();
+                m_buffer = std::move(other.m_buffer);
+                m_generation = other.m_generation;
+            }
+            return *this;
+        }
+
+        pixel_buffer_lease(const pixel_buffer_lease&) = delete;
+        pixel_buffer_lease& operator=(const pixel_buffer_lease&) = delete;
+
+        // releases the buffer before the destruction
+        inline void reset();
+
+        pixel_buffer* operator->() const { return m_buffer.get(); }
+        const std::shared_ptr<pixel_buffer>& get() const { return m_buffer; }
+        explicit operator bool() const { return m_buffer != nullptr; }
+
+        // the generation of the buffer when the lease was taken, it stays the same while the lease lives
+        uint64_t generation() const { return m_generation; }
+
+    private:
+        std::shared_ptr<pixel_buffer> m_buffer;
+        uint64_t m_generation{0};
+    };
+
+    class pixel_buffer: public std::enable_shared_from_this<pixel_buffer>
     {
     public:
         virtual ~pixel_buffer() = default;
 
+        /**
+         * Take a lease of the frame, safe from any thread. Must be taken while the buffer
+         * is locked, e.g. in the output callback, a lease of a released buffer may see a
+         * later frame.
+         *
+         * Example auto lease = pb->lease()
+         */
+        pixel_buffer_lease lease() { return pixel_buffer_lease(shared_from_this()); }
+
         /**
          * Lock pixel buffer. If you want to keep lock of pixel buffer
          * longer than output image callback scope you should lock pixel buffer.
+         * The count of locks is atomic, prefer lease() which unlocks by itself.
          * 
          * Example lock()
          */
@@ -24,7 +115,8 @@ namespace bnb::interfaces
 
         /**
          * Unlock pixel_buffer. Must be called if user explicitly called lock()
-         * after the work to process output pixel buffer completed.
+         * after the work to process output pixel buffer completed. The buffer
+         * is reused for a next frame when the last lock is released.
          * 
          * Example unlock()
          */
@@ -47,6 +139,54 @@ namespace bnb::interfaces
          * Example process_image_async([](void* cv_pixel_buffer_ref){})
          */
         virtual void get_pixel_buffer(oep_image_ready_pb_cb callback) = 0;
+
+        /**
+         * Get the processed frame as full_image_t in the requested pixel format.
+         * Works on every platform. Planes of the image are taken from the pool and
+         * returned to it when the image is destroyed.
+         * 
+         * @param format pixel format of the resulting image: rgba, nv12 or i420 (BT.601 full range)
+         * @param callback calling with full_image_t, or std::nullopt if the pixel buffer can't be read
+         * 
+         * Example get_image(output_image_format::nv12, [](std::optional<full_image_t> image){})
+         */
+        virtual void get_image(output_image_format format, oep_image_ready_cb callback) = 0;
+
+        /**
+         * Timing of the frame the pixel buffer currently holds, passed to process_image_async.
+         * 
+         * Example get_frame_timing().capture_timestamp_us
+         */
+        virtual frame_timing get_frame_timing() = 0;
+
+        /**
+         * The number of frames the buffer has held, it changes when the buffer is reused.
+         * A reference kept without a lock may compare it to detect the reuse.
+         *
+         * Example get_generation() == lease.generation()
+         */
+        virtual uint64_t get_generation() = 0;
     };
+
+    pixel_buffer_lease::pixel_buffer_lease(std::shared_ptr<pixel_buffer> buffer)
+        : m_buffer(std::move(buffer))
+    {
+        if (m_buffer != nullptr) {
+            m_buffer->lock();
+            m_generation = m_buffer->get_generation();
+        }
+    }
+
+    pixel_buffer_lease::~pixel_buffer_lease()
+    {
+        reset();
+    }
+
+    void pixel_buffer_lease::reset()
+    {
+        if (auto buffer = std::move(m_buffer)) {
+            buffer->unlock();
+        }
+    }
 } // bnb::interfaces
 
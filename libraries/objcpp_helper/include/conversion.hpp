@@ -3,6 +3,8 @@
 #include <bnb/types/full_image.hpp>
 #include <functional>
 
+#include "rotation.hpp"
+
 #define restrict __restrict
 
 namespace bnb
@@ -41,6 +43,34 @@ namespace bnb
         // clang-format on
     );
 
+    /**
+     * Copies the planes rotated and mirrored by pre_rotation, e.g. upright_transform(image_format)
+     * to hand the effect an upright deg_0 frame. The format of the image is transformed_format.
+     *
+     * Example make_full_image_from_biplanar_yuv(format, y, y_stride, uv, uv_stride, upright_transform(format))
+     */
+    full_image_t make_full_image_from_biplanar_yuv(
+        // clang-format off
+        const image_format& image_format,
+        const uint8_t* restrict lumo_buffer, int32_t lumo_row_stride,
+        const uint8_t* restrict chromo_buffer, int32_t chromo_row_stride,
+        image_transform pre_rotation, uint32_t threads = 1
+        // clang-format on
+    );
+
+    /**
+     * Copies the packed pixels rotated and mirrored by pre_rotation, the format of the image
+     * is transformed_format.
+     */
+    full_image_t make_full_image_from_nonplanar_bpc8(
+        // clang-format off
+        const image_format& image_format,
+        const bpc8_image_t::pixel_format_t pixel_format,
+        const uint8_t* restrict buffer, int32_t row_stride,
+        image_transform pre_rotation, uint32_t threads = 1
+        // clang-format on
+    );
+
     full_image_t make_full_image_from_biplanar_yuv_no_copy(
         // clang-format off
         const image_format& image_format,
@@ -49,4 +79,45 @@ namespace bnb
         // clang-format on
     );
 
+    /**
+     * Converts a packed RGBA image into NV12 (BT.601 full range) planes provided by the caller.
+     * Uses vImage on Apple platforms, otherwise a fixed-point portable implementation.
+     */
+    void rgba_to_nv12(
+        // clang-format off
+        const uint8_t* restrict rgba_buffer, int32_t rgba_row_stride,
+        uint32_t width, uint32_t height,
+        uint8_t* restrict y_buffer, int32_t y_row_stride,
+        uint8_t* restrict uv_buffer, int32_t uv_row_stride
+        // clang-format on
+    );
+
+    /**
+     * Converts a packed RGBA image into I420 (BT.601 full range) planes provided by the caller.
+     * Uses vImage on Apple platforms, otherwise a fixed-point portable implementation.
+     */
+    void rgba_to_i420(
+        // clang-format off
+        const uint8_t* restrict rgba_buffer, int32_t rgba_row_stride,
+        uint32_t width, uint32_t height,
+        uint8_t* restrict y_buffer, int32_t y_row_stride,
+        uint8_t* restrict u_buffer, int32_t u_row_stride,
+        uint8_t* restrict v_buffer, int32_t v_row_stride
+        // clang-format on
+    );
+
+    /**
+     * Converts YUV 4:2:0 planes into packed RGBA with the matrix and the range of yuv_format.
+     * The chroma is read with uv_pixel_stride, for NV12 pass the interleaved plane as
+     * u_buffer, its second byte as v_buffer and a stride of 2.
+     */
+    void yuv_to_rgba(
+        // clang-format off
+        const uint8_t* restrict y_buffer, int32_t y_row_stride,
+        const uint8_t* u_buffer, const uint8_t* v_buffer, int32_t uv_row_stride, int32_t uv_pixel_stride,
+        uint32_t width, uint32_t height, yuv_format_t yuv_format,
+        uint8_t* restrict rgba_buffer, int32_t rgba_row_stride
+        // clang-format on
+    );
+
 } // bnb
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <bnb/types/full_image.hpp>
+
+#define restrict __restrict
+
+namespace bnb
+{
+    struct image_transform
+    {
+        // clockwise: 0, 90, 180 or 270
+        uint32_t degrees{0};
+        // horizontal, applied before the rotation
+        bool mirror{false};
+    };
+
+    /**
+     * The side of a 4:2:0 chroma plane for the side of the image, an odd last row or column
+     * has a chroma sample of its own. Every producer and consumer of the planes uses it.
+     *
+     * Example chroma_size(width) * chroma_size(height) * 2 // NV12 UV plane
+     */
+    inline uint32_t chroma_size(uint32_t size)
+    {
+        return (size + 1) / 2;
+    }
+
+    /**
+     * The transform which makes an image of the format upright: the rotation by its orientation
+     * and the mirroring if it requires one.
+     *
+     * Example rotate_image(image, upright_transform(image.get_format()))
+     */
+    image_transform upright_transform(const image_format& format);
+
+    /**
+     * The format of an image after the transform: the size is swapped by 90 and 270 degrees,
+     * the orientation and the mirroring left to apply are reduced by the transform.
+     */
+    image_format transformed_format(const image_format& format, image_transform transform);
+
+    /**
+     * Rotates and mirrors a plane of pixels of bytes_per_pixel bytes, e.g. 1 for Y, U and V,
+     * 2 for interleaved UV and 4 for RGBA. The destination of 90 and 270 degrees has the
+     * swapped size. 90 and 270 degrees transpose the plane by cache-sized tiles of SIMD blocks,
+     * 0 and 180 degrees copy or reverse the rows; SSE2 and AVX2 on x86, NEON on ARM and a
+     * portable fallback for other pixel sizes. threads > 1 splits the rows among threads,
+     * which pays off for planes of several megabytes.
+     *
+     * Example rotate_plane(y, width, width, height, 1, {90, false}, dst, height)
+     */
+    void rotate_plane(
+        // clang-format off
+        const uint8_t* restrict src, int32_t src_row_stride,
+        uint32_t width, uint32_t height, uint32_t bytes_per_pixel, image_transform transform,
+        uint8_t* restrict dst, int32_t dst_row_stride,
+        uint32_t threads = 1
+        // clang-format on
+    );
+
+    /**
+     * Applies the transform to every plane of the image, the result has new tightly packed
+     * planes and transformed_format of the source format.
+     *
+     * Example rotate_image(image, {270, true}, 2)
+     */
+    full_image_t rotate_image(const full_image_t& image, image_transform transform, uint32_t threads = 1);
+
+} // bnb
@@ -2,7 +2,14 @@
 
 #include <bnb/utils/exceptions.hpp>
 
+#include <algorithm>
 #include <cmath>
+#include <cstring>
+#include <mutex>
+
+#ifdef __APPLE__
+    #include <Accelerate/Accelerate.h>
+#endif
 
 using namespace bnb;
 
@@ -168,8 +175,10 @@ full_image_t bnb::make_full_image_from_biplanar_yuv(
     const auto width = image_format.width;
     const auto height = image_format.height;
 
+    const auto uv_row_size = chroma_size(width) * 2;
+
     std::vector<std::uint8_t> y_plane(width * height);
-    std::vector<std::uint8_t> uv_plane((width / 2) * (height / 2) * 2);
+    std::vector<std::uint8_t> uv_plane(size_t(uv_row_size) * chroma_size(height));
 
     if (lumo_row_stride == width) {
         memcpy(y_plane.data(), lumo_buffer, y_plane.size());
@@ -181,13 +190,13 @@ full_image_t bnb::make_full_image_from_biplanar_yuv(
         }
     }
 
-    if (chromo_row_stride == width / 2 * 2) {
+    if (chromo_row_stride == int32_t(uv_row_size)) {
         memcpy(uv_plane.data(), chromo_buffer, uv_plane.size());
     } else {
         auto uv_ptr_dst = uv_plane.data();
-        for (int row = 0; row != height / 2;
-             ++row, chromo_buffer += chromo_row_stride, uv_ptr_dst += width / 2 * 2) {
-            memcpy(uv_ptr_dst, chromo_buffer, width / 2 * 2);
+        for (uint32_t row = 0; row != chroma_size(height);
+             ++row, chromo_buffer += chromo_row_stride, uv_ptr_dst += uv_row_size) {
+            memcpy(uv_ptr_dst, chromo_buffer, uv_row_size);
         }
     }
 
@@ -199,6 +208,81 @@ full_image_t bnb::make_full_image_from_biplanar_yuv(
         }};
 }
 
+full_image_t bnb::make_full_image_from_biplanar_yuv(
+    // clang-format off
+    const image_format& image_format,
+    const uint8_t* restrict lumo_buffer, int32_t lumo_row_stride,
+    const uint8_t* restrict chromo_buffer, int32_t chromo_row_stride,
+    image_transform pre_rotation, uint32_t threads
+    // clang-format on
+)
+{
+    if (pre_rotation.degrees % 360 == 0 && !pre_rotation.mirror) {
+        return make_full_image_from_biplanar_yuv(image_format, lumo_buffer, lumo_row_stride, chromo_buffer, chromo_row_stride);
+    }
+
+    const auto width = image_format.width;
+    const auto height = image_format.height;
+    const auto result_format = transformed_format(image_format, pre_rotation);
+
+    // the rotation is the copy, the source is read once
+    std::vector<std::uint8_t> y_plane(width * height);
+    std::vector<std::uint8_t> uv_plane(size_t(chroma_size(width)) * chroma_size(height) * 2);
+    rotate_plane(
+        // clang-format off
+        lumo_buffer, lumo_row_stride,
+        width, height, 1, pre_rotation,
+        y_plane.data(), int32_t(result_format.width),
+        threads
+        // clang-format on
+    );
+    rotate_plane(
+        // clang-format off
+        chromo_buffer, chromo_row_stride,
+        chroma_size(width), chroma_size(height), 2, pre_rotation,
+        uv_plane.data(), int32_t(chroma_size(result_format.width) * 2),
+        threads
+        // clang-format on
+    );
+
+    return full_image_t{
+        yuv_image_t{
+            bnb::color_plane_vector(std::move(y_plane)),
+            bnb::color_plane_vector(std::move(uv_plane)),
+            result_format,
+        }};
+}
+
+full_image_t bnb::make_full_image_from_nonplanar_bpc8(
+    // clang-format off
+    const image_format& image_format,
+    const bpc8_image_t::pixel_format_t pixel_format,
+    const uint8_t* restrict buffer, int32_t row_stride,
+    image_transform pre_rotation, uint32_t threads
+    // clang-format on
+)
+{
+    const auto bytes_per_pixel = bpc8_image_t::bytes_per_pixel(pixel_format);
+    const auto result_format = transformed_format(image_format, pre_rotation);
+
+    std::vector<std::uint8_t> plane(size_t(image_format.width) * image_format.height * bytes_per_pixel);
+    rotate_plane(
+        // clang-format off
+        buffer, row_stride,
+        image_format.width, image_format.height, bytes_per_pixel, pre_rotation,
+        plane.data(), int32_t(result_format.width * bytes_per_pixel),
+        threads
+        // clang-format on
+    );
+
+    return full_image_t{
+        bpc8_image_t{
+            bnb::color_plane_vector(std::move(plane)),
+            pixel_format,
+            result_format,
+        }};
+}
+
 full_image_t bnb::make_full_image_from_biplanar_yuv_no_copy(
     // clang-format off
     const image_format& image_format,
@@ -229,4 +313,232 @@ full_image_t bnb::make_full_image_from_biplanar_yuv_no_copy(
         free_chromo();
         return result;
     }
-}
\ No newline at end of file
+}
+
+namespace
+{
+    // BT.601 full range coefficients in 2.14 fixed point
+    constexpr int32_t fp_shift = 14;
+    constexpr int32_t fp_half = 1 << (fp_shift - 1);
+
+    inline uint8_t rgb_to_y(int32_t r, int32_t g, int32_t b)
+    {
+        return static_cast<uint8_t>((4899 * r + 9617 * g + 1868 * b + fp_half) >> fp_shift);
+    }
+
+    // arguments are sums of 4 pixels, the result is an average
+    inline uint8_t rgb4_to_u(int32_t r, int32_t g, int32_t b)
+    {
+        auto u = ((-2765 * r - 5427 * g + 8192 * b + 4 * fp_half) >> (fp_shift + 2)) + 128;
+        return static_cast<uint8_t>(std::min(std::max(u, 0), 255));
+    }
+
+    inline uint8_t rgb4_to_v(int32_t r, int32_t g, int32_t b)
+    {
+        auto v = ((8192 * r - 6860 * g - 1332 * b + 4 * fp_half) >> (fp_shift + 2)) + 128;
+        return static_cast<uint8_t>(std::min(std::max(v, 0), 255));
+    }
+
+    /**
+     * Processes the image by 2x2 blocks, calls on_chroma(column, row, u, v) for every block
+     * with chroma subsampled coordinates. With an odd size the last row and column form blocks
+     * of their own, the missing pixels of such a block repeat the edge ones.
+     */
+    template<class OnChroma>
+    void rgba_to_yuv420_portable(
+        const uint8_t* restrict rgba_buffer, int32_t rgba_row_stride,
+        uint32_t width, uint32_t height,
+        uint8_t* restrict y_buffer, int32_t y_row_stride,
+        OnChroma on_chroma)
+    {
+        for (uint32_t row = 0; row < height; row += 2) {
+            const bool has_row1 = row + 1 < height;
+            const uint8_t* src0 = rgba_buffer + row * rgba_row_stride;
+            const uint8_t* src1 = has_row1 ? src0 + rgba_row_stride : src0;
+            uint8_t* y0 = y_buffer + row * y_row_stride;
+            // the last row of an odd height has no pair, y1 is never written then
+            uint8_t* y1 = has_row1 ? y0 + y_row_stride : y0;
+
+            for (uint32_t column = 0; column < width; column += 2) {
+                const bool has_column1 = column + 1 < width;
+                const uint8_t* p00 = src0 + column * 4;
+                const uint8_t* p01 = has_column1 ? p00 + 4 : p00;
+                const uint8_t* p10 = src1 + column * 4;
+                const uint8_t* p11 = has_column1 ? p10 + 4 : p10;
+
+                y0[column] = rgb_to_y(p00[0], p00[1], p00[2]);
+                if (has_column1) {
+                    y0[column + 1] = rgb_to_y(p01[0], p01[1], p01[2]);
+                }
+                if (has_row1) {
+                    y1[column] = rgb_to_y(p10[0], p10[1], p10[2]);
+                    if (has_column1) {
+                        y1[column + 1] = rgb_to_y(p11[0], p11[1], p11[2]);
+                    }
+                }
+
+                int32_t r = p00[0] + p01[0] + p10[0] + p11[0];
+                int32_t g = p00[1] + p01[1] + p10[1] + p11[1];
+                int32_t b = p00[2] + p01[2] + p10[2] + p11[2];
+                on_chroma(column / 2, row / 2, rgb4_to_u(r, g, b), rgb4_to_v(r, g, b));
+            }
+        }
+    }
+
+#ifdef __APPLE__
+    const vImage_ARGBToYpCbCr* argb_to_ycbcr_info(vImageYpCbCrType type)
+    {
+        static vImage_ARGBToYpCbCr nv12_info;
+        static vImage_ARGBToYpCbCr i420_info;
+        static std::once_flag once;
+        std::call_once(once, []() {
+            vImage_YpCbCrPixelRange full_range = {0, 128, 255, 255, 255, 1, 255, 0};
+            vImageConvert_ARGBToYpCbCr_GenerateConversion(
+                kvImage_ARGBToYpCbCrMatrix_ITU_R_601_4, &full_range, &nv12_info, kvImageARGB8888, kvImage420Yp8_CbCr8, 0);
+            vImageConvert_ARGBToYpCbCr_GenerateConversion(
+                kvImage_ARGBToYpCbCrMatrix_ITU_R_601_4, &full_range, &i420_info, kvImageARGB8888, kvImage420Yp8_Cb8_Cr8, 0);
+        });
+        return type == kvImage420Yp8_CbCr8 ? &nv12_info : &i420_info;
+    }
+
+    vImage_Buffer make_vimage_buffer(const uint8_t* data, uint32_t width, uint32_t height, int32_t row_stride)
+    {
+        return vImage_Buffer{
+            const_cast<uint8_t*>(data),
+            static_cast<vImagePixelCount>(height),
+            static_cast<vImagePixelCount>(width),
+            static_cast<size_t>(row_stride)};
+    }
+
+    // vImage expects ARGB, the source is RGBA
+    const uint8_t rgba_to_argb_permute_map[4] = {3, 0, 1, 2};
+#endif
+} // namespace
+
+void bnb::rgba_to_nv12(
+    // clang-format off
+    const uint8_t* restrict rgba_buffer, int32_t rgba_row_stride,
+    uint32_t width, uint32_t height,
+    uint8_t* restrict y_buffer, int32_t y_row_stride,
+    uint8_t* restrict uv_buffer, int32_t uv_row_stride
+    // clang-format on
+)
+{
+#ifdef __APPLE__
+    // vImage converts the even sizes only
+    if (width % 2 == 0 && height % 2 == 0) {
+        auto src = make_vimage_buffer(rgba_buffer, width, height, rgba_row_stride);
+        auto y = make_vimage_buffer(y_buffer, width, height, y_row_stride);
+        auto uv = make_vimage_buffer(uv_buffer, width / 2, height / 2, uv_row_stride);
+
+        vImageConvert_ARGB8888To420Yp8_CbCr8(
+            &src, &y, &uv, argb_to_ycbcr_info(kvImage420Yp8_CbCr8), rgba_to_argb_permute_map, kvImageDoNotTile);
+        return;
+    }
+#endif
+    rgba_to_yuv420_portable(
+        rgba_buffer, rgba_row_stride, width, height, y_buffer, y_row_stride,
+        [uv_buffer, uv_row_stride](uint32_t column, uint32_t row, uint8_t u, uint8_t v) {
+            uint8_t* uv = uv_buffer + row * uv_row_stride + column * 2;
+            uv[0] = u;
+            uv[1] = v;
+        });
+}
+
+void bnb::rgba_to_i420(
+    // clang-format off
+    const uint8_t* restrict rgba_buffer, int32_t rgba_row_stride,
+    uint32_t width, uint32_t height,
+    uint8_t* restrict y_buffer, int32_t y_row_stride,
+    uint8_t* restrict u_buffer, int32_t u_row_stride,
+    uint8_t* restrict v_buffer, int32_t v_row_stride
+    // clang-format on
+)
+{
+#ifdef __APPLE__
+    // vImage converts the even sizes only
+    if (width % 2 == 0 && height % 2 == 0) {
+        auto src = make_vimage_buffer(rgba_buffer, width, height, rgba_row_stride);
+        auto y = make_vimage_buffer(y_buffer, width, height, y_row_stride);
+        auto u = make_vimage_buffer(u_buffer, width / 2, height / 2, u_row_stride);
+        auto v = make_vimage_buffer(v_buffer, width / 2, height / 2, v_row_stride);
+
+        vImageConvert_ARGB8888To420Yp8_Cb8_Cr8(
+            &src, &y, &u, &v, argb_to_ycbcr_info(kvImage420Yp8_Cb8_Cr8), rgba_to_argb_permute_map, kvImageDoNotTile);
+        return;
+    }
+#endif
+    rgba_to_yuv420_portable(
+        rgba_buffer, rgba_row_stride, width, height, y_buffer, y_row_stride,
+        [=](uint32_t column, uint32_t row, uint8_t u, uint8_t v) {
+            u_buffer[row * u_row_stride + column] = u;
+            v_buffer[row * v_row_stride + column] = v;
+        });
+}
+
+namespace
+{
+    struct yuv_to_rgb_coefficients
+    {
+        // 2.14 fixed point, the range expansion is folded in
+        int32_t y;
+        int32_t v_to_r;
+        int32_t u_to_g;
+        int32_t v_to_g;
+        int32_t u_to_b;
+        int32_t y_offset;
+    };
+
+    yuv_to_rgb_coefficients make_coefficients(yuv_format_t format)
+    {
+        bool bt709 = format.standard == color_std::bt709;
+        double kr = bt709 ? 0.2126 : 0.299;
+        double kb = bt709 ? 0.0722 : 0.114;
+        double kg = 1.0 - kr - kb;
+        bool video = format.range == color_range::video;
+        double y_scale = video ? 255.0 / 219.0 : 1.0;
+        double c_scale = video ? 255.0 / 224.0 : 1.0;
+        auto fp = [](double value) { return static_cast<int32_t>(std::lround(value * (1 << fp_shift))); };
+        return yuv_to_rgb_coefficients{
+            fp(y_scale),
+            fp(c_scale * 2.0 * (1.0 - kr)),
+            fp(c_scale * 2.0 * (1.0 - kb) * kb / kg),
+            fp(c_scale * 2.0 * (1.0 - kr) * kr / kg),
+            fp(c_scale * 2.0 * (1.0 - kb)),
+            video ? 16 : 0};
+    }
+
+    inline uint8_t clamp_fp(int32_t value)
+    {
+        return static_cast<uint8_t>(std::min(std::max((value + fp_half) >> fp_shift, 0), 255));
+    }
+} // namespace
+
+void bnb::yuv_to_rgba(
+    // clang-format off
+    const uint8_t* restrict y_buffer, int32_t y_row_stride,
+    const uint8_t* u_buffer, const uint8_t* v_buffer, int32_t uv_row_stride, int32_t uv_pixel_stride,
+    uint32_t width, uint32_t height, yuv_format_t yuv_format,
+    uint8_t* restrict rgba_buffer, int32_t rgba_row_stride
+    // clang-format on
+)
+{
+    const auto k = make_coefficients(yuv_format);
+    for (uint32_t row = 0; row < height; ++row) {
+        const uint8_t* y_row = y_buffer + row * y_row_stride;
+        const uint8_t* u_row = u_buffer + (row / 2) * uv_row_stride;
+        const uint8_t* v_row = v_buffer + (row / 2) * uv_row_stride;
+        uint8_t* dst = rgba_buffer + row * rgba_row_stride;
+
+        for (uint32_t column = 0; column < width; ++column) {
+            int32_t y = (y_row[column] - k.y_offset) * k.y;
+            int32_t u = u_row[(column / 2) * uv_pixel_stride] - 128;
+            int32_t v = v_row[(column / 2) * uv_pixel_stride] - 128;
+            dst[0] = clamp_fp(y + k.v_to_r * v);
+            dst[1] = clamp_fp(y - k.u_to_g * u - k.v_to_g * v);
+            dst[2] = clamp_fp(y + k.u_to_b * u);
+            dst[3] = 255;
+            dst += 4;
+        }
+    }
+}
@@ -0,0 +1,540 @@
+#include "rotation.hpp"
+
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <cstring>
+#include <future>
+#include <thread>
+#include <vector>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__)
+    #include <immintrin.h>
+    #define BNB_ROTATION_SSE2 1
+    #if defined(__GNUC__) || defined(__clang__)
+        #define BNB_ROTATION_AVX2 1
+    #else
+        #define BNB_ROTATION_AVX2 0
+    #endif
+#else
+    #define BNB_ROTATION_SSE2 0
+    #define BNB_ROTATION_AVX2 0
+#endif
+
+#if defined(__ARM_NEON) || defined(__aarch64__)
+    #include <arm_neon.h>
+    #define BNB_ROTATION_NEON 1
+#else
+    #define BNB_ROTATION_NEON 0
+#endif
+
+using namespace bnb;
+
+namespace
+{
+    // the side of the square tiles in pixels, a tile of the source and of the destination stay in L1
+    constexpr uint32_t tile_size = 64;
+
+    uint32_t orientation_degrees(camera_orientation orientation)
+    {
+        switch (orientation) {
+            case camera_orientation::deg_90:
+                return 90;
+            case camera_orientation::deg_180:
+                return 180;
+            case camera_orientation::deg_270:
+                return 270;
+            default:
+                return 0;
+        }
+    }
+
+    camera_orientation degrees_orientation(uint32_t degrees)
+    {
+        switch (degrees % 360) {
+            case 90:
+                return camera_orientation::deg_90;
+            case 180:
+                return camera_orientation::deg_180;
+            case 270:
+                return camera_orientation::deg_270;
+            default:
+                return camera_orientation::deg_0;
+        }
+    }
+
+    /* Transposes of square blocks: dst[j][i] = src[i][j], the rows are given by pointers so
+     * the callers flip the result by the order of the pointers. */
+
+    template<size_t BytesPerPixel>
+    struct block_transpose
+    {
+        static constexpr uint32_t size = 0;
+    };
+
+#if BNB_ROTATION_SSE2
+    template<>
+    struct block_transpose<1>
+    {
+        static constexpr uint32_t size = 8;
+
+        static void run(const uint8_t* const* src, uint8_t* const* dst)
+        {
+            auto load = [src](int i) { return _mm_loadl_epi64(reinterpret_cast<const __m128i*>(src[i])); };
+            __m128i b0 = _mm_unpacklo_epi8(load(0), load(1));
+            __m128i b1 = _mm_unpacklo_epi8(load(2), load(3));
+            __m128i b2 = _mm_unpacklo_epi8(load(4), load(5));
+            __m128i b3 = _mm_unpacklo_epi8(load(6), load(7));
+            __m128i c0 = _mm_unpacklo_epi16(b0, b1);
+            __m128i c1 = _mm_unpackhi_epi16(b0, b1);
+            __m128i c2 = _mm_unpacklo_epi16(b2, b3);
+            __m128i c3 = _mm_unpackhi_epi16(b2, b3);
+            __m128i columns[4] = {
+                _mm_unpacklo_epi32(c0, c2), _mm_unpackhi_epi32(c0, c2),
+                _mm_unpacklo_epi32(c1, c3), _mm_unpackhi_epi32(c1, c3)};
+            for (int i = 0; i < 4; ++i) {
+                _mm_storel_epi64(reinterpret_cast<__m128i*>(dst[i * 2]), columns[i]);
+                _mm_storel_epi64(reinterpret_cast<__m128i*>(dst[i * 2 + 1]), _mm_srli_si128(columns[i], 8));
+            }
+        }
+    };
+
+    template<>
+    struct block_transpose<2>
+    {
+        static constexpr uint32_t size = 8;
+
+        static void run(const uint8_t* const* src, uint8_t* const* dst)
+        {
+            __m128i a[8];
+            for (int i = 0; i < 8; ++i) {
+                a[i] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src[i]));
+            }
+            __m128i b[8];
+            for (int i = 0; i < 4; ++i) {
+                b[i * 2] = _mm_unpacklo_epi16(a[i * 2], a[i * 2 + 1]);
+                b[i * 2 + 1] = _mm_unpackhi_epi16(a[i * 2], a[i * 2 + 1]);
+            }
+            __m128i c0 = _mm_unpacklo_epi32(b[0], b[2]);
+            __m128i c1 = _mm_unpackhi_epi32(b[0], b[2]);
+            __m128i c2 = _mm_unpacklo_epi32(b[1], b[3]);
+            __m128i c3 = _mm_unpackhi_epi32(b[1], b[3]);
+            __m128i c4 = _mm_unpacklo_epi32(b[4], b[6]);
+            __m128i c5 = _mm_unpackhi_epi32(b[4], b[6]);
+            __m128i c6 = _mm_unpacklo_epi32(b[5], b[7]);
+            __m128i c7 = _mm_unpackhi_epi32(b[5], b[7]);
+            __m128i columns[8] = {
+                _mm_unpacklo_epi64(c0, c4), _mm_unpackhi_epi64(c0, c4),
+                _mm_unpacklo_epi64(c1, c5), _mm_unpackhi_epi64(c1, c5),
+                _mm_unpacklo_epi64(c2, c6), _mm_unpackhi_epi64(c2, c6),
+                _mm_unpacklo_epi64(c3, c7), _mm_unpackhi_epi64(c3, c7)};
+            for (int i = 0; i < 8; ++i) {
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(dst[i]), columns[i]);
+            }
+        }
+    };
+
+    template<>
+    struct block_transpose<4>
+    {
+        static constexpr uint32_t size = 4;
+
+        static void run(const uint8_t* const* src, uint8_t* const* dst)
+        {
+            auto load = [src](int i) { return _mm_loadu_si128(reinterpret_cast<const __m128i*>(src[i])); };
+            __m128i a0 = load(0);
+            __m128i a1 = load(1);
+            __m128i a2 = load(2);
+            __m128i a3 = load(3);
+            __m128i b0 = _mm_unpacklo_epi32(a0, a1);
+            __m128i b1 = _mm_unpackhi_epi32(a0, a1);
+            __m128i b2 = _mm_unpacklo_epi32(a2, a3);
+            __m128i b3 = _mm_unpackhi_epi32(a2, a3);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst[0]), _mm_unpacklo_epi64(b0, b2));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst[1]), _mm_unpackhi_epi64(b0, b2));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst[2]), _mm_unpacklo_epi64(b1, b3));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst[3]), _mm_unpackhi_epi64(b1, b3));
+        }
+    };
+#elif BNB_ROTATION_NEON
+    template<>
+    struct block_transpose<1>
+    {
+        static constexpr uint32_t size = 8;
+
+        static void run(const uint8_t* const* src, uint8_t* const* dst)
+        {
+            uint8x8x2_t t01 = vtrn_u8(vld1_u8(src[0]), vld1_u8(src[1]));
+            uint8x8x2_t t23 = vtrn_u8(vld1_u8(src[2]), vld1_u8(src[3]));
+            uint8x8x2_t t45 = vtrn_u8(vld1_u8(src[4]), vld1_u8(src[5]));
+            uint8x8x2_t t67 = vtrn_u8(vld1_u8(src[6]), vld1_u8(src[7]));
+            uint16x4x2_t u02 = vtrn_u16(vreinterpret_u16_u8(t01.val[0]), vreinterpret_u16_u8(t23.val[0]));
+            uint16x4x2_t u13 = vtrn_u16(vreinterpret_u16_u8(t01.val[1]), vreinterpret_u16_u8(t23.val[1]));
+            uint16x4x2_t u46 = vtrn_u16(vreinterpret_u16_u8(t45.val[0]), vreinterpret_u16_u8(t67.val[0]));
+            uint16x4x2_t u57 = vtrn_u16(vreinterpret_u16_u8(t45.val[1]), vreinterpret_u16_u8(t67.val[1]));
+            uint32x2x2_t v0 = vtrn_u32(vreinterpret_u32_u16(u02.val[0]), vreinterpret_u32_u16(u46.val[0]));
+            uint32x2x2_t v1 = vtrn_u32(vreinterpret_u32_u16(u13.val[0]), vreinterpret_u32_u16(u57.val[0]));
+            uint32x2x2_t v2 = vtrn_u32(vreinterpret_u32_u16(u02.val[1]), vreinterpret_u32_u16(u46.val[1]));
+            uint32x2x2_t v3 = vtrn_u32(vreinterpret_u32_u16(u13.val[1]), vreinterpret_u32_u16(u57.val[1]));
+            vst1_u8(dst[0], vreinterpret_u8_u32(v0.val[0]));
+            vst1_u8(dst[1], vreinterpret_u8_u32(v1.val[0]));
+            vst1_u8(dst[2], vreinterpret_u8_u32(v2.val[0]));
+            vst1_u8(dst[3], vreinterpret_u8_u32(v3.val[0]));
+            vst1_u8(dst[4], vreinterpret_u8_u32(v0.val[1]));
+            vst1_u8(dst[5], vreinterpret_u8_u32(v1.val[1]));
+            vst1_u8(dst[6], vreinterpret_u8_u32(v2.val[1]));
+            vst1_u8(dst[7], vreinterpret_u8_u32(v3.val[1]));
+        }
+    };
+
+    template<>
+    struct block_transpose<2>
+    {
+        static constexpr uint32_t size = 8;
+
+        static void run(const uint8_t* const* src, uint8_t* const* dst)
+        {
+            auto load = [src](int i) { return vreinterpretq_u16_u8(vld1q_u8(src[i])); };
+            uint16x8x2_t t01 = vtrnq_u16(load(0), load(1));
+            uint16x8x2_t t23 = vtrnq_u16(load(2), load(3));
+            uint16x8x2_t t45 = vtrnq_u16(load(4), load(5));
+            uint16x8x2_t t67 = vtrnq_u16(load(6), load(7));
+            uint32x4x2_t u02 = vtrnq_u32(vreinterpretq_u32_u16(t01.val[0]), vreinterpretq_u32_u16(t23.val[0]));
+            uint32x4x2_t u13 = vtrnq_u32(vreinterpretq_u32_u16(t01.val[1]), vreinterpretq_u32_u16(t23.val[1]));
+            uint32x4x2_t u46 = vtrnq_u32(vreinterpretq_u32_u16(t45.val[0]), vreinterpretq_u32_u16(t67.val[0]));
+            uint32x4x2_t u57 = vtrnq_u32(vreinterpretq_u32_u16(t45.val[1]), vreinterpretq_u32_u16(t67.val[1]));
+            auto store = [dst](int i, uint32x2_t low, uint32x2_t high) {
+                vst1q_u8(dst[i], vreinterpretq_u8_u32(vcombine_u32(low, high)));
+            };
+            store(0, vget_low_u32(u02.val[0]), vget_low_u32(u46.val[0]));
+            store(1, vget_low_u32(u13.val[0]), vget_low_u32(u57.val[0]));
+            store(2, vget_low_u32(u02.val[1]), vget_low_u32(u46.val[1]));
+            store(3, vget_low_u32(u13.val[1]), vget_low_u32(u57.val[1]));
+            store(4, vget_high_u32(u02.val[0]), vget_high_u32(u46.val[0]));
+            store(5, vget_high_u32(u13.val[0]), vget_high_u32(u57.val[0]));
+            store(6, vget_high_u32(u02.val[1]), vget_high_u32(u46.val[1]));
+            store(7, vget_high_u32(u13.val[1]), vget_high_u32(u57.val[1]));
+        }
+    };
+
+    template<>
+    struct block_transpose<4>
+    {
+        static constexpr uint32_t size = 4;
+
+        static void run(const uint8_t* const* src, uint8_t* const* dst)
+        {
+            auto load = [src](int i) { return vreinterpretq_u32_u8(vld1q_u8(src[i])); };
+            uint32x4x2_t t01 = vtrnq_u32(load(0), load(1));
+            uint32x4x2_t t23 = vtrnq_u32(load(2), load(3));
+            vst1q_u8(dst[0], vreinterpretq_u8_u32(vcombine_u32(vget_low_u32(t01.val[0]), vget_low_u32(t23.val[0]))));
+            vst1q_u8(dst[1], vreinterpretq_u8_u32(vcombine_u32(vget_low_u32(t01.val[1]), vget_low_u32(t23.val[1]))));
+            vst1q_u8(dst[2], vreinterpretq_u8_u32(vcombine_u32(vget_high_u32(t01.val[0]), vget_high_u32(t23.val[0]))));
+            vst1q_u8(dst[3], vreinterpretq_u8_u32(vcombine_u32(vget_high_u32(t01.val[1]), vget_high_u32(t23.val[1]))));
+        }
+    };
+#endif
+
+    /**
+     * Transposes the source rows [row_begin, row_end), a source pixel (row, column) goes to
+     * the destination column flip_x ? height - 1 - row : row and the destination row
+     * flip_y ? width - 1 - column : column.
+     */
+    template<size_t BytesPerPixel>
+    void transpose_rows(
+        const uint8_t* src, int32_t src_row_stride, uint32_t width, uint32_t height,
+        uint8_t* dst, int32_t dst_row_stride, bool flip_x, bool flip_y,
+        uint32_t row_begin, uint32_t row_end)
+    {
+        constexpr size_t bpp = BytesPerPixel;
+        constexpr uint32_t block = block_transpose<BytesPerPixel>::size;
+
+        auto dst_column = [=](uint32_t row) { return flip_x ? height - 1 - row : row; };
+        auto dst_row = [=](uint32_t column) { return flip_y ? width - 1 - column : column; };
+        auto copy_pixel = [=](uint32_t row, uint32_t column) {
+            std::memcpy(dst + size_t(dst_row(column)) * dst_row_stride + dst_column(row) * bpp,
+                        src + size_t(row) * src_row_stride + column * bpp, bpp);
+        };
+
+        for (uint32_t tile_row = row_begin; tile_row < row_end; tile_row += tile_size) {
+            const uint32_t tile_row_end = std::min(tile_row + tile_size, row_end);
+            for (uint32_t tile_column = 0; tile_column < width; tile_column += tile_size) {
+                const uint32_t tile_column_end = std::min(tile_column + tile_size, width);
+
+                uint32_t row = tile_row;
+                if constexpr (block > 0) {
+                    for (; row + block <= tile_row_end; row += block) {
+                        // the source rows in the order of the destination columns
+                        const uint8_t* src_rows[block];
+                        for (uint32_t i = 0; i < block; ++i) {
+                            uint32_t src_row = flip_x ? row + block - 1 - i : row + i;
+                            src_rows[i] = src + size_t(src_row) * src_row_stride;
+                        }
+                        const uint32_t first_dst_column = flip_x ? height - row - block : row;
+
+                        uint32_t column = tile_column;
+                        for (; column + block <= tile_column_end; column += block) {
+                            const uint8_t* block_src[block];
+                            uint8_t* block_dst[block];
+                            for (uint32_t i = 0; i < block; ++i) {
+                                block_src[i] = src_rows[i] + (column * bpp);
+                                block_dst[i] = dst + size_t(dst_row(column + i)) * dst_row_stride + first_dst_column * bpp;
+                            }
+                            block_transpose<BytesPerPixel>::run(block_src, block_dst);
+                        }
+                        for (; column < tile_column_end; ++column) {
+                            for (uint32_t i = 0; i < block; ++i) {
+                                copy_pixel(row + i, column);
+                            }
+                        }
+                    }
+                }
+                for (; row < tile_row_end; ++row) {
+                    for (uint32_t column = tile_column; column < tile_column_end; ++column) {
+                        copy_pixel(row, column);
+                    }
+                }
+            }
+        }
+    }
+
+    void transpose_rows_any(
+        const uint8_t* src, int32_t src_row_stride, uint32_t width, uint32_t height, uint32_t bytes_per_pixel,
+        uint8_t* dst, int32_t dst_row_stride, bool flip_x, bool flip_y, uint32_t row_begin, uint32_t row_end)
+    {
+        switch (bytes_per_pixel) {
+            case 1:
+                return transpose_rows<1>(src, src_row_stride, width, height, dst, dst_row_stride, flip_x, flip_y, row_begin, row_end);
+            case 2:
+                return transpose_rows<2>(src, src_row_stride, width, height, dst, dst_row_stride, flip_x, flip_y, row_begin, row_end);
+            case 3:
+                return transpose_rows<3>(src, src_row_stride, width, height, dst, dst_row_stride, flip_x, flip_y, row_begin, row_end);
+            case 4:
+                return transpose_rows<4>(src, src_row_stride, width, height, dst, dst_row_stride, flip_x, flip_y, row_begin, row_end);
+            default:
+                break;
+        }
+        for (uint32_t row = row_begin; row < row_end; ++row) {
+            for (uint32_t column = 0; column < width; ++column) {
+                uint32_t x = flip_x ? height - 1 - row : row;
+                uint32_t y = flip_y ? width - 1 - column : column;
+                std::memcpy(dst + size_t(y) * dst_row_stride + size_t(x) * bytes_per_pixel,
+                            src + size_t(row) * src_row_stride + size_t(column) * bytes_per_pixel, bytes_per_pixel);
+            }
+        }
+    }
+
+    /* Reversal of the pixel order of a row: dst[i] = src[count - 1 - i]. */
+
+#if BNB_ROTATION_AVX2
+    __attribute__((target("avx2"))) size_t reverse_row_avx2(const uint8_t* src, uint8_t* dst, size_t count, uint32_t bytes_per_pixel)
+    {
+        const size_t bytes = count * bytes_per_pixel;
+        __m256i mask;
+        switch (bytes_per_pixel) {
+            case 1:
+                mask = _mm256_setr_epi8(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0,
+                                        15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0);
+                break;
+            case 2:
+                mask = _mm256_setr_epi8(14, 15, 12, 13, 10, 11, 8, 9, 6, 7, 4, 5, 2, 3, 0, 1,
+                                        14, 15, 12, 13, 10, 11, 8, 9, 6, 7, 4, 5, 2, 3, 0, 1);
+                break;
+            case 4:
+                mask = _mm256_setr_epi8(12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3,
+                                        12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3);
+                break;
+            default:
+                return 0;
+        }
+        size_t done = 0;
+        for (; done + 32 <= bytes; done += 32) {
+            auto v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + bytes - done - 32));
+            v = _mm256_shuffle_epi8(v, mask);
+            v = _mm256_permute2x128_si256(v, v, 1);
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + done), v);
+        }
+        return done / bytes_per_pixel;
+    }
+
+    bool cpu_has_avx2()
+    {
+        static const bool result = __builtin_cpu_supports("avx2");
+        return result;
+    }
+#endif
+
+    // returns the pixels reversed, the rest is left to the scalar loop
+    size_t reverse_row_simd(const uint8_t* src, uint8_t* dst, size_t count, uint32_t bytes_per_pixel)
+    {
+        if (bytes_per_pixel != 1 && bytes_per_pixel != 2 && bytes_per_pixel != 4) {
+            return 0;
+        }
+#if BNB_ROTATION_AVX2
+        if (cpu_has_avx2()) {
+            return reverse_row_avx2(src, dst, count, bytes_per_pixel);
+        }
+#endif
+        const size_t bytes = count * bytes_per_pixel;
+        size_t done = 0;
+#if BNB_ROTATION_SSE2
+        for (; done + 16 <= bytes; done += 16) {
+            auto v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + bytes - done - 16));
+            if (bytes_per_pixel == 1) {
+                v = _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+            }
+            if (bytes_per_pixel <= 2) {
+                v = _mm_shufflehi_epi16(_mm_shufflelo_epi16(v, 0x1B), 0x1B);
+                v = _mm_shuffle_epi32(v, 0x4E);
+            } else {
+                v = _mm_shuffle_epi32(v, 0x1B);
+            }
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + done), v);
+        }
+#elif BNB_ROTATION_NEON
+        for (; done + 16 <= bytes; done += 16) {
+            auto v = vld1q_u8(src + bytes - done - 16);
+            if (bytes_per_pixel == 1) {
+                v = vrev64q_u8(v);
+            } else if (bytes_per_pixel == 2) {
+                v = vreinterpretq_u8_u16(vrev64q_u16(vreinterpretq_u16_u8(v)));
+            } else {
+                v = vreinterpretq_u8_u32(vrev64q_u32(vreinterpretq_u32_u8(v)));
+            }
+            vst1q_u8(dst + done, vextq_u8(v, v, 8));
+        }
+#endif
+        return done / bytes_per_pixel;
+    }
+
+    void reverse_row(const uint8_t* src, uint8_t* dst, size_t count, uint32_t bytes_per_pixel)
+    {
+        size_t done = reverse_row_simd(src, dst, count, bytes_per_pixel);
+        for (size_t i = done; i < count; ++i) {
+            std::memcpy(dst + i * bytes_per_pixel, src + (count - 1 - i) * bytes_per_pixel, bytes_per_pixel);
+        }
+    }
+
+    // the workers of the bands, started once: a thread per band and call costs more than
+    // the band of a camera frame takes
+    thread_pool& band_workers()
+    {
+        static thread_pool workers(std::max(2u, std::thread::hardware_concurrency()) - 1);
+        return workers;
+    }
+
+    // runs body(begin, end) on bands of rows, the bands are multiples of the tile size
+    template<class Body>
+    void for_row_bands(uint32_t rows, uint32_t threads, Body body)
+    {
+        threads = std::max(1u, std::min(threads, (rows + tile_size - 1) / tile_size));
+        if (threads == 1) {
+            body(0u, rows);
+            return;
+        }
+        uint32_t band = (rows + threads - 1) / threads;
+        band = (band + tile_size - 1) / tile_size * tile_size;
+        std::vector<std::future<void>> bands;
+        for (uint32_t begin = band; begin < rows; begin += band) {
+            bands.push_back(band_workers().enqueue(body, begin, std::min(begin + band, rows)));
+        }
+        // the calling thread takes the first band
+        body(0u, std::min(band, rows));
+        for (auto& result : bands) {
+            result.get();
+        }
+    }
+} // namespace
+
+image_transform bnb::upright_transform(const image_format& format)
+{
+    return image_transform{orientation_degrees(format.orientation), format.require_mirroring};
+}
+
+image_format bnb::transformed_format(const image_format& format, image_transform transform)
+{
+    auto result = format;
+    if (transform.degrees % 180 != 0) {
+        std::swap(result.width, result.height);
+    }
+    result.orientation = degrees_orientation(orientation_degrees(format.orientation) + 360 - transform.degrees % 360);
+    result.require_mirroring = format.require_mirroring != transform.mirror;
+    return result;
+}
+
+void bnb::rotate_plane(
+    // clang-format off
+    const uint8_t* restrict src, int32_t src_row_stride,
+    uint32_t width, uint32_t height, uint32_t bytes_per_pixel, image_transform transform,
+    uint8_t* restrict dst, int32_t dst_row_stride,
+    uint32_t threads
+    // clang-format on
+)
+{
+    const auto degrees = transform.degrees % 360;
+
+    if (degrees == 90 || degrees == 270) {
+        // mirroring first flips the source columns, which are the destination rows
+        bool flip_x = degrees == 90;
+        bool flip_y = (degrees == 270) != transform.mirror;
+        for_row_bands(height, threads, [=](uint32_t begin, uint32_t end) {
+            transpose_rows_any(src, src_row_stride, width, height, bytes_per_pixel, dst, dst_row_stride, flip_x, flip_y, begin, end);
+        });
+        return;
+    }
+
+    const bool flip_rows = degrees == 180;
+    const bool reverse = (degrees == 180) != transform.mirror;
+    const size_t row_bytes = size_t(width) * bytes_per_pixel;
+    for_row_bands(height, threads, [=](uint32_t begin, uint32_t end) {
+        for (uint32_t row = begin; row < end; ++row) {
+            const uint8_t* src_row = src + size_t(row) * src_row_stride;
+            uint8_t* dst_row = dst + size_t(flip_rows ? height - 1 - row : row) * dst_row_stride;
+            if (reverse) {
+                reverse_row(src_row, dst_row, width, bytes_per_pixel);
+            } else {
+                std::memcpy(dst_row, src_row, row_bytes);
+            }
+        }
+    });
+}
+
+full_image_t bnb::rotate_image(const full_image_t& image, image_transform transform, uint32_t threads)
+{
+    const auto format = image.get_format();
+    const auto result_format = transformed_format(format, transform);
+    const auto width = format.width;
+    const auto height = format.height;
+
+    auto rotate = [&](const uint8_t* src, uint32_t plane_width, uint32_t plane_height, uint32_t bytes_per_pixel) {
+        std::vector<uint8_t> plane(size_t(plane_width) * plane_height * bytes_per_pixel);
+        auto dst_width = transform.degrees % 180 == 0 ? plane_width : plane_height;
+        rotate_plane(
+            // clang-format off
+            src, int32_t(plane_width * bytes_per_pixel),
+            plane_width, plane_height, bytes_per_pixel, transform,
+            plane.data(), int32_t(dst_width * bytes_per_pixel),
+            threads
+            // clang-format on
+        );
+        return color_plane_vector(std::move(plane));
+    };
+
+    if (image.has_data<yuv_image_t>()) {
+        auto& yuv = image.get_data<yuv_image_t>();
+        auto yuv_format = yuv.get_yuv_format();
+        auto y_plane = rotate(yuv.get_y_plane(), width, height, 1);
+        if (yuv_format.format == yuv_format::yuv_nv12) {
+            auto uv_plane = rotate(yuv.get_uv_plane(), chroma_size(width), chroma_size(height), 2);
+            return full_image_t(yuv_image_t(y_plane, uv_plane, result_format, yuv_format));
+        }
+        auto u_plane = rotate(yuv.get_u_plane(), chroma_size(width), chroma_size(height), 1);
+        auto v_plane = rotate(yuv.get_v_plane(), chroma_size(width), chroma_size(height), 1);
+        return full_image_t(yuv_image_t(y_plane, u_plane, v_plane, result_format, yuv_format));
+    }
+
+    auto& bpc8 = image.get_data<bpc8_image_t>();
+    auto pixel_format = bpc8.get_pixel_format();
+    auto plane = rotate(bpc8.get_data(), width, height, bpc8_image_t::bytes_per_pixel(pixel_format));
+    return full_image_t(bpc8_image_t(plane, pixel_format, result_format));
+}
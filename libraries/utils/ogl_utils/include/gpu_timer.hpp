@@ -0,0 +1,56 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+namespace bnb::gl
+{
+    /**
+     * GL_TIME_ELAPSED queries around the stages of the frame. Every stage has a ring of
+     * queries, so the results of the previous frames are read while the current one is
+     * measured and reading never stalls the pipeline: a stage is skipped for the frame if
+     * all its queries are still in flight. Stages must not overlap, it's a GL restriction.
+     * All methods must be called from the thread with the current context.
+     */
+    class gpu_timer
+    {
+    public:
+        static constexpr uint32_t queries_per_stage = 2;
+
+        explicit gpu_timer(uint32_t stage_count);
+        ~gpu_timer();
+
+        gpu_timer(const gpu_timer&) = delete;
+        gpu_timer& operator=(const gpu_timer&) = delete;
+
+        void begin(uint32_t stage);
+        void end(uint32_t stage);
+
+        /**
+         * Report results of the queries finished on the GPU, never waits for the GPU.
+         *
+         * @param on_result called with the stage and its GPU time in milliseconds
+         */
+        void collect(const std::function<void(uint32_t stage, double milliseconds)>& on_result);
+
+    private:
+        struct query_t
+        {
+            GLuint id{0};
+            bool pending{false};
+        };
+
+        struct stage_t
+        {
+            query_t queries[queries_per_stage];
+            uint32_t next{0};
+            int32_t active{-1};
+        };
+
+        std::vector<stage_t> m_stages;
+        bool m_running{false};
+    };
+} // namespace bnb::gl
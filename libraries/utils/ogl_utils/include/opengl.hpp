@@ -6,8 +6,37 @@
 
 #include <bnb/utils/singleton.hpp>
 
+#include <atomic>
+#include <cstdint>
+
+// Set to 0 to strip all the GL error checks except explicit GL_CHECK_ERROR() from the build
+#ifndef BNB_GL_ERROR_CHECKS
+    #define BNB_GL_ERROR_CHECKS 1
+#endif
+
+// Default error_check_mode, see below. Debug builds check every call, release ones don't check.
+#ifndef BNB_GL_ERROR_CHECK_MODE
+    #ifdef NDEBUG
+        #define BNB_GL_ERROR_CHECK_MODE off
+    #else
+        #define BNB_GL_ERROR_CHECK_MODE debug
+    #endif
+#endif
+
+#ifndef BNB_GL_ERROR_CHECK_PERIOD
+    #define BNB_GL_ERROR_CHECK_PERIOD 60
+#endif
+
 namespace bnb::gl
 {
+    enum class error_check_mode
+    {
+        off,     // only explicit GL_CHECK_ERROR() calls
+        sampled, // GL_CALL checks errors during every Nth frame only
+        scoped,  // errors are checked at BNB_GL_SCOPE boundaries, i.e. once per pass
+        debug,   // KHR_debug callback reports errors, GL_CALL checks every call if KHR_debug isn't available
+    };
+
     enum class mali_gpu_family
     {
         generic, // all not listed
@@ -40,23 +69,116 @@ namespace bnb::gl
         context_info();
         virtual ~context_info() = default;
 
-        void check_error(const char* file, int line);
+        // scope names the BNB_GL_SCOPE the check is made at, if any
+        void check_error(const char* file, int line, const char* scope = nullptr);
+
+        /**
+         * Applies the error checking mode to the context current on the calling thread, i.e.
+         * installs the debug callback of the debug mode. Called once the context is created,
+         * before that the mode only sets which GL_CALL and BNB_GL_SCOPE checks are made.
+         *
+         * Example context_info::instance().init_current_context()
+         */
+        void init_current_context();
+
+        /**
+         * Switch the error checking mode. Must be called from the thread with the current
+         * context when the debug mode is turned on or off, the debug callback is installed there.
+         *
+         * @param mode new mode
+         * @param sample_period frames between checked ones in the sampled mode
+         */
+        void set_error_check_mode(error_check_mode mode, uint32_t sample_period = BNB_GL_ERROR_CHECK_PERIOD);
+        error_check_mode get_error_check_mode() const { return m_error_check_mode; }
+
+        /**
+         * Notify about the new frame, drives the sampled mode.
+         */
+        void begin_frame();
+
+        /**
+         * Whether GL_CALL has to check errors after the call
+         */
+        static bool check_each_call() { return s_check_each_call.load(std::memory_order_relaxed); }
+
+        /**
+         * Whether BNB_GL_SCOPE has to check errors at the boundaries
+         */
+        static bool check_scopes() { return s_check_scopes.load(std::memory_order_relaxed); }
 
     private:
         bool is_rgba16f_available();
 
         const char* error_code_to_string(GLenum error_code) const;
-        void on_error(GLenum error_code, const char* file, int line);
+        void on_error(GLenum error_code, const char* file, int line, const char* scope);
+
+        bool enable_debug_output(bool enable);
+
+        static constexpr error_check_mode default_error_check_mode = error_check_mode::BNB_GL_ERROR_CHECK_MODE;
+
+        error_check_mode m_error_check_mode{default_error_check_mode};
+        uint32_t m_sample_period{BNB_GL_ERROR_CHECK_PERIOD};
+        uint64_t m_frame_index{0};
+        bool m_debug_output_enabled{false};
+
+        // GL_CALL may run before the first use of the instance, so the flags start with the build defaults
+        inline static std::atomic<bool> s_check_each_call{default_error_check_mode == error_check_mode::debug};
+        inline static std::atomic<bool> s_check_scopes{default_error_check_mode == error_check_mode::scoped};
+    };
+
+    /**
+     * Checks errors at the beginning and at the end of the scope when scoped mode is on.
+     * Errors found at the beginning were made before the scope.
+     */
+    class error_scope
+    {
+    public:
+        error_scope(const char* name, const char* file, int line)
+            : m_name(name)
+            , m_file(file)
+            , m_line(line)
+        {
+            if (context_info::check_scopes()) {
+                context_info::instance().check_error(m_file, m_line, m_name);
+            }
+        }
+
+        ~error_scope()
+        {
+            if (context_info::check_scopes()) {
+                context_info::instance().check_error(m_file, m_line, m_name);
+            }
+        }
+
+        error_scope(const error_scope&) = delete;
+        error_scope& operator=(const error_scope&) = delete;
+
+    private:
+        const char* m_name;
+        const char* m_file;
+        int m_line;
     };
 
 } // namespace bnb::gl
 
 #define GL_CHECK_ERROR() bnb::gl::context_info::instance().check_error(__FILE__, __LINE__)
-#define GL_CALL(FUNC) [&]() {FUNC; GL_CHECK_ERROR(); }()
+
+#if BNB_GL_ERROR_CHECKS
+    #define GL_CALL(FUNC) [&]() {FUNC; if (bnb::gl::context_info::check_each_call()) { GL_CHECK_ERROR(); } }()
+#else
+    #define GL_CALL(FUNC) [&]() {FUNC; }()
+#endif
+
+#define BNB_GL_CONCAT_IMPL(a, b) a##b
+#define BNB_GL_CONCAT(a, b) BNB_GL_CONCAT_IMPL(a, b)
 
 #define BNB_GL_INIT() ((void) 0)
 #define BNB_GL_START_GROUP(name) ((void) 0)
 #define BNB_GL_END_GROUP() ((void) 0)
 #define BNB_GL_LABEL(obj, name) ((void) 0)
 
-#define BNB_GL_SCOPE(name) ((void) 0)
+#if BNB_GL_ERROR_CHECKS
+    #define BNB_GL_SCOPE(name) bnb::gl::error_scope BNB_GL_CONCAT(bnb_gl_scope_, __LINE__)(name, __FILE__, __LINE__)
+#else
+    #define BNB_GL_SCOPE(name) ((void) 0)
+#endif
@@ -1,20 +1,41 @@
 #pragma once
 
 #include <iostream>
+#include <memory>
+#include <vector>
 
 namespace bnb
 {
     class program
     {
     public:
+        struct description
+        {
+            const char* name;
+            const char* vertex_shader_code;
+            const char* fragmant_shader_code;
+        };
+
+        // compiled through gl::program_cache, throws std::runtime_error on compile errors
         program(const char* name, const char* vertex_shader_code, const char* fragmant_shader_code);
         ~program();
 
+        /**
+         * Builds several programs at once, the missing ones are compiled in parallel
+         * when the driver supports it.
+         *
+         * Example program::create({{"blit", blit_vs, blit_fs}, {"yuv", yuv_vs, yuv_fs}})
+         */
+        static std::vector<std::unique_ptr<program>> create(const std::vector<description>& descriptions);
+
         void use() const;
         void unuse() const;
 
         unsigned int handle() const { return m_handle; }
 
+    private:
+        explicit program(unsigned int handle);
+
     private:
         unsigned int m_handle;
     };
@@ -0,0 +1,123 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <bnb/utils/singleton.hpp>
+
+#include "metrics.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace bnb::gl
+{
+    struct program_source
+    {
+        std::string name;
+        // complete sources including the #version line
+        std::string vertex;
+        std::string fragment;
+    };
+
+    /**
+     * Linked program binaries keyed by the hash of the sources and of the driver
+     * (vendor, renderer and version strings). A binary is looked up in memory, then on
+     * disk, and is loaded with glProgramBinary; the program is compiled from the sources
+     * if there is none, if the driver changed or if the driver rejects it. Compiled
+     * programs are retrieved with glGetProgramBinary and written back to both levels.
+     *
+     * build() submits the compilation of all the missing programs before it waits for
+     * any of them, so a driver with KHR_parallel_shader_compile (or an asynchronous
+     * compiler) compiles them concurrently.
+     *
+     * GL calls are issued on the calling thread, it must have a current context.
+     */
+    class program_cache : public bnb::singleton<program_cache>
+    {
+    public:
+        struct stats_t
+        {
+            uint64_t memory_hits{0};
+            uint64_t disk_hits{0};
+            uint64_t misses{0};
+            // binaries the driver refused to load, e.g. after an update
+            uint64_t rejected{0};
+            // from the submission to the linked program, per program
+            metrics::latency_histogram::snapshot_t compile_us;
+            // glProgramBinary of a cached binary, per program
+            metrics::latency_histogram::snapshot_t load_us;
+        };
+
+        program_cache();
+
+        /**
+         * The directory of the binaries, created if missing. BNB_PROGRAM_CACHE_DIR or the cache
+         * directory of the user by default: ~/Library/Caches/bnb_program_cache on Apple platforms,
+         * $XDG_CACHE_HOME/bnb_program_cache or ~/.cache/bnb_program_cache elsewhere, and
+         * $TMPDIR/bnb_program_cache_<uid> without a home. An empty path keeps the binaries in memory only.
+         *
+         * Example set_directory("~/Library/Caches/com.example.app/programs")
+         */
+        void set_directory(const std::string& directory);
+        std::string directory() const;
+
+        // handles of the linked programs in the order of the sources, throws std::runtime_error on compile errors
+        std::vector<GLuint> build(const std::vector<program_source>& sources);
+
+        GLuint build(const program_source& source)
+        {
+            return build(std::vector<program_source>{source}).front();
+        }
+
+        stats_t stats() const;
+
+    private:
+        struct binary_t
+        {
+            GLenum format{0};
+            std::vector<uint8_t> data;
+        };
+
+        struct pending_t
+        {
+            size_t index;
+            uint64_t source_hash;
+            GLuint program;
+            GLuint vertex_shader;
+            GLuint fragment_shader;
+            std::chrono::steady_clock::time_point submitted;
+        };
+
+        bool binaries_supported();
+        uint64_t driver_hash();
+
+        GLuint load_binary(const program_source& source, uint64_t source_hash, uint64_t driver);
+        pending_t submit(size_t index, const program_source& source, uint64_t source_hash);
+        GLuint finish(const program_source& source, const pending_t& pending, uint64_t driver);
+
+        bool read_file(const std::string& name, uint64_t source_hash, uint64_t driver, binary_t& binary);
+        void write_file(const std::string& name, uint64_t source_hash, uint64_t driver, const binary_t& binary);
+        std::string file_path(const std::string& name, uint64_t source_hash) const;
+
+    private:
+        mutable std::mutex m_mutex;
+        std::string m_directory;
+        std::unordered_map<uint64_t, binary_t> m_binaries;
+
+        std::atomic<uint64_t> m_memory_hits{0};
+        std::atomic<uint64_t> m_disk_hits{0};
+        std::atomic<uint64_t> m_misses{0};
+        std::atomic<uint64_t> m_rejected{0};
+        metrics::latency_histogram m_compile_us;
+        metrics::latency_histogram m_load_us;
+
+        // -1 until the first query on a context
+        int m_binaries_supported{-1};
+        bool m_parallel_compile_enabled{false};
+    };
+} // namespace bnb::gl
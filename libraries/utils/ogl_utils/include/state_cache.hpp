@@ -0,0 +1,112 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <cstdint>
+#include <unordered_map>
+
+namespace bnb::gl
+{
+    /**
+     * Shadow copy of the GL state touched by the render target. Calls that would
+     * set an already current value are elided. Attachments are tracked per framebuffer,
+     * and completeness is validated only when an attachment actually changes.
+     *
+     * The cache has to be told when foreign code (e.g. effect_player) could have
+     * changed bindings, see invalidate_bindings(). Attachments of own framebuffers
+     * survive the invalidation because nobody else touches them.
+     */
+    class state_cache
+    {
+    public:
+        struct counters_t
+        {
+            uint32_t binds_issued{0};       // bind, use and viewport calls passed to the driver
+            uint32_t binds_elided{0};       // bind, use and viewport calls skipped, the state was current
+            uint32_t attachments_issued{0}; // attachment and completeness calls passed to the driver
+            uint32_t attachments_elided{0}; // attachment and completeness calls skipped, nothing was reattached
+        };
+
+        void bind_framebuffer(GLuint framebuffer);
+        void use_program(GLuint program);
+        void bind_vertex_array(GLuint vao);
+        void bind_texture_2d(GLuint texture);
+        void viewport(GLint x, GLint y, GLsizei width, GLsizei height);
+
+        /**
+         * Attach the texture to the color attachment 0 of the framebuffer, the framebuffer gets bound.
+         *
+         * @return false if the framebuffer is incomplete
+         */
+        bool attach_color_texture(GLuint framebuffer, GLuint texture);
+
+        /**
+         * Forget all bindings, must be called after the state has been changed bypassing the cache.
+         */
+        void invalidate_bindings();
+
+        /**
+         * Forget the object, must be called before it is deleted since its name may be reused.
+         */
+        void forget_texture(GLuint texture);
+        void forget_framebuffer(GLuint framebuffer);
+
+        /**
+         * Start collecting counters of a new frame, counters of the previous one become available.
+         */
+        void begin_frame();
+        counters_t last_frame_counters() const { return m_last_frame_counters; }
+
+    private:
+        template<typename T>
+        struct cached
+        {
+            T value{};
+            bool valid{false};
+        };
+
+        struct viewport_t
+        {
+            GLint x;
+            GLint y;
+            GLsizei width;
+            GLsizei height;
+
+            bool operator==(const viewport_t& other) const
+            {
+                return x == other.x && y == other.y && width == other.width && height == other.height;
+            }
+        };
+
+        struct attachment_t
+        {
+            GLuint texture{0};
+            bool complete{false};
+        };
+
+        // returns true if the value has to be set
+        template<typename T>
+        bool update(cached<T>& cache, const T& value)
+        {
+            if (cache.valid && cache.value == value) {
+                ++m_counters.binds_elided;
+                return false;
+            }
+            cache.value = value;
+            cache.valid = true;
+            ++m_counters.binds_issued;
+            return true;
+        }
+
+        cached<GLuint> m_framebuffer;
+        cached<GLuint> m_program;
+        cached<GLuint> m_vao;
+        cached<GLuint> m_texture_2d;
+        cached<viewport_t> m_viewport;
+
+        std::unordered_map<GLuint, attachment_t> m_attachments;
+
+        counters_t m_counters;
+        counters_t m_last_frame_counters;
+    };
+} // namespace bnb::gl
@@ -0,0 +1,81 @@
+#include "gpu_timer.hpp"
+
+#include "opengl.hpp"
+
+using namespace bnb;
+
+gl::gpu_timer::gpu_timer(uint32_t stage_count)
+    : m_stages(stage_count)
+{
+    for (auto& stage : m_stages) {
+        for (auto& query : stage.queries) {
+            GL_CALL(glGenQueries(1, &query.id));
+        }
+    }
+}
+
+gl::gpu_timer::~gpu_timer()
+{
+    for (auto& stage : m_stages) {
+        for (auto& query : stage.queries) {
+            if (query.id != 0) {
+                GL_CALL(glDeleteQueries(1, &query.id));
+            }
+        }
+    }
+}
+
+void gl::gpu_timer::begin(uint32_t stage)
+{
+    if (stage >= m_stages.size() || m_running) {
+        return;
+    }
+
+    auto& s = m_stages[stage];
+    auto& query = s.queries[s.next];
+    if (query.pending) {
+        // the result of this query is not read yet, skip the stage rather than wait for the GPU
+        s.active = -1;
+        return;
+    }
+
+    GL_CALL(glBeginQuery(GL_TIME_ELAPSED, query.id));
+    s.active = static_cast<int32_t>(s.next);
+    s.next = (s.next + 1) % queries_per_stage;
+    m_running = true;
+}
+
+void gl::gpu_timer::end(uint32_t stage)
+{
+    if (stage >= m_stages.size() || m_stages[stage].active < 0) {
+        return;
+    }
+
+    auto& s = m_stages[stage];
+    GL_CALL(glEndQuery(GL_TIME_ELAPSED));
+    s.queries[s.active].pending = true;
+    s.active = -1;
+    m_running = false;
+}
+
+void gl::gpu_timer::collect(const std::function<void(uint32_t stage, double milliseconds)>& on_result)
+{
+    for (uint32_t stage = 0; stage < m_stages.size(); ++stage) {
+        for (auto& query : m_stages[stage].queries) {
+            if (!query.pending) {
+                continue;
+            }
+
+            GLint available = 0;
+            GL_CALL(glGetQueryObjectiv(query.id, GL_QUERY_RESULT_AVAILABLE, &available));
+            if (!available) {
+                continue;
+            }
+
+            GLuint64 nanoseconds = 0;
+            GL_CALL(glGetQueryObjectui64v(query.id, GL_QUERY_RESULT, &nanoseconds));
+            query.pending = false;
+            on_result(stage, static_cast<double>(nanoseconds) / 1e6);
+        }
+    }
+}
@@ -1,18 +1,7 @@
 #include <bnb/utils/singleton.hpp>
 
-#ifndef BNB_WRITE_LOG_MESSAGE
-    #define WRITE_LOG_MESSAGE(severity, message) std::cout << #severity << message << std::endl
-#else
-    #define WRITE_LOG_MESSAGE(severity, message) BNB_WRITE_LOG_MESSAGE(severity) << message
-#endif
-
-#ifndef BNB_WRITE_LOG_MESSAGE_WITH_LOGGER
-    #define WRITE_LOG_MESSAGE_WITH_LOGGER(logger, severity, message) std::cout << #severity << message << std::endl
-#else
-    #define WRITE_LOG_MESSAGE_WITH_LOGGER(logger, severity, message) BNB_WRITE_LOG_MESSAGE_WITH_LOGGER(logger, severity) << message
-#endif
+#include "logger.hpp"
 
-#include <iostream>
 #include <string>
 #include "opengl.hpp"
 
@@ -27,6 +16,8 @@ gl::context_info::context_info()
 
     // glGetIntegerv(GL_MAX_TEXTURE_SIZE, &caps.max_texture_size);
     // caps.has_rgba16f = is_rgba16f_available();
+
+    // the instance may be created before any context, GL is touched by init_current_context() only
 }
 
 bool gl::context_info::is_rgba16f_available()
@@ -55,16 +46,88 @@ const char* gl::context_info::error_code_to_string(GLenum error_code) const
     }
 }
 
-void gl::context_info::on_error(GLenum error_code, const char* file, int line)
+void gl::context_info::on_error(GLenum error_code, const char* file, int line, const char* scope)
 {
     WRITE_LOG_MESSAGE(
-        warning, "glGetError: " << error_code_to_string(error_code) << " | " << file << " (" << line << ") ");
+        warning, "glGetError: " << error_code_to_string(error_code) << " | " << file << " (" << line << ") "
+                                << (scope != nullptr ? scope : ""));
 }
 
-void gl::context_info::check_error(const char* file, int line)
+void gl::context_info::check_error(const char* file, int line, const char* scope)
 {
     GLenum error_code;
     while ((error_code = glGetError()) != GL_NO_ERROR) {
-        context_info::instance().on_error(error_code, file, line);
+        context_info::instance().on_error(error_code, file, line, scope);
     }
+}
+
+void gl::context_info::init_current_context()
+{
+    set_error_check_mode(m_error_check_mode, m_sample_period);
+}
+
+void gl::context_info::set_error_check_mode(error_check_mode mode, uint32_t sample_period)
+{
+    m_error_check_mode = mode;
+    m_sample_period = sample_period > 0 ? sample_period : 1;
+
+    bool debug_output = mode == error_check_mode::debug && enable_debug_output(true);
+    if (mode != error_check_mode::debug && m_debug_output_enabled) {
+        enable_debug_output(false);
+    }
+
+    // without KHR_debug the debug mode falls back to checking every call
+    bool check_each_call = (mode == error_check_mode::debug && !debug_output)
+                           || (mode == error_check_mode::sampled && m_frame_index % m_sample_period == 0);
+
+    s_check_each_call.store(check_each_call, std::memory_order_relaxed);
+    s_check_scopes.store(mode == error_check_mode::scoped, std::memory_order_relaxed);
+}
+
+void gl::context_info::begin_frame()
+{
+    ++m_frame_index;
+    if (m_error_check_mode == error_check_mode::sampled) {
+        s_check_each_call.store(m_frame_index % m_sample_period == 0, std::memory_order_relaxed);
+    }
+}
+
+#if defined(GL_KHR_debug)
+namespace
+{
+    void APIENTRY on_debug_message(
+        // clang-format off
+        [[maybe_unused]] GLenum source, GLenum type, GLuint id, GLenum severity,
+        [[maybe_unused]] GLsizei length, const GLchar* message, [[maybe_unused]] const void* user_param
+        // clang-format on
+    )
+    {
+        if (type != GL_DEBUG_TYPE_ERROR && severity != GL_DEBUG_SEVERITY_HIGH) {
+            return;
+        }
+        WRITE_LOG_MESSAGE(warning, "GL debug message " << id << ": " << message);
+    }
+} // namespace
+#endif
+
+bool gl::context_info::enable_debug_output(bool enable)
+{
+#if defined(GL_KHR_debug)
+    if (!GLAD_GL_KHR_debug) {
+        return false;
+    }
+    if (enable) {
+        glEnable(GL_DEBUG_OUTPUT);
+        // the callback runs on the thread of the failed call, so the reports come in order
+        glEnable(GL_DEBUG_OUTPUT_SYNCHRONOUS);
+        glDebugMessageCallback(on_debug_message, nullptr);
+    } else {
+        glDebugMessageCallback(nullptr, nullptr);
+        glDisable(GL_DEBUG_OUTPUT);
+    }
+    m_debug_output_enabled = enable;
+    return true;
+#else
+    return false;
+#endif
 }
\ No newline at end of file
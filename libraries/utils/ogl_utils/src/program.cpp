@@ -1,6 +1,7 @@
 #include "program.hpp"
 
 #include "opengl.hpp"
+#include "program_cache.hpp"
 #include <sstream>
 
 #define BNB_GLSL_VERSION "#version 330 core \n"
@@ -8,66 +9,50 @@
 using namespace bnb;
 using namespace std;
 
-program::program(const char* name, const char* vertex_shader_code, const char* fragmant_shader_code)
-    : m_handle(0)
+namespace
 {
-    ostringstream vsc;
-    vsc << BNB_GLSL_VERSION << endl;
-    vsc << vertex_shader_code << endl;
-    vsc.flush();
-
-    ostringstream fsc;
-    fsc << BNB_GLSL_VERSION << endl;
-    fsc << fragmant_shader_code << endl;
-    fsc.flush();
+    gl::program_source make_source(const char* name, const char* vertex_shader_code, const char* fragmant_shader_code)
+    {
+        ostringstream vsc;
+        vsc << BNB_GLSL_VERSION << endl;
+        vsc << vertex_shader_code << endl;
+        vsc.flush();
 
-    string vsc_str = vsc.str();
-    string fsc_str = fsc.str();
+        ostringstream fsc;
+        fsc << BNB_GLSL_VERSION << endl;
+        fsc << fragmant_shader_code << endl;
+        fsc.flush();
 
-    const char* vsc_str_c = vsc_str.c_str();
-    const char* fsc_str_c = fsc_str.c_str();
+        return {name, vsc.str(), fsc.str()};
+    }
+} // anonymous namespace
 
-    int vertexShader = glCreateShader(GL_VERTEX_SHADER);
-    GL_CALL(glShaderSource(vertexShader, 1, &vsc_str_c, NULL));
-    GL_CALL(glCompileShader(vertexShader));
+program::program(const char* name, const char* vertex_shader_code, const char* fragmant_shader_code)
+    : m_handle(gl::program_cache::instance().build(make_source(name, vertex_shader_code, fragmant_shader_code)))
+{
+}
 
-    // check for shader compile errors
-    int success;
-    char infoLog[512];
-    GL_CALL(glGetShaderiv(vertexShader, GL_COMPILE_STATUS, &success));
-    if (!success)
-    {
-        GL_CALL(glGetShaderInfoLog(vertexShader, 512, NULL, infoLog));
-        throw std::exception();
-    }
+program::program(unsigned int handle)
+    : m_handle(handle)
+{
+}
 
-    // fragment shader
-    int fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
-    GL_CALL(glShaderSource(fragmentShader, 1, &fsc_str_c, NULL));
-    GL_CALL(glCompileShader(fragmentShader));
-    // check for shader compile errors
-    GL_CALL(glGetShaderiv(fragmentShader, GL_COMPILE_STATUS, &success));
-    if (!success)
-    {
-        GL_CALL(glGetShaderInfoLog(fragmentShader, 512, NULL, infoLog));
-        throw std::exception();
+std::vector<std::unique_ptr<program>> program::create(const std::vector<description>& descriptions)
+{
+    std::vector<gl::program_source> sources;
+    sources.reserve(descriptions.size());
+    for (auto& d : descriptions) {
+        sources.push_back(make_source(d.name, d.vertex_shader_code, d.fragmant_shader_code));
     }
 
-    // link shaders
-    unsigned int shaderProgram = glCreateProgram();
-    GL_CALL(glAttachShader(shaderProgram, vertexShader));
-    GL_CALL(glAttachShader(shaderProgram, fragmentShader));
-    GL_CALL(glLinkProgram(shaderProgram));
-    // check for linking errors
-    GL_CALL(glGetProgramiv(shaderProgram, GL_LINK_STATUS, &success));
-    if (!success) {
-        glGetProgramInfoLog(shaderProgram, 512, NULL, infoLog);
-        throw std::exception();
+    auto handles = gl::program_cache::instance().build(sources);
+    std::vector<std::unique_ptr<program>> programs;
+    programs.reserve(handles.size());
+    for (auto handle : handles) {
+        // we use "new" instead of "make_unique" because the constructor is private
+        programs.emplace_back(new program(handle));
     }
-    GL_CALL(glDeleteShader(vertexShader));
-    GL_CALL(glDeleteShader(fragmentShader));
-
-    m_handle = shaderProgram;
+    return programs;
 }
 
 program::~program()
@@ -84,4 +69,3 @@ void program::unuse() const
 {
     GL_CALL(glUseProgram(0));
 }
-
@@ -0,0 +1,427 @@
+#include "program_cache.hpp"
+
+#include "opengl.hpp"
+#include "logger.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace bnb;
+using namespace bnb::gl;
+
+namespace
+{
+    constexpr char file_magic[8] = {'B', 'N', 'B', 'P', 'R', 'G', 'B', '1'};
+
+    struct file_header
+    {
+        char magic[8];
+        uint64_t driver_hash;
+        uint64_t source_hash;
+        uint32_t format;
+        uint32_t length;
+    };
+
+    // FNV-1a
+    uint64_t hash_bytes(const void* data, size_t size, uint64_t hash = 14695981039346656037ull)
+    {
+        auto bytes = static_cast<const uint8_t*>(data);
+        for (size_t i = 0; i < size; ++i) {
+            hash = (hash ^ bytes[i]) * 1099511628211ull;
+        }
+        return hash;
+    }
+
+    uint64_t hash_string(const std::string& value, uint64_t hash = 14695981039346656037ull)
+    {
+        // the terminator separates the concatenated strings
+        return hash_bytes(value.c_str(), value.size() + 1, hash);
+    }
+
+    std::string gl_string(GLenum name)
+    {
+        auto value = reinterpret_cast<const char*>(glGetString(name));
+        return value != nullptr ? value : "";
+    }
+
+    uint64_t elapsed_us(std::chrono::steady_clock::time_point from)
+    {
+        auto us = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - from).count();
+        return us > 0 ? static_cast<uint64_t>(us) : 0;
+    }
+
+    std::string without_trailing_slash(std::string dir)
+    {
+        if (!dir.empty() && dir.back() == '/') {
+            dir.pop_back();
+        }
+        return dir;
+    }
+
+    // the binaries of one user are not visible to, nor replaced by, the others
+    std::string default_directory()
+    {
+        if (auto dir = std::getenv("BNB_PROGRAM_CACHE_DIR")) {
+            return dir;
+        }
+    #ifdef __APPLE__
+        if (auto home = std::getenv("HOME"); home != nullptr && *home != '\0') {
+            return without_trailing_slash(home) + "/Library/Caches/bnb_program_cache";
+        }
+    #else
+        if (auto cache = std::getenv("XDG_CACHE_HOME"); cache != nullptr && *cache != '\0') {
+            return without_trailing_slash(cache) + "/bnb_program_cache";
+        }
+        if (auto home = std::getenv("HOME"); home != nullptr && *home != '\0') {
+            return without_trailing_slash(home) + "/.cache/bnb_program_cache";
+        }
+    #endif
+        std::string tmp = "/tmp";
+        if (auto dir = std::getenv("TMPDIR")) {
+            tmp = without_trailing_slash(dir);
+        }
+        return tmp + "/bnb_program_cache_" + std::to_string(getuid());
+    }
+
+    // creates the missing directories of the path, the last one is private to the user
+    bool make_directories(const std::string& directory)
+    {
+        for (size_t slash = directory.find('/', 1); slash != std::string::npos; slash = directory.find('/', slash + 1)) {
+            if (mkdir(directory.substr(0, slash).c_str(), 0755) != 0 && errno != EEXIST) {
+                return false;
+            }
+        }
+        return mkdir(directory.c_str(), 0700) == 0 || errno == EEXIST;
+    }
+
+    std::string shader_log(GLuint shader)
+    {
+        GLint length = 0;
+        glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &length);
+        std::string log(size_t(std::max(length, 1)), '\0');
+        glGetShaderInfoLog(shader, length, nullptr, log.data());
+        return log.c_str();
+    }
+
+    std::string program_log(GLuint program)
+    {
+        GLint length = 0;
+        glGetProgramiv(program, GL_INFO_LOG_LENGTH, &length);
+        std::string log(size_t(std::max(length, 1)), '\0');
+        glGetProgramInfoLog(program, length, nullptr, log.data());
+        return log.c_str();
+    }
+} // anonymous namespace
+
+program_cache::program_cache()
+{
+    set_directory(default_directory());
+}
+
+void program_cache::set_directory(const std::string& directory)
+{
+    if (!directory.empty() && !make_directories(directory)) {
+        WRITE_LOG_MESSAGE(warning, "Failed to create the program cache directory " << directory << ", binaries are kept in memory only");
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_directory.clear();
+        return;
+    }
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_directory = directory;
+}
+
+std::string program_cache::directory() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_directory;
+}
+
+program_cache::stats_t program_cache::stats() const
+{
+    stats_t result;
+    result.memory_hits = m_memory_hits.load(std::memory_order_relaxed);
+    result.disk_hits = m_disk_hits.load(std::memory_order_relaxed);
+    result.misses = m_misses.load(std::memory_order_relaxed);
+    result.rejected = m_rejected.load(std::memory_order_relaxed);
+    result.compile_us = m_compile_us.snapshot();
+    result.load_us = m_load_us.snapshot();
+    return result;
+}
+
+bool program_cache::binaries_supported()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_binaries_supported < 0) {
+        // a driver may implement the API yet support no binary format, e.g. some software renderers
+        GLint formats = 0;
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+        m_binaries_supported = formats > 0 ? 1 : 0;
+        if (m_binaries_supported == 0) {
+            WRITE_LOG_MESSAGE(info, "The driver supports no program binary format, programs are always compiled");
+        }
+    }
+    if (!m_parallel_compile_enabled && GLAD_GL_KHR_parallel_shader_compile) {
+        // let the driver pick the number of compiler threads
+        glMaxShaderCompilerThreadsKHR(0xFFFFFFFF);
+        m_parallel_compile_enabled = true;
+    }
+    return m_binaries_supported == 1;
+}
+
+uint64_t program_cache::driver_hash()
+{
+    auto hash = hash_string(gl_string(GL_VENDOR));
+    hash = hash_string(gl_string(GL_RENDERER), hash);
+    hash = hash_string(gl_string(GL_VERSION), hash);
+    return hash_string(gl_string(GL_SHADING_LANGUAGE_VERSION), hash);
+}
+
+std::vector<GLuint> program_cache::build(const std::vector<program_source>& sources)
+{
+    const bool use_binaries = binaries_supported();
+    const auto driver = driver_hash();
+
+    std::vector<GLuint> programs(sources.size(), 0);
+    std::vector<pending_t> pending;
+    for (size_t i = 0; i < sources.size(); ++i) {
+        auto& source = sources[i];
+        auto source_hash = hash_string(source.fragment, hash_string(source.vertex));
+        if (use_binaries) {
+            programs[i] = load_binary(source, source_hash, driver);
+            if (programs[i] != 0) {
+                continue;
+            }
+        }
+        m_misses.fetch_add(1, std::memory_order_relaxed);
+        // only submitted, the status queries of finish() would wait for the compiler
+        pending.push_back(submit(i, source, source_hash));
+    }
+
+    for (size_t i = 0; i < pending.size(); ++i) {
+        try {
+            programs[pending[i].index] = finish(sources[pending[i].index], pending[i], use_binaries ? driver : 0);
+        } catch (...) {
+            for (size_t j = i + 1; j < pending.size(); ++j) {
+                glDeleteShader(pending[j].vertex_shader);
+                glDeleteShader(pending[j].fragment_shader);
+                glDeleteProgram(pending[j].program);
+            }
+            for (auto program : programs) {
+                if (program != 0) {
+                    glDeleteProgram(program);
+                }
+            }
+            throw;
+        }
+    }
+    return programs;
+}
+
+GLuint program_cache::load_binary(const program_source& source, uint64_t source_hash, uint64_t driver)
+{
+    const auto key = source_hash ^ (driver * 31);
+    binary_t binary;
+    bool from_disk = false;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto it = m_binaries.find(key);
+        if (it != m_binaries.end()) {
+            binary = it->second;
+        }
+    }
+    if (binary.data.empty()) {
+        if (!read_file(source.name, source_hash, driver, binary)) {
+            return 0;
+        }
+        from_disk = true;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    GLuint program = glCreateProgram();
+    glProgramBinary(program, binary.format, binary.data.data(), GLsizei(binary.data.size()));
+    GLint success = 0;
+    glGetProgramiv(program, GL_LINK_STATUS, &success);
+    if (!success) {
+        // the driver was updated without changing its strings or the file is damaged
+        glDeleteProgram(program);
+        m_rejected.fetch_add(1, std::memory_order_relaxed);
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_binaries.erase(key);
+        return 0;
+    }
+    m_load_us.record(elapsed_us(start));
+
+    if (from_disk) {
+        m_disk_hits.fetch_add(1, std::memory_order_relaxed);
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_binaries[key] = std::move(binary);
+    } else {
+        m_memory_hits.fetch_add(1, std::memory_order_relaxed);
+    }
+    return program;
+}
+
+program_cache::pending_t program_cache::submit(size_t index, const program_source& source, uint64_t source_hash)
+{
+    pending_t result;
+    result.index = index;
+    result.source_hash = source_hash;
+    result.submitted = std::chrono::steady_clock::now();
+
+    const char* vertex = source.vertex.c_str();
+    const char* fragment = source.fragment.c_str();
+
+    result.vertex_shader = glCreateShader(GL_VERTEX_SHADER);
+    GL_CALL(glShaderSource(result.vertex_shader, 1, &vertex, nullptr));
+    GL_CALL(glCompileShader(result.vertex_shader));
+
+    result.fragment_shader = glCreateShader(GL_FRAGMENT_SHADER);
+    GL_CALL(glShaderSource(result.fragment_shader, 1, &fragment, nullptr));
+    GL_CALL(glCompileShader(result.fragment_shader));
+
+    result.program = glCreateProgram();
+    GL_CALL(glAttachShader(result.program, result.vertex_shader));
+    GL_CALL(glAttachShader(result.program, result.fragment_shader));
+    GL_CALL(glProgramParameteri(result.program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE));
+    GL_CALL(glLinkProgram(result.program));
+    return result;
+}
+
+GLuint program_cache::finish(const program_source& source, const pending_t& pending, uint64_t driver)
+{
+    GLint success = 0;
+    glGetProgramiv(pending.program, GL_LINK_STATUS, &success);
+    if (!success) {
+        std::string log;
+        GLint compiled = 0;
+        glGetShaderiv(pending.vertex_shader, GL_COMPILE_STATUS, &compiled);
+        if (!compiled) {
+            log = "vertex shader: " + shader_log(pending.vertex_shader);
+        }
+        glGetShaderiv(pending.fragment_shader, GL_COMPILE_STATUS, &compiled);
+        if (!compiled) {
+            log += "fragment shader: " + shader_log(pending.fragment_shader);
+        }
+        if (log.empty()) {
+            log = "link: " + program_log(pending.program);
+        }
+        glDeleteShader(pending.vertex_shader);
+        glDeleteShader(pending.fragment_shader);
+        glDeleteProgram(pending.program);
+        WRITE_LOG_MESSAGE(error, "Failed to build the program " << source.name << ", " << log);
+        throw std::runtime_error("failed to build the program " + source.name);
+    }
+
+    GL_CALL(glDetachShader(pending.program, pending.vertex_shader));
+    GL_CALL(glDetachShader(pending.program, pending.fragment_shader));
+    GL_CALL(glDeleteShader(pending.vertex_shader));
+    GL_CALL(glDeleteShader(pending.fragment_shader));
+
+    auto compile_us = elapsed_us(pending.submitted);
+    m_compile_us.record(compile_us);
+    WRITE_LOG_MESSAGE(debug, "Program " << source.name << " compiled in " << compile_us / 1000.0 << " ms");
+
+    if (driver != 0) {
+        binary_t binary;
+        GLint length = 0;
+        glGetProgramiv(pending.program, GL_PROGRAM_BINARY_LENGTH, &length);
+        if (length > 0) {
+            binary.data.resize(size_t(length));
+            GLsizei written = 0;
+            glGetProgramBinary(pending.program, length, &written, &binary.format, binary.data.data());
+            binary.data.resize(size_t(written));
+        }
+        if (!binary.data.empty()) {
+            write_file(source.name, pending.source_hash, driver, binary);
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_binaries[pending.source_hash ^ (driver * 31)] = std::move(binary);
+        }
+    }
+    return pending.program;
+}
+
+std::string program_cache::file_path(const std::string& name, uint64_t source_hash) const
+{
+    char hash[17];
+    std::snprintf(hash, sizeof(hash), "%016llx", static_cast<unsigned long long>(source_hash));
+    return m_directory + "/" + name + "_" + hash + ".bin";
+}
+
+bool program_cache::read_file(const std::string& name, uint64_t source_hash, uint64_t driver, binary_t& binary)
+{
+    std::string path;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_directory.empty()) {
+            return false;
+        }
+        path = file_path(name, source_hash);
+    }
+
+    auto file = std::fopen(path.c_str(), "rb");
+    if (file == nullptr) {
+        return false;
+    }
+    file_header header;
+    bool valid = std::fread(&header, sizeof(header), 1, file) == 1
+                 && std::memcmp(header.magic, file_magic, sizeof(file_magic)) == 0
+                 && header.source_hash == source_hash;
+    if (valid && header.driver_hash != driver) {
+        WRITE_LOG_MESSAGE(info, "The driver changed, the program " << name << " is compiled again");
+        valid = false;
+    }
+    if (valid) {
+        binary.format = header.format;
+        binary.data.resize(header.length);
+        valid = std::fread(binary.data.data(), 1, header.length, file) == header.length;
+    }
+    std::fclose(file);
+    return valid;
+}
+
+void program_cache::write_file(const std::string& name, uint64_t source_hash, uint64_t driver, const binary_t& binary)
+{
+    std::string path;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_directory.empty()) {
+            return;
+        }
+        path = file_path(name, source_hash);
+    }
+
+    file_header header{};
+    std::memcpy(header.magic, file_magic, sizeof(file_magic));
+    header.driver_hash = driver;
+    header.source_hash = source_hash;
+    header.format = binary.format;
+    header.length = static_cast<uint32_t>(binary.data.size());
+
+    // another process may read or write the file at the same time, so each writer has
+    // a temporary file of its own which atomically replaces the binary
+    auto tmp_path = path + ".XXXXXX";
+    auto fd = mkstemp(tmp_path.data());
+    auto file = fd != -1 ? fdopen(fd, "wb") : nullptr;
+    if (file == nullptr) {
+        WRITE_LOG_MESSAGE(warning, "Failed to write the program binary " << path);
+        if (fd != -1) {
+            close(fd);
+            std::remove(tmp_path.c_str());
+        }
+        return;
+    }
+    bool written = std::fwrite(&header, sizeof(header), 1, file) == 1
+                   && std::fwrite(binary.data.data(), 1, binary.data.size(), file) == binary.data.size();
+    written = std::fclose(file) == 0 && written;
+    if (!written || std::rename(tmp_path.c_str(), path.c_str()) != 0) {
+        WRITE_LOG_MESSAGE(warning, "Failed to write the program binary " << path);
+        std::remove(tmp_path.c_str());
+    }
+}
@@ -0,0 +1,99 @@
+#include "state_cache.hpp"
+
+#include "opengl.hpp"
+#include "logger.hpp"
+
+using namespace bnb;
+
+void gl::state_cache::bind_framebuffer(GLuint framebuffer)
+{
+    if (update(m_framebuffer, framebuffer)) {
+        GL_CALL(glBindFramebuffer(GL_FRAMEBUFFER, framebuffer));
+    }
+}
+
+void gl::state_cache::use_program(GLuint program)
+{
+    if (update(m_program, program)) {
+        GL_CALL(glUseProgram(program));
+    }
+}
+
+void gl::state_cache::bind_vertex_array(GLuint vao)
+{
+    if (update(m_vao, vao)) {
+        GL_CALL(glBindVertexArray(vao));
+    }
+}
+
+void gl::state_cache::bind_texture_2d(GLuint texture)
+{
+    if (update(m_texture_2d, texture)) {
+        GL_CALL(glBindTexture(GL_TEXTURE_2D, texture));
+    }
+}
+
+void gl::state_cache::viewport(GLint x, GLint y, GLsizei width, GLsizei height)
+{
+    if (update(m_viewport, viewport_t{x, y, width, height})) {
+        GL_CALL(glViewport(x, y, width, height));
+    }
+}
+
+bool gl::state_cache::attach_color_texture(GLuint framebuffer, GLuint texture)
+{
+    bind_framebuffer(framebuffer);
+
+    auto& attachment = m_attachments[framebuffer];
+    if (attachment.texture == texture && texture != 0) {
+        // glFramebufferTexture2D and glCheckFramebufferStatus
+        m_counters.attachments_elided += 2;
+        return attachment.complete;
+    }
+
+    GL_CALL(glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture, 0));
+    GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+    m_counters.attachments_issued += 2;
+
+    attachment.texture = texture;
+    attachment.complete = status == GL_FRAMEBUFFER_COMPLETE;
+    if (!attachment.complete) {
+        WRITE_LOG_MESSAGE(error, "Failed to make complete framebuffer object " << status);
+    }
+    return attachment.complete;
+}
+
+void gl::state_cache::invalidate_bindings()
+{
+    m_framebuffer.valid = false;
+    m_program.valid = false;
+    m_vao.valid = false;
+    m_texture_2d.valid = false;
+    m_viewport.valid = false;
+}
+
+void gl::state_cache::forget_texture(GLuint texture)
+{
+    for (auto& [framebuffer, attachment] : m_attachments) {
+        if (attachment.texture == texture) {
+            attachment = attachment_t{};
+        }
+    }
+    if (m_texture_2d.value == texture) {
+        m_texture_2d.valid = false;
+    }
+}
+
+void gl::state_cache::forget_framebuffer(GLuint framebuffer)
+{
+    m_attachments.erase(framebuffer);
+    if (m_framebuffer.value == framebuffer) {
+        m_framebuffer.valid = false;
+    }
+}
+
+void gl::state_cache::begin_frame()
+{
+    m_last_frame_counters = m_counters;
+    m_counters = counters_t{};
+}
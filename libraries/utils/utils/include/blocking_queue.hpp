@@ -0,0 +1,62 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <optional>
+
+namespace bnb
+{
+    /**
+     * Bounded FIFO between the pipeline stages: push blocks while the queue is full,
+     * pop blocks while it is empty. After close() push fails and pop drains the rest.
+     */
+    template<typename T>
+    class blocking_queue
+    {
+    public:
+        explicit blocking_queue(size_t capacity)
+            : m_capacity(capacity > 0 ? capacity : 1) {}
+
+        bool push(T value)
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_not_full.wait(lock, [this]() { return m_closed || m_items.size() < m_capacity; });
+            if (m_closed) {
+                return false;
+            }
+            m_items.push_back(std::move(value));
+            m_not_empty.notify_one();
+            return true;
+        }
+
+        std::optional<T> pop()
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_not_empty.wait(lock, [this]() { return m_closed || !m_items.empty(); });
+            if (m_items.empty()) {
+                return std::nullopt;
+            }
+            auto value = std::move(m_items.front());
+            m_items.pop_front();
+            m_not_full.notify_one();
+            return value;
+        }
+
+        void close()
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_closed = true;
+            m_not_full.notify_all();
+            m_not_empty.notify_all();
+        }
+
+    private:
+        const size_t m_capacity;
+        std::mutex m_mutex;
+        std::condition_variable m_not_full;
+        std::condition_variable m_not_empty;
+        std::deque<T> m_items;
+        bool m_closed{false};
+    };
+} // bnb
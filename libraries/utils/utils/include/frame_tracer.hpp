@@ -0,0 +1,206 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace bnb
+{
+    /**
+     * Process wide tracer of the frames lifetime. Every thread writes events into its own
+     * ring buffer without locks, the buffers are merged only when the trace is dumped
+     * in Chrome trace event format (chrome://tracing, ui.perfetto.dev).
+     * The ring keeps the last events_per_thread events of the thread.
+     * Frame ids are numbered by their sources, e.g. every player, so an event names its
+     * source too; new_source_id() gives every source an id of its own.
+     */
+    class frame_tracer
+    {
+    public:
+        static constexpr size_t events_per_thread = 1 << 14;
+
+        struct event_t
+        {
+            uint32_t source_id;
+            uint64_t frame_id;
+            int64_t timestamp_ns;
+            const char* stage; // must be a string literal
+        };
+
+        static frame_tracer& instance()
+        {
+            static frame_tracer tracer;
+            return tracer;
+        }
+
+        // an id of the events of a new source of frames, unique within the process
+        uint32_t new_source_id() { return ++m_last_source_id; }
+
+        void set_enabled(bool enabled) { m_enabled.store(enabled, std::memory_order_relaxed); }
+        bool is_enabled() const { return m_enabled.load(std::memory_order_relaxed); }
+
+        /**
+         * Record the moment the frame of the source passes the stage on the current thread.
+         * Lock free except of the very first call on the thread. No-op if the tracer is disabled.
+         */
+        void trace(uint32_t source_id, uint64_t frame_id, const char* stage)
+        {
+            if (!is_enabled()) {
+                return;
+            }
+
+            auto& buffer = current_thread_buffer();
+            auto head = buffer.head.load(std::memory_order_relaxed);
+            buffer.events[head % events_per_thread] = event_t{source_id, frame_id, now_ns(), stage};
+            buffer.head.store(head + 1, std::memory_order_release);
+        }
+
+        /**
+         * Name of the current thread in the trace
+         */
+        void set_thread_name(const std::string& name)
+        {
+            auto& buffer = current_thread_buffer();
+            std::lock_guard<std::mutex> lock(m_mutex);
+            buffer.name = name;
+        }
+
+        /**
+         * Chrome trace JSON. Every event becomes a span that starts at the previous event
+         * of the same frame, on the thread which finished the stage, so the slow stage and
+         * its thread are visible at once. Events also appear as instant markers.
+         */
+        std::string dump_chrome_trace()
+        {
+            struct record_t
+            {
+                event_t event;
+                uint32_t tid;
+            };
+
+            std::vector<record_t> records;
+            std::vector<std::pair<uint32_t, std::string>> thread_names;
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                for (auto& buffer : m_buffers) {
+                    auto head = buffer->head.load(std::memory_order_acquire);
+                    auto first = head > events_per_thread ? head - events_per_thread : 0;
+                    std::vector<event_t> events;
+                    for (auto i = first; i < head; ++i) {
+                        events.push_back(buffer->events[i % events_per_thread]);
+                    }
+
+                    // the owner could overwrite the oldest events while they were copied
+                    auto head_after = buffer->head.load(std::memory_order_acquire);
+                    auto valid_from = head_after > events_per_thread ? head_after - events_per_thread : 0;
+                    for (auto i = std::max(first, valid_from); i < head; ++i) {
+                        records.push_back({events[i - first], buffer->tid});
+                    }
+                    thread_names.emplace_back(buffer->tid, buffer->name);
+                }
+            }
+
+            std::sort(records.begin(), records.end(), [](const record_t& a, const record_t& b) {
+                return a.event.timestamp_ns < b.event.timestamp_ns;
+            });
+
+            std::ostringstream out;
+            out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+            bool first_event = true;
+            auto separator = [&out, &first_event]() {
+                if (!first_event) {
+                    out << ",";
+                }
+                first_event = false;
+            };
+
+            for (auto& [tid, name] : thread_names) {
+                separator();
+                out << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << tid
+                    << ",\"args\":{\"name\":\"" << (name.empty() ? "thread " + std::to_string(tid) : name) << "\"}}";
+            }
+
+            std::map<std::pair<uint32_t, uint64_t>, int64_t> previous_event_ns;
+            for (auto& record : records) {
+                auto& event = record.event;
+                auto ts_us = static_cast<double>(event.timestamp_ns) / 1000.0;
+
+                separator();
+                out << "{\"name\":\"" << event.stage << "\",\"cat\":\"frame\",\"ph\":\"i\",\"s\":\"t\",\"pid\":1,\"tid\":" << record.tid
+                    << ",\"ts\":" << std::fixed << ts_us
+                    << ",\"args\":{\"source\":" << event.source_id << ",\"frame\":" << event.frame_id << "}}";
+
+                auto key = std::make_pair(event.source_id, event.frame_id);
+                auto previous = previous_event_ns.find(key);
+                if (previous != previous_event_ns.end()) {
+                    auto start_us = static_cast<double>(previous->second) / 1000.0;
+                    separator();
+                    out << "{\"name\":\"" << event.stage << "\",\"cat\":\"stage\",\"ph\":\"X\",\"pid\":1,\"tid\":" << record.tid
+                        << ",\"ts\":" << std::fixed << start_us << ",\"dur\":" << (ts_us - start_us)
+                        << ",\"args\":{\"source\":" << event.source_id << ",\"frame\":" << event.frame_id << "}}";
+                }
+                previous_event_ns[key] = event.timestamp_ns;
+            }
+            out << "]}";
+            return out.str();
+        }
+
+        bool write_chrome_trace(const std::string& path)
+        {
+            std::ofstream file(path, std::ios::out | std::ios::trunc);
+            if (!file) {
+                return false;
+            }
+            file << dump_chrome_trace();
+            return static_cast<bool>(file);
+        }
+
+    private:
+        struct thread_buffer
+        {
+            std::atomic<uint64_t> head{0};
+            std::array<event_t, events_per_thread> events;
+            uint32_t tid{0};
+            std::string name;
+        };
+
+        frame_tracer()
+            : m_epoch(std::chrono::steady_clock::now()) {}
+
+        int64_t now_ns() const
+        {
+            return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - m_epoch).count();
+        }
+
+        thread_buffer& current_thread_buffer()
+        {
+            // the tracer is the singleton, the buffers are owned by it and outlive the thread
+            thread_local thread_buffer* buffer = nullptr;
+            if (buffer == nullptr) {
+                auto new_buffer = std::make_unique<thread_buffer>();
+                std::lock_guard<std::mutex> lock(m_mutex);
+                new_buffer->tid = static_cast<uint32_t>(m_buffers.size() + 1);
+                buffer = new_buffer.get();
+                m_buffers.push_back(std::move(new_buffer));
+            }
+            return *buffer;
+        }
+
+        const std::chrono::steady_clock::time_point m_epoch;
+        std::atomic<bool> m_enabled{false};
+        std::atomic<uint32_t> m_last_source_id{0};
+
+        std::mutex m_mutex;
+        std::vector<std::unique_ptr<thread_buffer>> m_buffers;
+    };
+} // bnb
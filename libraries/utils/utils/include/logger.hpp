@@ -0,0 +1,418 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace bnb
+{
+    enum class log_severity : uint32_t
+    {
+        debug,
+        info,
+        warning,
+        error
+    };
+
+    inline const char* log_severity_to_string(log_severity severity)
+    {
+        switch (severity) {
+            case log_severity::debug: return "[DEBUG] ";
+            case log_severity::info: return "[INFO] ";
+            case log_severity::warning: return "[WARNING] ";
+            case log_severity::error: return "[ERROR] ";
+        }
+        return "";
+    }
+
+    /**
+     * Limits the messages of one call site to burst messages per window, the messages
+     * over the limit are counted and the count is reported later by the logger.
+     * Declared as a function-local static by WRITE_LOG_MESSAGE, lock free.
+     */
+    class log_rate_limiter
+    {
+    public:
+        static constexpr uint32_t default_burst = 5;
+        static constexpr int64_t default_window_ms = 1000;
+
+        log_rate_limiter(const char* file, int line, uint32_t burst = default_burst, int64_t window_ms = default_window_ms);
+
+        /**
+         * @param suppressed set to the number of messages dropped since the last allowed one
+         * @return true if the message should be written
+         */
+        bool allow(uint64_t& suppressed)
+        {
+            // the window start and the count change in one CAS, so a message counted
+            // in the old window can not leak into the new one
+            auto now = now_ms() - m_origin_ms;
+            auto state = m_state.load(std::memory_order_relaxed);
+            uint64_t next;
+            do {
+                auto window_start = int64_t(state >> count_bits);
+                auto count = state & count_mask;
+                next = now - window_start >= m_window_ms
+                    ? (uint64_t(now) << count_bits) | 1
+                    : state + (count < count_mask ? 1 : 0);
+            } while (!m_state.compare_exchange_weak(state, next, std::memory_order_relaxed));
+
+            if ((next & count_mask) <= m_burst) {
+                suppressed = m_suppressed.exchange(0, std::memory_order_relaxed);
+                return true;
+            }
+            m_suppressed.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+
+        /**
+         * Take the count of suppressed messages if the call site is quiet for the whole window
+         */
+        uint64_t take_stale_suppressed()
+        {
+            auto window_start = int64_t(m_state.load(std::memory_order_relaxed) >> count_bits);
+            if (now_ms() - m_origin_ms - window_start < m_window_ms) {
+                return 0;
+            }
+            return m_suppressed.exchange(0, std::memory_order_relaxed);
+        }
+
+        const char* file() const { return m_file; }
+        int line() const { return m_line; }
+
+        static int64_t now_ms()
+        {
+            return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+        }
+
+    private:
+        // m_state is the window start in ms since m_origin_ms above the count of its messages
+        static constexpr uint32_t count_bits = 24;
+        static constexpr uint64_t count_mask = (uint64_t(1) << count_bits) - 1;
+
+        const char* m_file;
+        int m_line;
+        const uint32_t m_burst;
+        const int64_t m_window_ms;
+        const int64_t m_origin_ms;
+
+        std::atomic<uint64_t> m_state{0};
+        std::atomic<uint64_t> m_suppressed{0};
+    };
+
+    /**
+     * Asynchronous logger. Writers format the message on their thread and put it to
+     * a bounded lock-free ring (Vyukov MPMC queue), a background thread drains the ring
+     * to the sink in batches. If the ring is full the message is dropped and counted,
+     * the writer never waits for the console.
+     */
+    class logger
+    {
+    public:
+        using sink_t = std::function<void(log_severity severity, const std::string& line)>;
+
+        static constexpr size_t ring_capacity = 1024; // power of two
+        static constexpr size_t max_message_size = 256; // longer messages are cut and end with "..."
+        static constexpr int64_t drain_period_ms = 20;
+
+        static logger& instance()
+        {
+            // never destroyed, so it is safe to log from destructors of other static objects
+            static logger* instance = [] {
+                auto result = new logger();
+                std::atexit([] { logger::instance().shutdown(); });
+                return result;
+            }();
+            return *instance;
+        }
+
+        void set_min_severity(log_severity severity) { m_min_severity.store(severity, std::memory_order_relaxed); }
+        bool is_enabled(log_severity severity) const { return severity >= m_min_severity.load(std::memory_order_relaxed); }
+
+        /**
+         * Replace the output, std::cout by default. The sink is called on the drain thread.
+         */
+        void set_sink(sink_t sink)
+        {
+            std::lock_guard<std::mutex> lock(m_sink_mutex);
+            m_sink = std::move(sink);
+        }
+
+        void write(log_severity severity, const char* message, size_t size)
+        {
+            if (m_stopped.load(std::memory_order_acquire)) {
+                // after shutdown there is nobody to drain the ring
+                write_to_sink(severity, log_severity_to_string(severity) + std::string(message, size) + "\n");
+                return;
+            }
+
+            auto position = m_enqueue_position.load(std::memory_order_relaxed);
+            slot_t* slot;
+            for (;;) {
+                slot = &m_ring[position % ring_capacity];
+                auto sequence = slot->sequence.load(std::memory_order_acquire);
+                auto diff = static_cast<int64_t>(sequence) - static_cast<int64_t>(position);
+                if (diff == 0) {
+                    if (m_enqueue_position.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                        break;
+                    }
+                } else if (diff < 0) {
+                    m_dropped.fetch_add(1, std::memory_order_relaxed);
+                    return;
+                } else {
+                    position = m_enqueue_position.load(std::memory_order_relaxed);
+                }
+            }
+
+            slot->severity = severity;
+            if (size <= max_message_size) {
+                slot->size = size;
+                std::memcpy(slot->text, message, size);
+            } else {
+                // cut on a UTF-8 character boundary and mark the message as truncated
+                static constexpr char marker[] = "...";
+                auto kept = max_message_size - (sizeof(marker) - 1);
+                while (kept > 0 && (static_cast<uint8_t>(message[kept]) & 0xC0) == 0x80) {
+                    --kept;
+                }
+                std::memcpy(slot->text, message, kept);
+                std::memcpy(slot->text + kept, marker, sizeof(marker) - 1);
+                slot->size = kept + sizeof(marker) - 1;
+            }
+            slot->sequence.store(position + 1, std::memory_order_release);
+        }
+
+        void write(log_severity severity, const std::string& message)
+        {
+            write(severity, message.data(), message.size());
+        }
+
+        /**
+         * Wait until everything written before the call reaches the sink
+         */
+        void flush()
+        {
+            if (m_stopped.load(std::memory_order_acquire)) {
+                return;
+            }
+            std::unique_lock<std::mutex> lock(m_drain_mutex);
+            auto target = ++m_flush_requests;
+            m_drain_cv.notify_one();
+            m_flushed_cv.wait(lock, [this, target] { return m_flushes_done >= target || m_stopped; });
+        }
+
+        /**
+         * Drain the ring and stop the thread, later messages are written synchronously
+         */
+        void shutdown()
+        {
+            {
+                std::lock_guard<std::mutex> lock(m_drain_mutex);
+                if (m_stopping) {
+                    return;
+                }
+                m_stopping = true;
+            }
+            m_drain_cv.notify_one();
+            if (m_thread.joinable()) {
+                m_thread.join();
+            }
+        }
+
+        void register_limiter(log_rate_limiter* limiter)
+        {
+            std::lock_guard<std::mutex> lock(m_limiters_mutex);
+            m_limiters.push_back(limiter);
+        }
+
+    private:
+        struct slot_t
+        {
+            std::atomic<uint64_t> sequence{0};
+            log_severity severity{log_severity::info};
+            size_t size{0};
+            char text[max_message_size];
+        };
+
+        logger()
+            : m_ring(ring_capacity)
+        {
+            for (size_t i = 0; i < ring_capacity; ++i) {
+                m_ring[i].sequence.store(i, std::memory_order_relaxed);
+            }
+            m_thread = std::thread([this] { drain_loop(); });
+        }
+
+        void drain_loop()
+        {
+            for (;;) {
+                uint64_t flush_target;
+                bool stopping;
+                {
+                    std::unique_lock<std::mutex> lock(m_drain_mutex);
+                    m_drain_cv.wait_for(lock, std::chrono::milliseconds(drain_period_ms), [this] {
+                        return m_stopping || m_flush_requests > m_flushes_done;
+                    });
+                    flush_target = m_flush_requests;
+                    stopping = m_stopping;
+                }
+
+                drain();
+                report_suppressed();
+
+                std::lock_guard<std::mutex> lock(m_drain_mutex);
+                m_flushes_done = flush_target;
+                if (stopping) {
+                    m_stopped.store(true, std::memory_order_release);
+                }
+                m_flushed_cv.notify_all();
+                if (stopping) {
+                    break;
+                }
+            }
+            // messages which raced with the stop
+            drain();
+        }
+
+        void drain()
+        {
+            std::lock_guard<std::mutex> lock(m_sink_mutex);
+            std::string batch;
+            auto position = m_dequeue_position;
+            for (;;) {
+                auto& slot = m_ring[position % ring_capacity];
+                if (slot.sequence.load(std::memory_order_acquire) != position + 1) {
+                    break;
+                }
+                batch.append(log_severity_to_string(slot.severity));
+                batch.append(slot.text, slot.size);
+                batch.push_back('\n');
+                if (m_sink) {
+                    m_sink(slot.severity, batch);
+                    batch.clear();
+                }
+                slot.sequence.store(position + ring_capacity, std::memory_order_release);
+                ++position;
+            }
+            m_dequeue_position = position;
+
+            if (auto dropped = m_dropped.exchange(0, std::memory_order_relaxed)) {
+                batch.append("[WARNING] " + std::to_string(dropped) + " log messages dropped, the log ring is full\n");
+            }
+            if (batch.empty()) {
+                return;
+            }
+            // one write and one flush per batch instead of per message
+            if (m_sink) {
+                m_sink(log_severity::warning, batch);
+            } else {
+                std::cout << batch << std::flush;
+            }
+        }
+
+        void report_suppressed()
+        {
+            std::lock_guard<std::mutex> lock(m_limiters_mutex);
+            for (auto limiter : m_limiters) {
+                if (auto suppressed = limiter->take_stale_suppressed()) {
+                    std::ostringstream line;
+                    line << "[INFO] " << suppressed << " similar messages suppressed at " << limiter->file() << ":" << limiter->line() << "\n";
+                    write_to_sink(log_severity::info, line.str());
+                }
+            }
+        }
+
+        void write_to_sink(log_severity severity, const std::string& text)
+        {
+            std::lock_guard<std::mutex> lock(m_sink_mutex);
+            if (m_sink) {
+                m_sink(severity, text);
+            } else {
+                std::cout << text << std::flush;
+            }
+        }
+
+        std::vector<slot_t> m_ring;
+        alignas(64) std::atomic<uint64_t> m_enqueue_position{0};
+        alignas(64) uint64_t m_dequeue_position{0}; // drain thread only
+        std::atomic<uint64_t> m_dropped{0};
+        std::atomic<log_severity> m_min_severity{log_severity::info};
+
+        std::mutex m_sink_mutex;
+        sink_t m_sink;
+
+        std::mutex m_limiters_mutex;
+        std::vector<log_rate_limiter*> m_limiters;
+
+        std::mutex m_drain_mutex;
+        std::condition_variable m_drain_cv;
+        std::condition_variable m_flushed_cv;
+        uint64_t m_flush_requests{0};
+        uint64_t m_flushes_done{0};
+        bool m_stopping{false};
+        std::atomic<bool> m_stopped{false};
+        std::thread m_thread;
+    };
+
+    inline log_rate_limiter::log_rate_limiter(const char* file, int line, uint32_t burst, int64_t window_ms)
+        : m_file(file)
+        , m_line(line)
+        , m_burst(burst)
+        , m_window_ms(window_ms)
+        , m_origin_ms(now_ms())
+    {
+        logger::instance().register_limiter(this);
+    }
+
+    namespace detail
+    {
+        inline std::ostringstream& log_stream()
+        {
+            thread_local std::ostringstream stream;
+            stream.str(std::string());
+            stream.clear();
+            return stream;
+        }
+    } // namespace detail
+} // bnb
+
+/**
+ * Write the message to the asynchronous logger, rate limited per call site.
+ * The message is a stream expression, e.g. WRITE_LOG_MESSAGE(warning, "size " << size)
+ */
+#ifndef BNB_WRITE_LOG_MESSAGE
+    #define WRITE_LOG_MESSAGE(severity, message)                                                                         \
+        do {                                                                                                            \
+            if (::bnb::logger::instance().is_enabled(::bnb::log_severity::severity)) {                                  \
+                static ::bnb::log_rate_limiter bnb_log_limiter(__FILE__, __LINE__);                                     \
+                uint64_t bnb_log_suppressed = 0;                                                                        \
+                if (bnb_log_limiter.allow(bnb_log_suppressed)) {                                                        \
+                    auto& bnb_log_stream = ::bnb::detail::log_stream();                                                 \
+                    bnb_log_stream << message;                                                                          \
+                    if (bnb_log_suppressed != 0) {                                                                      \
+                        bnb_log_stream << " (" << bnb_log_suppressed << " similar messages suppressed)";                \
+                    }                                                                                                   \
+                    ::bnb::logger::instance().write(::bnb::log_severity::severity, bnb_log_stream.str());               \
+                }                                                                                                       \
+            }                                                                                                           \
+        } while (0)
+#else
+    #define WRITE_LOG_MESSAGE(severity, message) BNB_WRITE_LOG_MESSAGE(severity) << message
+#endif
+
+#ifndef BNB_WRITE_LOG_MESSAGE_WITH_LOGGER
+    #define WRITE_LOG_MESSAGE_WITH_LOGGER(logger, severity, message) WRITE_LOG_MESSAGE(severity, message)
+#else
+    #define WRITE_LOG_MESSAGE_WITH_LOGGER(logger, severity, message) BNB_WRITE_LOG_MESSAGE_WITH_LOGGER(logger, severity) << message
+#endif
@@ -0,0 +1,182 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+namespace bnb::metrics
+{
+    /**
+     * Monotonic counter, wait-free increment.
+     */
+    class counter
+    {
+    public:
+        void add(uint64_t value = 1) { m_value.fetch_add(value, std::memory_order_relaxed); }
+        uint64_t get() const { return m_value.load(std::memory_order_relaxed); }
+
+    private:
+        std::atomic<uint64_t> m_value{0};
+    };
+
+    /**
+     * Value that goes up and down, wait-free update.
+     */
+    class gauge
+    {
+    public:
+        void set(int64_t value) { m_value.store(value, std::memory_order_relaxed); }
+        void add(int64_t value) { m_value.fetch_add(value, std::memory_order_relaxed); }
+        int64_t get() const { return m_value.load(std::memory_order_relaxed); }
+
+    private:
+        std::atomic<int64_t> m_value{0};
+    };
+
+    /**
+     * HDR style latency histogram in microseconds: values below 16 are exact, above that
+     * every power of two is split into 16 linear sub-buckets, i.e. the relative error is
+     * below 6.25% over the whole range. Recording is a few wait-free atomic increments,
+     * readers take a snapshot without stopping the writers.
+     */
+    class latency_histogram
+    {
+    public:
+        static constexpr uint32_t sub_bucket_bits = 4;
+        static constexpr uint32_t sub_bucket_count = 1 << sub_bucket_bits;
+        static constexpr uint32_t max_exponent = 40; // ~12 days in microseconds
+        static constexpr uint32_t bucket_count = sub_bucket_count + (max_exponent - sub_bucket_bits) * sub_bucket_count;
+
+        struct snapshot_t
+        {
+            uint64_t count{0};
+            uint64_t sum_us{0};
+            std::vector<uint64_t> buckets; // counts per bucket, see bucket_lower_bound()
+
+            uint64_t max_us() const
+            {
+                for (auto i = buckets.size(); i > 0; --i) {
+                    if (buckets[i - 1] != 0) {
+                        return bucket_upper_bound(static_cast<uint32_t>(i - 1));
+                    }
+                }
+                return 0;
+            }
+
+            /**
+             * Sum of the buckets, may differ from count while the histogram is being written
+             */
+            uint64_t bucket_total() const
+            {
+                uint64_t total = 0;
+                for (auto value : buckets) {
+                    total += value;
+                }
+                return total;
+            }
+
+            double mean_us() const { return count == 0 ? 0.0 : static_cast<double>(sum_us) / count; }
+
+            /**
+             * Upper bound of the bucket containing the quantile, quantile is within [0, 1]
+             */
+            uint64_t percentile_us(double quantile) const
+            {
+                auto total = bucket_total();
+                if (total == 0) {
+                    return 0;
+                }
+
+                auto rank = static_cast<uint64_t>(quantile * total);
+                uint64_t seen = 0;
+                for (uint32_t i = 0; i < buckets.size(); ++i) {
+                    seen += buckets[i];
+                    if (seen > rank) {
+                        return bucket_upper_bound(i);
+                    }
+                }
+                return max_us();
+            }
+
+            /**
+             * Number of values below the bound, exact for powers of two
+             */
+            uint64_t count_below(uint64_t bound_us) const
+            {
+                uint64_t result = 0;
+                for (uint32_t i = 0; i < buckets.size() && bucket_upper_bound(i) < bound_us; ++i) {
+                    result += buckets[i];
+                }
+                return result;
+            }
+        };
+
+        void record(uint64_t value_us)
+        {
+            m_buckets[bucket_index(value_us)].fetch_add(1, std::memory_order_relaxed);
+            m_sum_us.fetch_add(value_us, std::memory_order_relaxed);
+            m_count.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        snapshot_t snapshot() const
+        {
+            snapshot_t result;
+            result.count = m_count.load(std::memory_order_relaxed);
+            result.sum_us = m_sum_us.load(std::memory_order_relaxed);
+            result.buckets.resize(bucket_count);
+            for (uint32_t i = 0; i < bucket_count; ++i) {
+                result.buckets[i] = m_buckets[i].load(std::memory_order_relaxed);
+            }
+            return result;
+        }
+
+        static uint32_t bucket_index(uint64_t value)
+        {
+            if (value < sub_bucket_count) {
+                return static_cast<uint32_t>(value);
+            }
+
+            uint32_t exponent = 63 - count_leading_zeros(value);
+            if (exponent >= max_exponent) {
+                return bucket_count - 1;
+            }
+            uint32_t shift = exponent - sub_bucket_bits;
+            auto sub_bucket = static_cast<uint32_t>(value >> shift) - sub_bucket_count;
+            return sub_bucket_count + shift * sub_bucket_count + sub_bucket;
+        }
+
+        static uint64_t bucket_lower_bound(uint32_t index)
+        {
+            if (index < sub_bucket_count) {
+                return index;
+            }
+            uint32_t shift = (index - sub_bucket_count) / sub_bucket_count;
+            uint64_t sub_bucket = (index - sub_bucket_count) % sub_bucket_count;
+            return (sub_bucket + sub_bucket_count) << shift;
+        }
+
+        static uint64_t bucket_upper_bound(uint32_t index)
+        {
+            return index + 1 < bucket_count ? bucket_lower_bound(index + 1) - 1 : UINT64_MAX;
+        }
+
+    private:
+        static uint32_t count_leading_zeros(uint64_t value)
+        {
+        #if defined(__GNUC__) || defined(__clang__)
+            return static_cast<uint32_t>(__builtin_clzll(value));
+        #else
+            uint32_t result = 0;
+            for (uint64_t bit = uint64_t(1) << 63; bit != 0 && (value & bit) == 0; bit >>= 1) {
+                ++result;
+            }
+            return result;
+        #endif
+        }
+
+        std::array<std::atomic<uint64_t>, bucket_count> m_buckets{};
+        std::atomic<uint64_t> m_sum_us{0};
+        std::atomic<uint64_t> m_count{0};
+    };
+} // bnb::metrics
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace bnb
+{
+    /**
+     * Size-keyed pool of byte planes. A plane acquired from the pool is returned to it
+     * when the last shared_ptr referencing the plane is destroyed, so planes handed
+     * out as bnb::color_plane are recycled without any explicit release call.
+     * The pool may be destroyed before the planes, in that case they are just freed.
+     */
+    class plane_pool : public std::enable_shared_from_this<plane_pool>
+    {
+    public:
+        using plane_sptr = std::shared_ptr<uint8_t>;
+
+        struct stats_t
+        {
+            size_t outstanding{0};     // planes handed out and still referenced
+            size_t free{0};            // planes waiting in the pool for reuse
+            size_t high_water_mark{0}; // max number of planes alive at once, outstanding and free
+            uint64_t allocations{0};   // planes allocated from the heap
+            uint64_t reuses{0};        // acquisitions served from the pool
+        };
+
+        static std::shared_ptr<plane_pool> create(size_t max_free_planes_per_size = 4)
+        {
+            // we use "new" instead of "make_shared" because the constructor is private
+            return std::shared_ptr<plane_pool>(new plane_pool(max_free_planes_per_size));
+        }
+
+        plane_sptr acquire(size_t size)
+        {
+            std::unique_ptr<uint8_t[]> plane;
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                auto& free_planes = m_free_planes[size];
+                if (!free_planes.empty()) {
+                    plane = std::move(free_planes.back());
+                    free_planes.pop_back();
+                    --m_stats.free;
+                    ++m_stats.reuses;
+                } else {
+                    ++m_stats.allocations;
+                }
+                ++m_stats.outstanding;
+                m_stats.high_water_mark = std::max(m_stats.high_water_mark, m_stats.outstanding + m_stats.free);
+            }
+            if (plane == nullptr) {
+                plane = std::make_unique<uint8_t[]>(size);
+            }
+
+            std::weak_ptr<plane_pool> pool = shared_from_this();
+            return plane_sptr(plane.release(), [pool, size](uint8_t* ptr) {
+                std::unique_ptr<uint8_t[]> released(ptr);
+                if (auto pool_sp = pool.lock()) {
+                    pool_sp->recycle(std::move(released), size);
+                }
+            });
+        }
+
+        void clear()
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_free_planes.clear();
+            m_stats.free = 0;
+        }
+
+        stats_t get_stats()
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            return m_stats;
+        }
+
+    private:
+        explicit plane_pool(size_t max_free_planes_per_size)
+            : m_max_free_planes_per_size(max_free_planes_per_size) {}
+
+        void recycle(std::unique_ptr<uint8_t[]> plane, size_t size)
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            --m_stats.outstanding;
+            auto& free_planes = m_free_planes[size];
+            if (free_planes.size() < m_max_free_planes_per_size) {
+                free_planes.push_back(std::move(plane));
+                ++m_stats.free;
+            }
+        }
+
+        const size_t m_max_free_planes_per_size;
+
+        std::mutex m_mutex;
+        std::unordered_map<size_t, std::vector<std::unique_ptr<uint8_t[]>>> m_free_planes;
+        stats_t m_stats;
+    };
+} // bnb
@@ -0,0 +1,118 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+namespace bnb
+{
+    /**
+     * Histogram of the last N samples: the oldest sample leaves the histogram when a new one
+     * comes, so the histogram follows the current load. Percentiles are exact over the window.
+     * Not thread safe.
+     */
+    class rolling_histogram
+    {
+    public:
+        struct bucket_t
+        {
+            double upper_bound;
+            uint32_t count;
+        };
+
+        struct snapshot_t
+        {
+            uint64_t total_samples{0};  // all samples ever added
+            uint32_t window_samples{0}; // samples the values below are calculated of
+            double min{0};
+            double mean{0};
+            double p50{0};
+            double p90{0};
+            double p99{0};
+            double max{0};
+            std::vector<bucket_t> buckets;
+        };
+
+        // milliseconds, good enough for the stages of the frame
+        static std::vector<double> default_bounds()
+        {
+            return {0.25, 0.5, 1.0, 2.0, 4.0, 8.0, 16.0, 33.0, 66.0, std::numeric_limits<double>::infinity()};
+        }
+
+        explicit rolling_histogram(size_t window = 300, std::vector<double> bounds = default_bounds())
+            : m_bounds(std::move(bounds))
+            , m_counts(m_bounds.size(), 0)
+            , m_window(std::max<size_t>(window, 1))
+        {
+            m_samples.reserve(m_window);
+        }
+
+        void add(double value)
+        {
+            if (m_samples.size() < m_window) {
+                m_samples.push_back(value);
+            } else {
+                --m_counts[bucket_index(m_samples[m_next])];
+                m_samples[m_next] = value;
+            }
+            m_next = (m_next + 1) % m_window;
+            ++m_counts[bucket_index(value)];
+            ++m_total_samples;
+        }
+
+        snapshot_t snapshot() const
+        {
+            snapshot_t result;
+            result.total_samples = m_total_samples;
+            result.window_samples = static_cast<uint32_t>(m_samples.size());
+            for (size_t i = 0; i < m_bounds.size(); ++i) {
+                result.buckets.push_back({m_bounds[i], m_counts[i]});
+            }
+            if (m_samples.empty()) {
+                return result;
+            }
+
+            auto sorted = m_samples;
+            std::sort(sorted.begin(), sorted.end());
+            auto percentile = [&sorted](double p) {
+                return sorted[std::min(sorted.size() - 1, static_cast<size_t>(p * sorted.size()))];
+            };
+
+            double sum = 0;
+            for (auto value : sorted) {
+                sum += value;
+            }
+            result.min = sorted.front();
+            result.mean = sum / sorted.size();
+            result.p50 = percentile(0.5);
+            result.p90 = percentile(0.9);
+            result.p99 = percentile(0.99);
+            result.max = sorted.back();
+            return result;
+        }
+
+        void reset()
+        {
+            m_samples.clear();
+            std::fill(m_counts.begin(), m_counts.end(), 0);
+            m_next = 0;
+            m_total_samples = 0;
+        }
+
+    private:
+        size_t bucket_index(double value) const
+        {
+            auto it = std::lower_bound(m_bounds.begin(), m_bounds.end(), value);
+            return it == m_bounds.end() ? m_bounds.size() - 1 : static_cast<size_t>(it - m_bounds.begin());
+        }
+
+        std::vector<double> m_bounds;
+        std::vector<uint32_t> m_counts;
+
+        size_t m_window;
+        std::vector<double> m_samples;
+        size_t m_next{0};
+        uint64_t m_total_samples{0};
+    };
+} // bnb
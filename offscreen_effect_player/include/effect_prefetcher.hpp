@@ -0,0 +1,55 @@
+#pragma once
+
+#include "interfaces/offscreen_effect_player.hpp"
+
+#include "thread_pool.h"
+
+#include <future>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace bnb
+{
+    /**
+     * Warms the files of an effect into the page cache before load_effect, so the load
+     * doesn't wait for the disk on the render thread. The assets are the files named in
+     * config.json, cfg.toml and config.js of the effect, they are read in parallel on
+     * background threads with read-ahead hints, the largest first. May be called from
+     * any thread, a second request for an effect being prefetched joins the first one.
+     *
+     * Example effect_prefetcher prefetcher({BNB_RESOURCES_FOLDER});
+     *         prefetcher.prefetch("effects/Afro").get().bytes
+     */
+    class effect_prefetcher
+    {
+    public:
+        // relative effect paths are looked up in the resource folders, like the SDK does
+        explicit effect_prefetcher(std::vector<std::string> resource_folders, size_t threads = 4);
+
+        std::shared_future<interfaces::prefetch_stats> prefetch(const std::string& effect_path);
+
+        // the directory of the effect, std::nullopt if there is none
+        std::optional<std::string> resolve(const std::string& effect_path) const;
+
+        // the referenced files and the configs themselves, the largest first
+        static std::vector<std::string> list_assets(const std::string& effect_dir);
+
+    private:
+        struct job;
+
+        void read_asset(std::shared_ptr<job> job, const std::string& path);
+        void finish(const std::shared_ptr<job>& job);
+
+    private:
+        const std::vector<std::string> m_resource_folders;
+
+        std::mutex m_mutex;
+        std::unordered_map<std::string, std::shared_future<interfaces::prefetch_stats>> m_in_flight;
+
+        // the last member, its destructor waits for the queued reads while the rest is alive
+        thread_pool m_pool;
+    };
+} // bnb
@@ -0,0 +1,63 @@
+#pragma once
+
+#include "interfaces/offscreen_effect_player.hpp"
+#include "oep_metrics.hpp"
+
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+namespace bnb
+{
+    /**
+     * Releases the frames at a fixed rate on the steady clock. The frames are queued by
+     * push() as they come from the renderer, the pacer thread waits until jitter_frames are
+     * queued and then takes one frame at every tick: the previous frame is repeated when the
+     * queue is empty, the oldest queued frame is dropped when a push finds the queue full.
+     * A tick missed by a slow callback is skipped instead of releasing a burst. The thread
+     * idles while no frame has come yet. push() may be called from any thread.
+     *
+     * Example frame_pacer pacer(frame_pacing_config{30.0f}, on_frame, metrics);
+     *         pacer.push(std::move(image), timing);
+     */
+    class frame_pacer
+    {
+    public:
+        frame_pacer(const interfaces::frame_pacing_config& config, interfaces::paced_frame_cb on_frame, oep_metrics& metrics);
+        // waits for the callback in progress, the queued frames are dropped
+        ~frame_pacer();
+
+        frame_pacer(const frame_pacer&) = delete;
+        frame_pacer& operator=(const frame_pacer&) = delete;
+
+        void push(full_image_t image, const interfaces::frame_timing& timing);
+
+        const interfaces::frame_pacing_config& config() const { return m_config; }
+
+    private:
+        struct entry
+        {
+            std::shared_ptr<const full_image_t> image;
+            interfaces::frame_timing timing;
+        };
+
+        void run();
+
+    private:
+        const interfaces::frame_pacing_config m_config;
+        const interfaces::paced_frame_cb m_on_frame;
+        oep_metrics& m_metrics;
+        const oep_metrics::clock::duration m_period;
+        const size_t m_capacity;
+
+        std::mutex m_mutex;
+        std::condition_variable m_cv;
+        std::deque<entry> m_queue;
+        bool m_stop = false;
+
+        // the last member, started when the rest is initialized
+        std::thread m_thread;
+    };
+} // bnb
@@ -0,0 +1,588 @@
+#pragma once
+
+// the awaitable layer needs C++20 coroutines, the player itself builds as C++17 and the header is empty there;
+// tools/oep_coro_example is built as C++20 and uses every awaitable of it
+#if __cplusplus >= 202002L && __has_include(<coroutine>)
+
+#include "interfaces/offscreen_effect_player.hpp"
+
+#include "logger.hpp"
+#include "thread_pool.h"
+
+#include <atomic>
+#include <coroutine>
+#include <exception>
+#include <memory>
+#include <optional>
+#include <utility>
+
+#ifdef __APPLE__
+    #include <dispatch/dispatch.h>
+#endif
+
+namespace bnb::coro
+{
+    /**
+     * Where a coroutine resumes when an operation completes. The default one resumes inline
+     * on the completing thread, usually the render thread, so the code after co_await delays
+     * the next frame there. The inline and the main queue executors allocate nothing.
+     *
+     * Example awaitable_effect_player player(oep, main_queue_executor())
+     */
+    class executor
+    {
+    public:
+        using post_fn = void (*)(void* context, std::coroutine_handle<> handle);
+
+        constexpr executor() = default;
+        constexpr executor(void* context, post_fn post)
+            : m_context(context)
+            , m_post(post) {}
+
+        bool is_inline() const
+        {
+            return m_post == nullptr;
+        }
+
+        void post(std::coroutine_handle<> handle) const
+        {
+            if (m_post != nullptr) {
+                m_post(m_context, handle);
+            } else {
+                handle.resume();
+            }
+        }
+
+    private:
+        void* m_context{nullptr};
+        post_fn m_post{nullptr};
+    };
+
+    inline executor inline_executor()
+    {
+        return executor();
+    }
+
+    // the pool must outlive the coroutines resumed on it
+    inline executor pool_executor(thread_pool& pool)
+    {
+        return executor(&pool, [](void* context, std::coroutine_handle<> handle) {
+            static_cast<thread_pool*>(context)->enqueue([handle]() { handle.resume(); });
+        });
+    }
+
+#ifdef __APPLE__
+    inline executor main_queue_executor()
+    {
+        return executor(nullptr, [](void*, std::coroutine_handle<> handle) {
+            dispatch_async_f(dispatch_get_main_queue(), handle.address(), [](void* address) {
+                std::coroutine_handle<>::from_address(address).resume();
+            });
+        });
+    }
+#endif
+
+    class cancellation_token
+    {
+    public:
+        // never cancelled
+        cancellation_token() = default;
+
+        bool is_cancelled() const
+        {
+            return m_cancelled != nullptr && m_cancelled->load(std::memory_order_acquire);
+        }
+
+    private:
+        friend class cancellation_source;
+
+        explicit cancellation_token(std::shared_ptr<const std::atomic<bool>> cancelled)
+            : m_cancelled(std::move(cancelled)) {}
+
+        std::shared_ptr<const std::atomic<bool>> m_cancelled;
+    };
+
+    /**
+     * Cancels the operations awaited with its tokens. An operation which has reached the
+     * render thread runs to the end, then its result is dropped, e.g. the pixel buffer is
+     * released at once, and the coroutine gets an empty result. Operations awaited after
+     * cancel() complete immediately without reaching the player.
+     *
+     * Example cancellation_source stop; awaitable_effect_player player(oep, {}, stop.token()); stop.cancel()
+     */
+    class cancellation_source
+    {
+    public:
+        cancellation_source()
+            : m_cancelled(std::make_shared<std::atomic<bool>>(false)) {}
+
+        void cancel()
+        {
+            m_cancelled->store(true, std::memory_order_release);
+        }
+
+        bool is_cancelled() const
+        {
+            return m_cancelled->load(std::memory_order_acquire);
+        }
+
+        cancellation_token token() const
+        {
+            return cancellation_token(m_cancelled);
+        }
+
+    private:
+        std::shared_ptr<std::atomic<bool>> m_cancelled;
+    };
+
+    /**
+     * The awaiter of one callback of the player. The callback captures only the awaiter,
+     * which lives in the coroutine frame until the completion, so std::function keeps it
+     * without an allocation. Derived classes implement start() and call complete() once.
+     */
+    template<class Derived, class Result>
+    class operation
+    {
+    public:
+        operation(executor executor, cancellation_token token)
+            : m_executor(executor)
+            , m_token(std::move(token)) {}
+
+        operation(const operation&) = delete;
+        operation& operator=(const operation&) = delete;
+
+        bool await_ready() const
+        {
+            return m_token.is_cancelled();
+        }
+
+        bool await_suspend(std::coroutine_handle<> handle)
+        {
+            m_handle = handle;
+            static_cast<Derived*>(this)->start();
+            // the first of the callback and this returning resumes the coroutine
+            if (!m_completed.exchange(true, std::memory_order_acq_rel)) {
+                return true;
+            }
+            if (m_executor.is_inline()) {
+                return false;
+            }
+            m_executor.post(handle);
+            return true;
+        }
+
+        Result await_resume()
+        {
+            if (m_token.is_cancelled()) {
+                return Result{};
+            }
+            return std::move(m_result);
+        }
+
+    protected:
+        void complete(Result result)
+        {
+            m_result = std::move(result);
+            if (m_completed.exchange(true, std::memory_order_acq_rel)) {
+                // await_suspend has returned, the awaiter may be destroyed by the resumption
+                m_executor.post(m_handle);
+            }
+        }
+
+    protected:
+        const executor m_executor;
+        const cancellation_token m_token;
+
+    private:
+        std::coroutine_handle<> m_handle;
+        std::atomic<bool> m_completed{false};
+        Result m_result{};
+    };
+
+    class frame;
+
+    class read_operation: public operation<read_operation, std::optional<full_image_t>>
+    {
+    public:
+        read_operation(interfaces::pixel_buffer& buffer, interfaces::output_image_format format,
+                       executor executor, cancellation_token token)
+            : operation(executor, std::move(token))
+            , m_buffer(buffer)
+            , m_format(format) {}
+
+        void start()
+        {
+            m_buffer.get_image(m_format, [this](std::optional<full_image_t> image) { complete(std::move(image)); });
+        }
+
+    private:
+        interfaces::pixel_buffer& m_buffer;
+        const interfaces::output_image_format m_format;
+    };
+
+    // CVPixelBufferRef in NV12 on Apple platforms, nullptr elsewhere
+    class pixel_buffer_operation: public operation<pixel_buffer_operation, void*>
+    {
+    public:
+        pixel_buffer_operation(interfaces::pixel_buffer& buffer, executor executor, cancellation_token token)
+            : operation(executor, std::move(token))
+            , m_buffer(buffer) {}
+
+        void start()
+        {
+            m_buffer.get_pixel_buffer([this](void* pixel_buffer) { complete(pixel_buffer); });
+        }
+
+    private:
+        interfaces::pixel_buffer& m_buffer;
+    };
+
+    /**
+     * A processed frame, holds a lease of its pixel buffer so it may be read after the
+     * coroutine moved to another executor while the next frames are rendered.
+     *
+     * Example auto image = co_await frame->read(interfaces::output_image_format::nv12)
+     */
+    class frame
+    {
+    public:
+        frame(interfaces::pixel_buffer_lease lease, executor executor, cancellation_token token)
+            : m_lease(std::move(lease))
+            , m_executor(executor)
+            , m_token(std::move(token)) {}
+
+        read_operation read(interfaces::output_image_format format) const
+        {
+            return read_operation(*m_lease.get(), format, m_executor, m_token);
+        }
+
+        pixel_buffer_operation read_pixel_buffer() const
+        {
+            return pixel_buffer_operation(*m_lease.get(), m_executor, m_token);
+        }
+
+        interfaces::frame_timing timing() const
+        {
+            return m_lease->get_frame_timing();
+        }
+
+        const interfaces::pixel_buffer_lease& lease() const
+        {
+            return m_lease;
+        }
+
+    private:
+        interfaces::pixel_buffer_lease m_lease;
+        executor m_executor;
+        cancellation_token m_token;
+    };
+
+    // std::nullopt if the frame was dropped or the operation cancelled
+    class process_operation: public operation<process_operation, std::optional<frame>>
+    {
+    public:
+        process_operation(interfaces::offscreen_effect_player& oep, std::shared_ptr<full_image_t> image,
+                          std::optional<interfaces::orient_format> target_orient, interfaces::frame_timing timing,
+                          executor executor, cancellation_token token)
+            : operation(executor, std::move(token))
+            , m_oep(oep)
+            , m_image(std::move(image))
+            , m_target_orient(target_orient)
+            , m_timing(timing) {}
+
+        void start()
+        {
+            m_oep.process_image_async(std::move(m_image), [this](std::optional<pb_sptr> pb) {
+                if (!pb.has_value()) {
+                    complete(std::nullopt);
+                    return;
+                }
+                // taken on the render thread, the buffer isn't reused before the coroutine resumes
+                complete(frame((*pb)->lease(), m_executor, m_token));
+            }, m_target_orient, m_timing);
+        }
+
+    private:
+        interfaces::offscreen_effect_player& m_oep;
+        std::shared_ptr<full_image_t> m_image;
+        const std::optional<interfaces::orient_format> m_target_orient;
+        const interfaces::frame_timing m_timing;
+    };
+
+    // false if the effect failed to load or the operation was cancelled
+    class load_effect_operation: public operation<load_effect_operation, bool>
+    {
+    public:
+        load_effect_operation(interfaces::offscreen_effect_player& oep, std::string effect_path,
+                              executor executor, cancellation_token token)
+            : operation(executor, std::move(token))
+            , m_oep(oep)
+            , m_effect_path(std::move(effect_path)) {}
+
+        void start()
+        {
+            m_oep.load_effect(m_effect_path, [this](bool loaded) { complete(loaded); });
+        }
+
+    private:
+        interfaces::offscreen_effect_player& m_oep;
+        const std::string m_effect_path;
+    };
+
+    /**
+     * The awaitable API of an offscreen effect player. Every co_await resumes on the
+     * executor and respects the cancellation token given here; the player must outlive
+     * the awaits.
+     *
+     * Example coro::task<> pipeline(coro::awaitable_effect_player& player, camera& camera)
+     *         {
+     *             co_await player.load_effect("effects/Afro");
+     *             while (auto image = camera.next()) {
+     *                 if (auto frame = co_await player.process(image)) {
+     *                     auto output = co_await frame->read(interfaces::output_image_format::nv12);
+     *                 }
+     *             }
+     *         }
+     */
+    class awaitable_effect_player
+    {
+    public:
+        explicit awaitable_effect_player(std::shared_ptr<interfaces::offscreen_effect_player> oep, executor executor = {}, cancellation_token token = {})
+            : m_oep(std::move(oep))
+            , m_executor(executor)
+            , m_token(std::move(token)) {}
+
+        process_operation process(std::shared_ptr<full_image_t> image,
+                                  std::optional<interfaces::orient_format> target_orient = std::nullopt,
+                                  interfaces::frame_timing timing = {})
+        {
+            return process_operation(*m_oep, std::move(image), target_orient, timing, m_executor, m_token);
+        }
+
+        load_effect_operation load_effect(std::string effect_path)
+        {
+            return load_effect_operation(*m_oep, std::move(effect_path), m_executor, m_token);
+        }
+
+        const std::shared_ptr<interfaces::offscreen_effect_player>& get() const
+        {
+            return m_oep;
+        }
+
+    private:
+        std::shared_ptr<interfaces::offscreen_effect_player> m_oep;
+        executor m_executor;
+        cancellation_token m_token;
+    };
+
+    template<class T = void>
+    class task;
+
+    namespace detail
+    {
+        struct task_promise_base
+        {
+            struct final_awaiter
+            {
+                bool await_ready() noexcept
+                {
+                    return false;
+                }
+
+                template<class Promise>
+                std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> handle) noexcept
+                {
+                    return handle.promise().continuation;
+                }
+
+                void await_resume() noexcept {}
+            };
+
+            std::suspend_always initial_suspend() noexcept
+            {
+                return {};
+            }
+
+            final_awaiter final_suspend() noexcept
+            {
+                return {};
+            }
+
+            void unhandled_exception()
+            {
+                exception = std::current_exception();
+            }
+
+            std::coroutine_handle<> continuation{std::noop_coroutine()};
+            std::exception_ptr exception;
+        };
+
+        template<class T>
+        struct task_promise: task_promise_base
+        {
+            task<T> get_return_object();
+
+            template<class U>
+            void return_value(U&& value)
+            {
+                result.emplace(std::forward<U>(value));
+            }
+
+            T take()
+            {
+                if (exception) {
+                    std::rethrow_exception(exception);
+                }
+                return std::move(*result);
+            }
+
+            std::optional<T> result;
+        };
+
+        template<>
+        struct task_promise<void>: task_promise_base
+        {
+            task<void> get_return_object();
+
+            void return_void() {}
+
+            void take()
+            {
+                if (exception) {
+                    std::rethrow_exception(exception);
+                }
+            }
+        };
+    } // detail
+
+    /**
+     * A lazy coroutine, it starts when awaited and resumes the awaiting one when done.
+     * Run the outermost one with spawn().
+     */
+    template<class T>
+    class task
+    {
+    public:
+        using promise_type = detail::task_promise<T>;
+        using handle_type = std::coroutine_handle<promise_type>;
+
+        explicit task(handle_type handle)
+            : m_handle(handle) {}
+
+        task(task&& other) noexcept
+            : m_handle(std::exchange(other.m_handle, nullptr)) {}
+
+        task& operator=(task&& other) noexcept
+        {
+            if (this != &other) {
+                if (m_handle) {
+                    m_handle.destroy();
+                }
+                m_handle = std::exchange(other.m_handle, nullptr);
+            }
+            return *this;
+        }
+
+        ~task()
+        {
+            if (m_handle) {
+                m_handle.destroy();
+            }
+        }
+
+        auto operator co_await() && noexcept
+        {
+            struct awaiter
+            {
+                handle_type handle;
+
+                bool await_ready() noexcept
+                {
+                    return !handle || handle.done();
+                }
+
+                std::coroutine_handle<> await_suspend(std::coroutine_handle<> continuation) noexcept
+                {
+                    handle.promise().continuation = continuation;
+                    return handle;
+                }
+
+                T await_resume()
+                {
+                    return handle.promise().take();
+                }
+            };
+            return awaiter{m_handle};
+        }
+
+    private:
+        handle_type m_handle;
+    };
+
+    namespace detail
+    {
+        template<class T>
+        task<T> task_promise<T>::get_return_object()
+        {
+            return task<T>(std::coroutine_handle<task_promise<T>>::from_promise(*this));
+        }
+
+        inline task<void> task_promise<void>::get_return_object()
+        {
+            return task<void>(std::coroutine_handle<task_promise<void>>::from_promise(*this));
+        }
+
+        // destroys itself at the end
+        struct detached_task
+        {
+            struct promise_type
+            {
+                detached_task get_return_object() noexcept
+                {
+                    return {};
+                }
+
+                std::suspend_never initial_suspend() noexcept
+                {
+                    return {};
+                }
+
+                std::suspend_never final_suspend() noexcept
+                {
+                    return {};
+                }
+
+                void return_void() noexcept {}
+
+                void unhandled_exception() noexcept
+                {
+                    try {
+                        throw;
+                    } catch (const std::exception& e) {
+                        WRITE_LOG_MESSAGE(error, "Unhandled exception in a spawned task: " << e.what());
+                    } catch (...) {
+                        WRITE_LOG_MESSAGE(error, "Unhandled exception in a spawned task");
+                    }
+                }
+            };
+        };
+
+        inline detached_task run_detached(task<void> task)
+        {
+            co_await std::move(task);
+        }
+    } // detail
+
+    /**
+     * Starts the task on the calling thread and lets it run to the end on its own,
+     * an exception escaping it is logged.
+     *
+     * Example coro::spawn(pipeline(player, camera))
+     */
+    inline void spawn(task<void> task)
+    {
+        detail::run_detached(std::move(task));
+    }
+} // bnb::coro
+
+#endif
@@ -0,0 +1,97 @@
+#pragma once
+
+#include "interfaces/offscreen_effect_player.hpp"
+#include "metrics.hpp"
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <thread>
+
+namespace bnb
+{
+    /**
+     * Metrics of the offscreen_effect_player pipeline. All updates are wait-free
+     * atomic increments, so they are called right on the render thread.
+     */
+    class oep_metrics
+    {
+    public:
+        using clock = std::chrono::steady_clock;
+
+        oep_metrics() = default;
+        ~oep_metrics();
+
+        oep_metrics(const oep_metrics&) = delete;
+        oep_metrics& operator=(const oep_metrics&) = delete;
+
+        void on_submitted() { m_frames_submitted.add(); }
+        void on_rendered() { m_frames_rendered.add(); }
+        void on_passthrough() { m_frames_passthrough.add(); }
+        void on_dropped(interfaces::frame_drop_reason reason) { m_frames_dropped[static_cast<size_t>(reason)].add(); }
+        void add_queue_depth(int64_t delta) { m_queue_depth.add(delta); }
+
+        void on_quality_change(uint32_t from_level, uint32_t to_level)
+        {
+            m_quality_level.set(to_level);
+            if (to_level > from_level) {
+                m_quality_steps_down.add();
+            } else if (to_level < from_level) {
+                m_quality_steps_up.add();
+            }
+        }
+
+        void on_paced(bool duplicate) { (duplicate ? m_pacer_duplicates : m_pacer_unique).add(); }
+        void on_pacer_drop() { m_pacer_drops.add(); }
+
+        void record(interfaces::pipeline_stage stage, clock::time_point from, clock::time_point to = clock::now())
+        {
+            auto us = std::chrono::duration_cast<std::chrono::microseconds>(to - from).count();
+            m_latency[static_cast<size_t>(stage)].record(us > 0 ? static_cast<uint64_t>(us) : 0);
+        }
+
+        interfaces::metrics_snapshot snapshot() const;
+
+        /**
+         * Percentiles and non-empty buckets of the histogram, e.g. to report a histogram
+         * of the client next to the ones of get_metrics()
+         */
+        static interfaces::stage_latency to_stage_latency(const metrics::latency_histogram::snapshot_t& histogram);
+
+        /**
+         * Prometheus text exposition format of the snapshot
+         */
+        static std::string to_prometheus(const interfaces::metrics_snapshot& snapshot);
+
+        bool write_prometheus(const std::string& path) const;
+
+        /**
+         * Start the thread answering on the unix socket, an empty path only stops it
+         */
+        bool serve(const std::string& socket_path);
+        void stop_serving();
+
+    private:
+        void serve_loop(int listen_fd);
+
+        metrics::counter m_frames_submitted;
+        metrics::counter m_frames_rendered;
+        metrics::counter m_frames_passthrough;
+        std::array<metrics::counter, static_cast<size_t>(interfaces::frame_drop_reason::count)> m_frames_dropped;
+        metrics::gauge m_queue_depth;
+        metrics::gauge m_quality_level;
+        metrics::counter m_quality_steps_down;
+        metrics::counter m_quality_steps_up;
+        metrics::counter m_pacer_unique;
+        metrics::counter m_pacer_duplicates;
+        metrics::counter m_pacer_drops;
+        std::array<metrics::latency_histogram, static_cast<size_t>(interfaces::pipeline_stage::count)> m_latency;
+
+        std::mutex m_server_mutex;
+        std::thread m_server_thread;
+        std::atomic<bool> m_serving{false};
+        std::string m_socket_path;
+    };
+} // bnb
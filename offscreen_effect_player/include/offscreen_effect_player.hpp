@@ -5,16 +5,24 @@
 
 #include "interfaces/offscreen_effect_player.hpp"
 #include "interfaces/offscreen_render_target.hpp"
+#include "interfaces/effect_renderer.hpp"
 
 #include "thread_pool.h"
+#include "plane_pool.hpp"
 
+#include "effect_prefetcher.hpp"
+#include "frame_pacer.hpp"
 #include "pixel_buffer.hpp"
+#include "oep_metrics.hpp"
+#include "quality_controller.hpp"
 
 using ioep_sptr = std::shared_ptr<bnb::interfaces::offscreen_effect_player>;
 using iort_sptr = std::shared_ptr<bnb::interfaces::offscreen_render_target>;
 
 namespace bnb
 {
+    class pixel_buffer;
+
     class offscreen_effect_player: public interfaces::offscreen_effect_player,
                                    public std::enable_shared_from_this<offscreen_effect_player>
     {
@@ -23,43 +31,203 @@ namespace bnb
             const std::vector<std::string>& path_to_resources, const std::string& client_token,
             int32_t width, int32_t height, bool manual_audio, std::optional<iort_sptr> ort);
 
+        /**
+         * The GL context is created on the render thread while the SDK and the effect player
+         * are initialized on the calling thread, then the render thread loads the initial
+         * effect and renders the warm-up frames. Returns before the effect is loaded, frames
+         * submitted meanwhile wait in the queue. Call it off the main thread for the best
+         * overlap, the context is created on the main queue.
+         *
+         * Example create({BNB_RESOURCES_FOLDER}, token, 1280, 720, false, {"effects/test_BG", 3})
+         */
+        static ioep_sptr create(
+            const std::vector<std::string>& path_to_resources, const std::string& client_token,
+            int32_t width, int32_t height, bool manual_audio, const interfaces::startup_options& options,
+            std::optional<iort_sptr> ort = std::nullopt);
+
+        // renders with the given effect_renderer instead of the SDK effect_player, e.g. a stand-in one for benchmarks;
+        // the streams of the grid mode get the renderers of grid_renderers
+        static ioep_sptr create(effect_renderer_sptr renderer, int32_t width, int32_t height,
+                                std::optional<iort_sptr> ort = std::nullopt,
+                                effect_renderer_factory grid_renderers = nullptr);
+
     private:
-        offscreen_effect_player(const std::vector<std::string>& path_to_resources,
-            const std::string& client_token,
-            int32_t width, int32_t height, bool manual_audio,
-            iort_sptr ort);
+        // starts the initialization of the render target, start() attaches the renderer
+        offscreen_effect_player(std::vector<std::string> resource_folders, int32_t width, int32_t height, iort_sptr ort);
+
+        void start(std::unique_ptr<bnb::utility> utility, effect_renderer_sptr renderer,
+                   const interfaces::startup_options& options);
 
     public:
         ~offscreen_effect_player();
 
-        void process_image_async(std::shared_ptr<full_image_t> image, oep_pb_ready_cb callback,
-                                 std::optional<interfaces::orient_format> target_orient) override;
+        using interfaces::offscreen_effect_player::process_image_async;
+        void process_image_async(std::shared_ptr<full_image_t> image, interfaces::frame_result_cb callback,
+                                 std::optional<interfaces::orient_format> target_orient,
+                                 interfaces::frame_timing timing) override;
+
+        void set_processing_mode(interfaces::processing_mode mode, uint32_t max_frames_in_flight) override;
 
         void surface_changed(int32_t width, int32_t height) override;
 
-        void load_effect(const std::string& effect_path) override;
+        using interfaces::offscreen_effect_player::load_effect;
+        void load_effect(const std::string& effect_path, interfaces::effect_loaded_cb callback) override;
         void unload_effect() override;
+        std::shared_future<interfaces::prefetch_stats> prefetch_effect(const std::string& effect_path) override;
 
         void call_js_method(const std::string& method, const std::string& param) override;
 
+        interfaces::gpu_stats get_gpu_stats() override;
+
+        void enable_tracing(bool enable) override;
+        bool dump_trace(const std::string& path) override;
+
+        interfaces::metrics_snapshot get_metrics() override;
+        bool write_metrics(const std::string& path) override;
+        bool serve_metrics(const std::string& socket_path) override;
+
+        void set_render_scale(float scale, interfaces::upscale_filter filter) override;
+
+        void enable_adaptive_quality(std::optional<interfaces::adaptive_quality_config> config,
+                                     interfaces::quality_event_cb on_change) override;
+
+        void enable_frame_pacing(std::optional<interfaces::frame_pacing_config> config,
+                                 interfaces::paced_frame_cb on_frame) override;
+
+        uint32_t add_grid_stream(const std::string& effect_path) override;
+        void remove_grid_stream(uint32_t stream) override;
+        void load_grid_effect(uint32_t stream, const std::string& effect_path, interfaces::effect_loaded_cb callback) override;
+        void push_grid_frame(uint32_t stream, std::shared_ptr<full_image_t> image,
+                             std::optional<interfaces::orient_format> target_orient) override;
+        using interfaces::offscreen_effect_player::composite_grid_async;
+        void composite_grid_async(interfaces::frame_result_cb callback, interfaces::frame_timing timing) override;
+
+        interfaces::startup_timings get_startup_timings() override;
+
     private:
         friend class pixel_buffer;
 
-        void read_current_buffer(std::function<void(bnb::data_t data)> callback);
+        // read the render target if it still holds the frame of the generation, std::nullopt otherwise
+        void read_current_buffer(std::shared_ptr<pixel_buffer> frame, uint64_t generation,
+                                 std::function<void(std::optional<bnb::data_t> data)> callback);
 
         #ifdef __APPLE__
-            void read_pixel_buffer(oep_image_ready_pb_cb callback);
+            void read_pixel_buffer(std::shared_ptr<pixel_buffer> frame, uint64_t generation,
+                                   std::function<void(std::optional<void*> pixel_buffer)> callback);
+            // copies a passed through frame into a pixel buffer
+            void make_pixel_buffer(full_image_t image, oep_image_ready_pb_cb callback);
         #endif
 
+        // must be called from the render thread
+        void apply_quality_level(const interfaces::quality_level& level);
+        void apply_render_size();
+        // renders m_warmup_frames black frames which are never read back
+        void warm_up();
+
+        // takes a place of a lossless frame in the pipeline, blocks the caller while it is full;
+        // returns false in the realtime mode, which does not limit the frames
+        bool admit_frame();
+        // frees the place taken by admit_frame() when the frame leaves the render thread
+        void release_frame();
+        // a free pixel buffer for the next frame, nullptr if all are leased: max_frames of them and
+        // m_max_frames_in_flight more in the lossless mode, not to drop a frame it admitted; render thread only
+        std::shared_ptr<pixel_buffer> acquire_frame(bool lossless);
+        // called by the last unlock of a pixel buffer, from any thread; a free buffer is not listed twice
+        void recycle_frame(std::shared_ptr<pixel_buffer> frame);
+        // keeps the frame of the render target in memory if it is leased, before the target is overwritten
+        void detach_gpu_frame();
+        // copies the processed frame into the frame pacer if it is on, before the callback; render thread only
+        void pace_frame(pixel_buffer& frame, const interfaces::frame_timing& timing);
+
+        struct grid_stream
+        {
+            uint32_t id;
+            effect_renderer_sptr renderer;
+            // the frame the next composite pushes to the renderer
+            std::shared_ptr<full_image_t> pending;
+            interfaces::orient_format orient{camera_orientation::deg_0, false};
+            bool has_frame = false;
+            interfaces::grid_tile tile;
+            // the size the renderer is notified about, the tile size swapped by 90 and 270 degrees
+            int32_t render_width = 0;
+            int32_t render_height = 0;
+        };
+
+        // render thread only
+        grid_stream* find_grid_stream(uint32_t stream);
+        // the tiles for the current streams and the output size, the renderers follow their sizes
+        void apply_grid_layout();
+        // whether the frame can't reach its callback within its latency budget; render thread only
+        bool misses_deadline(const interfaces::frame_timing& timing, oep_metrics::clock::time_point now);
+        void update_render_estimate(oep_metrics::clock::duration render_time);
+
     private:
-        bnb::utility m_utility;
-        std::shared_ptr<interfaces::effect_player> m_ep;
+        // initializes the SDK, null with a stand-in renderer
+        std::unique_ptr<bnb::utility> m_utility;
+        effect_renderer_sptr m_ep;
         iort_sptr m_ort;
 
+        // makes the renderers of the grid streams, null without them
+        effect_renderer_factory m_renderer_factory;
+
         thread_pool m_scheduler;
         std::thread::id render_thread_id;
 
-        pb_sptr m_current_frame;
+        std::shared_ptr<plane_pool> m_plane_pool = plane_pool::create();
+        effect_prefetcher m_prefetcher;
+
+        oep_metrics m_metrics;
+
+        // output size and the scale effect_player renders at, used on the render thread
+        int32_t m_width;
+        int32_t m_height;
+        float m_render_scale = 1.0f;         // set by the client
+        float m_quality_render_scale = 1.0f; // set by the quality controller
+        interfaces::upscale_filter m_upscale_filter = interfaces::upscale_filter::bicubic_sharp;
+        // the size effect_player is notified about
+        int32_t m_render_width = 0;
+        int32_t m_render_height = 0;
+
+        std::optional<quality_controller> m_quality_controller;
+        interfaces::quality_event_cb m_quality_cb;
+        std::optional<interfaces::quality_level> m_pending_quality_level;
+
+        // used on the render thread, destroyed before the metrics it counts in
+        std::unique_ptr<frame_pacer> m_pacer;
+
+        // the buffers of the output frames; the free ones are reused, the leased ones keep their frames
+        std::mutex m_frames_mutex;
+        std::vector<std::shared_ptr<pixel_buffer>> m_free_frames;
+        uint32_t m_frames_created = 0;
+        // the frame the render target holds, render thread only
+        std::shared_ptr<pixel_buffer> m_gpu_frame;
         std::atomic<uint16_t> m_incoming_frame_queue_task_count = 0;
+
+        std::atomic<interfaces::processing_mode> m_processing_mode = interfaces::processing_mode::realtime;
+        // backpressure of the lossless mode
+        std::mutex m_in_flight_mutex;
+        std::condition_variable m_in_flight_cv;
+        uint32_t m_frames_in_flight = 0;
+        uint32_t m_max_frames_in_flight = 2;
+
+        uint32_t m_warmup_frames = 0;
+        const oep_metrics::clock::time_point m_created = oep_metrics::clock::now();
+        std::mutex m_startup_mutex;
+        interfaces::startup_timings m_startup;
+
+        // the streams of the grid mode in the order of the tiles, render thread only
+        std::vector<grid_stream> m_grid_streams;
+        std::atomic<uint32_t> m_last_grid_stream = 0;
+        std::atomic<uint16_t> m_incoming_composite_count = 0;
+
+        // moving average of the time from the start of rendering to the callback, render thread only
+        double m_render_estimate_us = 0.0;
+        uint32_t m_deadline_skips = 0;
+
+        std::atomic<uint64_t> m_last_frame_id = 0;
+        // id of the frame last rendered, written and read on the render thread
+        uint64_t m_current_frame_id = 0;
+        // the frame ids are of this player, its events are told apart in the process wide trace by this id
+        const uint32_t m_trace_source_id;
     };
 } // bnb
\ No newline at end of file
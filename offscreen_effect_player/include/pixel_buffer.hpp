@@ -2,6 +2,10 @@
 
 #include "offscreen_effect_player.hpp"
 #include "interfaces/pixel_buffer.hpp"
+#include "plane_pool.hpp"
+
+#include <atomic>
+#include <mutex>
 
 namespace bnb
 {
@@ -15,18 +19,57 @@ namespace bnb
         pixel_buffer(oep_sptr oep_sptr, uint32_t width, uint32_t height, camera_orientation orientation);
 
         void lock() override;
+        // the last unlock hands the buffer back to the effect player for the next frames
         void unlock() override;
         bool is_locked() override;
-        
+        uint64_t get_generation() override;
+
         void get_pixel_buffer(oep_image_ready_pb_cb callback) override;
+        void get_image(interfaces::output_image_format format, oep_image_ready_cb callback) override;
+
+        interfaces::frame_timing get_frame_timing() override;
+        void set_frame_timing(interfaces::frame_timing timing);
+
+        // the frame is the input itself, get_image reorients and converts it on the CPU; nullptr for a rendered frame
+        void set_passthrough(std::shared_ptr<full_image_t> image, interfaces::orient_format target_orient);
+
+        // the buffer holds a new frame: the next generation, not passed through; the size is of the render
+        // target for a rendered frame and of the input for a passed through one; render thread only
+        void begin_frame(uint32_t width, uint32_t height, camera_orientation orientation);
+
+        /**
+         * Keeps the frame in memory, the render target is about to be overwritten while the
+         * buffer is still leased. rgba is the readback of the render target, afterwards the
+         * frame is read like a passed through one. Must be called from the render thread.
+         */
+        void detach(data_t rgba);
+
+        // the frame is passed through or detached, the reads don't touch the render target
+        bool in_memory();
+
+    private:
+        std::shared_ptr<full_image_t> passthrough_image();
+        // the format of the readback of a rendered frame and optionally its generation, read together
+        image_format rendered_format(uint64_t* generation = nullptr);
+        std::optional<full_image_t> get_passthrough_image(interfaces::output_image_format format, plane_pool& pool);
 
     private:
         oep_wptr m_oep_ptr;
-        uint8_t lock_count = 0;
+        std::atomic<uint32_t> m_lock_count{0};
+        std::atomic<uint64_t> m_generation{0};
+
+        // guards the description of the frame and the passed through or detached frame, all of which
+        // begin_frame replaces on the render thread while the client may still read the previous lease
+        std::mutex m_passthrough_mutex;
 
         uint32_t m_width = 0;
         uint32_t m_height = 0;
 
         camera_orientation m_orientation;
+
+        interfaces::frame_timing m_frame_timing;
+
+        std::shared_ptr<full_image_t> m_passthrough_image;
+        interfaces::orient_format m_passthrough_orient{camera_orientation::deg_0, true};
     };
 } // bnb
\ No newline at end of file
@@ -0,0 +1,43 @@
+#pragma once
+
+#include "interfaces/offscreen_effect_player.hpp"
+
+#include <optional>
+
+namespace bnb
+{
+    /**
+     * Picks the quality level by the measured render time of the frames. The time is
+     * averaged over a window of frames, the level goes one step down as soon as a window
+     * doesn't fit the budget and one step up only after several windows in a row with
+     * enough headroom. The gap between the thresholds and the window restart after every
+     * change keep the level from oscillating. Not thread safe, used on the render thread.
+     */
+    class quality_controller
+    {
+    public:
+        explicit quality_controller(interfaces::adaptive_quality_config config);
+
+        /**
+         * Account the render time of the frame
+         *
+         * @return the event if the level is changed by the frame
+         */
+        std::optional<interfaces::quality_event> on_frame(uint64_t frame_id, double render_ms);
+
+        uint32_t current_level_index() const { return m_level; }
+        const interfaces::quality_level& current_level() const { return m_config.levels[m_level]; }
+        const interfaces::adaptive_quality_config& config() const { return m_config; }
+
+    private:
+        interfaces::quality_event change_level(uint64_t frame_id, uint32_t level, double average_ms);
+
+        interfaces::adaptive_quality_config m_config;
+        double m_budget_ms;
+
+        uint32_t m_level{0};
+        double m_window_sum_ms{0};
+        uint32_t m_window_frames{0};
+        uint32_t m_headroom_windows{0};
+    };
+} // bnb
@@ -0,0 +1,76 @@
+#pragma once
+
+#include "offscreen_effect_player.hpp"
+
+#include "session_file.hpp"
+
+namespace bnb
+{
+    /**
+     * Decorator of offscreen_effect_player which records the frames and the control calls
+     * to a session file and forwards every call to the wrapped player. A session is replayed
+     * by feeding the events from session_reader back, e.g. with the oep_replay tool.
+     * The session format has no events of the grid mode: its calls are forwarded but not
+     * recorded, so a session of a grid is not recordable and replays without the composites.
+     * 
+     * Example recording_effect_player::create(oep, "/tmp/session.oeps", session_compression::lz4)
+     */
+    class recording_effect_player: public interfaces::offscreen_effect_player
+    {
+    public:
+        // nullptr if the file could not be created
+        static ioep_sptr create(ioep_sptr target, const std::string& path,
+                                session_compression compression = session_compression::none);
+
+        using interfaces::offscreen_effect_player::process_image_async;
+        void process_image_async(std::shared_ptr<full_image_t> image, interfaces::frame_result_cb callback,
+                                 std::optional<interfaces::orient_format> target_orient,
+                                 interfaces::frame_timing timing) override;
+
+        void set_processing_mode(interfaces::processing_mode mode, uint32_t max_frames_in_flight) override;
+
+        void surface_changed(int32_t width, int32_t height) override;
+
+        using interfaces::offscreen_effect_player::load_effect;
+        void load_effect(const std::string& effect_path, interfaces::effect_loaded_cb callback) override;
+        void unload_effect() override;
+        std::shared_future<interfaces::prefetch_stats> prefetch_effect(const std::string& effect_path) override;
+
+        void call_js_method(const std::string& method, const std::string& param) override;
+
+        interfaces::gpu_stats get_gpu_stats() override;
+
+        void enable_tracing(bool enable) override;
+        bool dump_trace(const std::string& path) override;
+
+        interfaces::metrics_snapshot get_metrics() override;
+        bool write_metrics(const std::string& path) override;
+        bool serve_metrics(const std::string& socket_path) override;
+
+        void set_render_scale(float scale, interfaces::upscale_filter filter) override;
+
+        void enable_adaptive_quality(std::optional<interfaces::adaptive_quality_config> config,
+                                     interfaces::quality_event_cb on_change) override;
+
+        void enable_frame_pacing(std::optional<interfaces::frame_pacing_config> config,
+                                 interfaces::paced_frame_cb on_frame) override;
+
+        // the grid mode is forwarded without recording, add_grid_stream() logs a warning
+        uint32_t add_grid_stream(const std::string& effect_path) override;
+        void remove_grid_stream(uint32_t stream) override;
+        void load_grid_effect(uint32_t stream, const std::string& effect_path, interfaces::effect_loaded_cb callback) override;
+        void push_grid_frame(uint32_t stream, std::shared_ptr<full_image_t> image,
+                             std::optional<interfaces::orient_format> target_orient) override;
+        using interfaces::offscreen_effect_player::composite_grid_async;
+        void composite_grid_async(interfaces::frame_result_cb callback, interfaces::frame_timing timing) override;
+
+        interfaces::startup_timings get_startup_timings() override;
+
+    private:
+        recording_effect_player(ioep_sptr target, std::unique_ptr<session_writer> writer);
+
+    private:
+        ioep_sptr m_target;
+        std::unique_ptr<session_writer> m_writer;
+    };
+} // bnb
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <bnb/effect_player/interfaces/all.hpp>
+
+#include "interfaces/effect_renderer.hpp"
+
+namespace bnb
+{
+    // effect_renderer over the SDK effect_player, bnb::utility must be initialized before
+    class sdk_effect_renderer: public interfaces::effect_renderer
+    {
+    public:
+        explicit sdk_effect_renderer(const interfaces::effect_player_configuration& config);
+
+        void surface_created(int32_t width, int32_t height) override;
+        void surface_changed(int32_t width, int32_t height) override;
+        void surface_destroyed() override;
+
+        void push_frame(full_image_t image) override;
+        int64_t draw() override;
+
+        void set_max_faces(int32_t max_faces) override;
+
+        bool load_effect(const std::string& effect_path) override;
+        bool has_effect() const override;
+        void call_js_method(const std::string& method, const std::string& param) override;
+
+    private:
+        std::shared_ptr<interfaces::effect_player> m_ep;
+        // the frames go through the SDK until an explicit unload by load_effect(""), as before the passthrough
+        bool m_has_effect = true;
+    };
+} // bnb
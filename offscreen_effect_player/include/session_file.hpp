@@ -0,0 +1,126 @@
+#pragma once
+
+#include "interfaces/offscreen_effect_player.hpp"
+#include "plane_pool.hpp"
+
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace bnb
+{
+    enum class session_compression : uint32_t
+    {
+        none,
+        lz4, // lossless, libcompression on Apple platforms, stored uncompressed elsewhere
+    };
+
+    enum class session_event_type : uint32_t
+    {
+        frame = 1,
+        load_effect,     // text is the effect path, empty for unload_effect
+        surface_changed, // width and height
+        call_js_method,  // text is the method, param is its argument
+        processing_mode, // mode and max_frames_in_flight
+        render_scale,    // scale and filter
+    };
+
+    struct session_event
+    {
+        session_event_type type{session_event_type::frame};
+        // since the start of the recording
+        int64_t timestamp_us{0};
+
+        std::shared_ptr<full_image_t> image;
+        std::optional<interfaces::orient_format> target_orient;
+        interfaces::frame_timing timing;
+
+        std::string text;
+        std::string param;
+
+        int32_t width{0};
+        int32_t height{0};
+
+        interfaces::processing_mode mode{interfaces::processing_mode::realtime};
+        uint32_t max_frames_in_flight{2};
+
+        float scale{1.0f};
+        interfaces::upscale_filter filter{interfaces::upscale_filter::bicubic_sharp};
+    };
+
+    /**
+     * Appends the input of offscreen_effect_player to a session file: the frames with
+     * their planes and the control calls, each with its time since the start. The file is
+     * memory mapped and grows in large steps, so a frame costs one copy of its planes
+     * (or one compression pass). May be called from any thread.
+     */
+    class session_writer
+    {
+    public:
+        static std::unique_ptr<session_writer> create(const std::string& path, session_compression compression);
+        ~session_writer();
+
+        session_writer(const session_writer&) = delete;
+        session_writer& operator=(const session_writer&) = delete;
+
+        void write_frame(const full_image_t& image, std::optional<interfaces::orient_format> target_orient,
+                         interfaces::frame_timing timing);
+        void write(const session_event& control_event);
+
+        // bytes written so far
+        uint64_t size() const;
+
+    private:
+        session_writer(int fd, session_compression compression);
+
+        int64_t now_us() const;
+        // must be called with m_mutex locked
+        uint8_t* reserve(size_t size);
+        void write_header(size_t offset, session_event_type type, uint32_t payload_size, int64_t timestamp_us);
+        void write_string(const std::string& value);
+        void write_plane(const uint8_t* data, uint32_t size, uint32_t& stored_size, uint32_t& plane_compression);
+
+    private:
+        const int m_fd;
+        const session_compression m_compression;
+        const std::chrono::steady_clock::time_point m_start;
+
+        mutable std::mutex m_mutex;
+        uint8_t* m_map{nullptr};
+        size_t m_capacity{0};
+        size_t m_size{0};
+        std::vector<uint8_t> m_scratch;
+    };
+
+    /**
+     * Reads a session file back. Uncompressed planes are not copied, the images reference
+     * the mapping of the file which stays alive while any of them exists.
+     */
+    class session_reader
+    {
+    public:
+        static std::unique_ptr<session_reader> open(const std::string& path);
+
+        // std::nullopt at the end of the session or on a damaged record
+        std::optional<session_event> next();
+        void rewind();
+
+        // the format of the first frame
+        std::optional<image_format> first_frame_format();
+
+    private:
+        struct mapping;
+
+        explicit session_reader(std::shared_ptr<mapping> file);
+
+        std::optional<session_event> read_frame(const uint8_t* payload, uint32_t size);
+
+    private:
+        std::shared_ptr<mapping> m_file;
+        size_t m_offset;
+        std::shared_ptr<plane_pool> m_plane_pool = plane_pool::create();
+    };
+} // bnb
@@ -0,0 +1,264 @@
+#include "effect_prefetcher.hpp"
+#include "logger.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <climits>
+#include <unordered_set>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace
+{
+    using clock_type = std::chrono::steady_clock;
+
+    // the configs which name the assets of an effect
+    const char* const config_files[] = {"config.json", "cfg.toml", "config.js"};
+
+    constexpr size_t read_chunk_size = 1024 * 1024;
+
+    std::optional<uint64_t> regular_file_size(const std::string& path)
+    {
+        struct stat st;
+        if (stat(path.c_str(), &st) != 0 || !S_ISREG(st.st_mode)) {
+            return std::nullopt;
+        }
+        return static_cast<uint64_t>(st.st_size);
+    }
+
+    bool is_directory(const std::string& path)
+    {
+        struct stat st;
+        return stat(path.c_str(), &st) == 0 && S_ISDIR(st.st_mode);
+    }
+
+    std::string read_text(const std::string& path)
+    {
+        std::string text;
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            return text;
+        }
+        char buffer[4096];
+        ssize_t count;
+        while ((count = read(fd, buffer, sizeof(buffer))) > 0) {
+            text.append(buffer, size_t(count));
+        }
+        close(fd);
+        return text;
+    }
+
+    // string literals of JSON, TOML and JS which may be file names
+    std::vector<std::string> string_literals(const std::string& text)
+    {
+        std::vector<std::string> result;
+        for (size_t i = 0; i < text.size(); ++i) {
+            char quote = text[i];
+            if (quote != '"' && quote != '\'') {
+                continue;
+            }
+            auto end = text.find_first_of(std::string(1, quote) + "\n", i + 1);
+            if (end == std::string::npos) {
+                break;
+            }
+            if (text[end] == quote && end - i - 1 > 0 && end - i - 1 < 256) {
+                result.push_back(text.substr(i + 1, end - i - 1));
+            }
+            i = end;
+        }
+        return result;
+    }
+
+    // a valid literal stays within the effect directory
+    bool is_relative_file_name(const std::string& name)
+    {
+        return name.front() != '/' && name.find("..") == std::string::npos && name.find('\\') == std::string::npos;
+    }
+
+    // reads the file into a scratch buffer, the data stays in the page cache; std::nullopt on errors
+    std::optional<uint64_t> warm_file(const std::string& path)
+    {
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            return std::nullopt;
+        }
+        struct stat st;
+        if (fstat(fd, &st) != 0) {
+            close(fd);
+            return std::nullopt;
+        }
+
+        // start the read-ahead of the whole file, the reads below mostly find the data ready
+    #ifdef __APPLE__
+        radvisory advisory;
+        advisory.ra_offset = 0;
+        advisory.ra_count = static_cast<int>(std::min<off_t>(st.st_size, INT_MAX));
+        fcntl(fd, F_RDADVISE, &advisory);
+    #elif defined(POSIX_FADV_WILLNEED)
+        posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+        posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+    #endif
+
+        thread_local std::vector<char> buffer(read_chunk_size);
+        uint64_t total = 0;
+        ssize_t count;
+        while ((count = read(fd, buffer.data(), buffer.size())) > 0) {
+            total += static_cast<uint64_t>(count);
+        }
+        close(fd);
+        if (count < 0) {
+            return std::nullopt;
+        }
+        return total;
+    }
+} // anonymous namespace
+
+namespace bnb
+{
+    struct effect_prefetcher::job
+    {
+        interfaces::prefetch_stats stats;
+        std::string key;
+        std::promise<interfaces::prefetch_stats> promise;
+        clock_type::time_point start{clock_type::now()};
+        std::atomic<size_t> remaining{0};
+        std::atomic<uint64_t> bytes{0};
+        std::atomic<uint32_t> failed{0};
+    };
+
+    effect_prefetcher::effect_prefetcher(std::vector<std::string> resource_folders, size_t threads)
+        : m_resource_folders(std::move(resource_folders))
+        , m_pool(std::max<size_t>(threads, 1))
+    {
+    }
+
+    std::optional<std::string> effect_prefetcher::resolve(const std::string& effect_path) const
+    {
+        if (effect_path.empty()) {
+            return std::nullopt;
+        }
+        if (effect_path.front() == '/') {
+            return is_directory(effect_path) ? std::optional<std::string>(effect_path) : std::nullopt;
+        }
+        for (auto& folder : m_resource_folders) {
+            auto path = folder + "/" + effect_path;
+            if (is_directory(path)) {
+                return path;
+            }
+        }
+        return std::nullopt;
+    }
+
+    std::vector<std::string> effect_prefetcher::list_assets(const std::string& effect_dir)
+    {
+        std::vector<std::pair<uint64_t, std::string>> assets;
+        std::unordered_set<std::string> seen;
+        auto add = [&](const std::string& path) {
+            if (seen.count(path) != 0) {
+                return;
+            }
+            if (auto size = regular_file_size(path)) {
+                seen.insert(path);
+                assets.emplace_back(*size, path);
+            }
+        };
+
+        for (auto config : config_files) {
+            auto config_path = effect_dir + "/" + config;
+            add(config_path);
+            if (seen.count(config_path) == 0) {
+                continue;
+            }
+            for (auto& name : string_literals(read_text(config_path))) {
+                if (is_relative_file_name(name)) {
+                    add(effect_dir + "/" + name);
+                }
+            }
+        }
+
+        std::sort(assets.begin(), assets.end(), [](const auto& a, const auto& b) { return a.first > b.first; });
+        std::vector<std::string> result;
+        result.reserve(assets.size());
+        for (auto& asset : assets) {
+            result.push_back(std::move(asset.second));
+        }
+        return result;
+    }
+
+    std::shared_future<interfaces::prefetch_stats> effect_prefetcher::prefetch(const std::string& effect_path)
+    {
+        auto dir = resolve(effect_path);
+        if (!dir.has_value()) {
+            WRITE_LOG_MESSAGE(warning, "Effect to prefetch not found: " << effect_path);
+            std::promise<interfaces::prefetch_stats> promise;
+            promise.set_value(interfaces::prefetch_stats{});
+            return promise.get_future().share();
+        }
+
+        auto job = std::make_shared<effect_prefetcher::job>();
+        job->stats.effect_path = *dir;
+        job->key = *dir;
+        std::shared_future<interfaces::prefetch_stats> future;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            auto it = m_in_flight.find(*dir);
+            if (it != m_in_flight.end()) {
+                return it->second;
+            }
+            future = job->promise.get_future().share();
+            m_in_flight.emplace(*dir, future);
+        }
+
+        // the configs are parsed on the pool too, the caller may be the UI thread
+        m_pool.enqueue([this, job]() {
+            auto assets = list_assets(job->key);
+            job->stats.files = static_cast<uint32_t>(assets.size());
+            if (assets.empty()) {
+                finish(job);
+                return;
+            }
+            job->remaining = assets.size();
+            for (auto& path : assets) {
+                try {
+                    m_pool.enqueue([this, job, path]() { read_asset(job, path); });
+                } catch (const std::runtime_error&) {
+                    // the prefetcher is being destroyed, the pool only drains its queue
+                    read_asset(job, path);
+                }
+            }
+        });
+        return future;
+    }
+
+    void effect_prefetcher::read_asset(std::shared_ptr<job> job, const std::string& path)
+    {
+        if (auto bytes = warm_file(path)) {
+            job->bytes += *bytes;
+        } else {
+            ++job->failed;
+            WRITE_LOG_MESSAGE(warning, "Failed to prefetch " << path);
+        }
+        if (--job->remaining == 0) {
+            finish(job);
+        }
+    }
+
+    void effect_prefetcher::finish(const std::shared_ptr<job>& job)
+    {
+        job->stats.bytes = job->bytes;
+        job->stats.failed = job->failed;
+        job->stats.duration_us = static_cast<uint64_t>(
+            std::chrono::duration_cast<std::chrono::microseconds>(clock_type::now() - job->start).count());
+        WRITE_LOG_MESSAGE(info, "Prefetched " << job->stats.files << " files, " << job->stats.bytes / 1024 << " KB of "
+            << job->stats.effect_path << " in " << job->stats.duration_us / 1000.0 << " ms");
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_in_flight.erase(job->key);
+        }
+        job->promise.set_value(job->stats);
+    }
+} // bnb
@@ -0,0 +1,83 @@
+#include "frame_pacer.hpp"
+
+#include <algorithm>
+
+namespace bnb
+{
+    namespace
+    {
+        int64_t clock_us(oep_metrics::clock::time_point time)
+        {
+            return std::chrono::duration_cast<std::chrono::microseconds>(time.time_since_epoch()).count();
+        }
+    } // anonymous namespace
+
+    frame_pacer::frame_pacer(const interfaces::frame_pacing_config& config, interfaces::paced_frame_cb on_frame, oep_metrics& metrics)
+        : m_config(config)
+        , m_on_frame(std::move(on_frame))
+        , m_metrics(metrics)
+        , m_period(std::chrono::duration_cast<oep_metrics::clock::duration>(std::chrono::duration<double>(1.0 / std::max(config.target_fps, 1.0f))))
+        , m_capacity(2 * std::max<size_t>(config.jitter_frames, 1))
+        , m_thread([this]() { run(); })
+    {
+    }
+
+    frame_pacer::~frame_pacer()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stop = true;
+        }
+        m_cv.notify_all();
+        m_thread.join();
+    }
+
+    void frame_pacer::push(full_image_t image, const interfaces::frame_timing& timing)
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (m_queue.size() >= m_capacity) {
+                m_queue.pop_front();
+                m_metrics.on_pacer_drop();
+            }
+            m_queue.push_back({std::make_shared<const full_image_t>(std::move(image)), timing});
+        }
+        m_cv.notify_one();
+    }
+
+    void frame_pacer::run()
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_cv.wait(lock, [this]() { return m_stop || !m_queue.empty(); });
+        // the jitter buffer fills before the first release, unless the frames come slower than the target rate
+        m_cv.wait_for(lock, m_period * m_config.jitter_frames, [this]() { return m_stop || m_queue.size() >= m_config.jitter_frames; });
+
+        entry last;
+        uint64_t sequence = 0;
+        auto tick = oep_metrics::clock::now();
+        while (!m_stop) {
+            bool duplicate = m_queue.empty();
+            if (!duplicate) {
+                last = std::move(m_queue.front());
+                m_queue.pop_front();
+            }
+            interfaces::paced_frame_info info{last.timing, clock_us(tick), sequence++, duplicate};
+            auto image = last.image;
+
+            lock.unlock();
+            m_metrics.on_paced(duplicate);
+            if (m_on_frame) {
+                m_on_frame(*image, info);
+            }
+            lock.lock();
+
+            tick += m_period;
+            auto late = oep_metrics::clock::now() - tick;
+            if (late >= m_period) {
+                // the ticks missed by a slow callback are skipped, the cadence is kept
+                tick += m_period * (late / m_period);
+            }
+            m_cv.wait_until(lock, tick, [this]() { return m_stop; });
+        }
+    }
+} // bnb
@@ -0,0 +1,276 @@
+#include "oep_metrics.hpp"
+#include "logger.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+
+#if defined(__APPLE__) || defined(__unix__)
+    #include <poll.h>
+    #include <sys/socket.h>
+    #include <sys/un.h>
+    #include <unistd.h>
+    #define BNB_METRICS_UNIX_SOCKET 1
+#else
+    #define BNB_METRICS_UNIX_SOCKET 0
+#endif
+
+namespace
+{
+    const char* drop_reason_names[] = {"queue", "locked_buffer", "timeout"};
+    const char* stage_names[] = {"queue_wait", "render", "orientation", "readback", "callback", "total"};
+
+    static_assert(std::size(drop_reason_names) == static_cast<size_t>(bnb::interfaces::frame_drop_reason::count));
+    static_assert(std::size(stage_names) == static_cast<size_t>(bnb::interfaces::pipeline_stage::count));
+
+    // Prometheus buckets are powers of two in microseconds, the HDR histogram is exact on them
+    constexpr uint32_t first_bucket_log2_us = 6;  // 64us
+    constexpr uint32_t last_bucket_log2_us = 20;  // ~1s
+} // anonymous namespace
+
+namespace bnb
+{
+    oep_metrics::~oep_metrics()
+    {
+        stop_serving();
+    }
+
+    interfaces::metrics_snapshot oep_metrics::snapshot() const
+    {
+        interfaces::metrics_snapshot result;
+        result.frames_submitted = m_frames_submitted.get();
+        result.frames_rendered = m_frames_rendered.get();
+        result.frames_passthrough = m_frames_passthrough.get();
+        for (size_t i = 0; i < m_frames_dropped.size(); ++i) {
+            result.frames_dropped[i] = m_frames_dropped[i].get();
+        }
+        result.queue_depth = m_queue_depth.get();
+        result.quality_level = static_cast<uint32_t>(m_quality_level.get());
+        result.quality_steps_down = m_quality_steps_down.get();
+        result.quality_steps_up = m_quality_steps_up.get();
+        result.pacer_duplicates = m_pacer_duplicates.get();
+        result.frames_paced = m_pacer_unique.get() + result.pacer_duplicates;
+        result.pacer_drops = m_pacer_drops.get();
+        for (size_t i = 0; i < m_latency.size(); ++i) {
+            result.latency[i] = to_stage_latency(m_latency[i].snapshot());
+        }
+        return result;
+    }
+
+    interfaces::stage_latency oep_metrics::to_stage_latency(const metrics::latency_histogram::snapshot_t& histogram)
+    {
+        interfaces::stage_latency result;
+        result.count = histogram.count;
+        result.sum_us = histogram.sum_us;
+        result.p50_us = histogram.percentile_us(0.5);
+        result.p90_us = histogram.percentile_us(0.9);
+        result.p99_us = histogram.percentile_us(0.99);
+        result.p999_us = histogram.percentile_us(0.999);
+        result.max_us = histogram.max_us();
+        for (uint32_t i = 0; i < histogram.buckets.size(); ++i) {
+            if (histogram.buckets[i] != 0) {
+                result.buckets.push_back({metrics::latency_histogram::bucket_upper_bound(i), histogram.buckets[i]});
+            }
+        }
+        return result;
+    }
+
+    std::string oep_metrics::to_prometheus(const interfaces::metrics_snapshot& snapshot)
+    {
+        std::ostringstream out;
+
+        out << "# HELP oep_frames_submitted_total Frames passed to process_image_async.\n"
+            << "# TYPE oep_frames_submitted_total counter\n"
+            << "oep_frames_submitted_total " << snapshot.frames_submitted << "\n";
+
+        out << "# HELP oep_frames_rendered_total Frames processed and passed to the callback.\n"
+            << "# TYPE oep_frames_rendered_total counter\n"
+            << "oep_frames_rendered_total " << snapshot.frames_rendered << "\n";
+
+        out << "# HELP oep_frames_passthrough_total Frames passed through on the CPU without an effect, included in the rendered ones.\n"
+            << "# TYPE oep_frames_passthrough_total counter\n"
+            << "oep_frames_passthrough_total " << snapshot.frames_passthrough << "\n";
+
+        out << "# HELP oep_frames_dropped_total Frames dropped without processing.\n"
+            << "# TYPE oep_frames_dropped_total counter\n";
+        for (size_t i = 0; i < snapshot.frames_dropped.size(); ++i) {
+            out << "oep_frames_dropped_total{reason=\"" << drop_reason_names[i] << "\"} " << snapshot.frames_dropped[i] << "\n";
+        }
+
+        out << "# HELP oep_queue_depth Frames waiting for the render thread.\n"
+            << "# TYPE oep_queue_depth gauge\n"
+            << "oep_queue_depth " << snapshot.queue_depth << "\n";
+
+        out << "# HELP oep_quality_level Current level of adaptive quality, 0 is the best.\n"
+            << "# TYPE oep_quality_level gauge\n"
+            << "oep_quality_level " << snapshot.quality_level << "\n"
+            << "# HELP oep_quality_steps_total Changes of the adaptive quality level.\n"
+            << "# TYPE oep_quality_steps_total counter\n"
+            << "oep_quality_steps_total{direction=\"down\"} " << snapshot.quality_steps_down << "\n"
+            << "oep_quality_steps_total{direction=\"up\"} " << snapshot.quality_steps_up << "\n";
+
+        out << "# HELP oep_paced_frames_total Frames released by the frame pacer.\n"
+            << "# TYPE oep_paced_frames_total counter\n"
+            << "oep_paced_frames_total{kind=\"unique\"} " << snapshot.frames_paced - snapshot.pacer_duplicates << "\n"
+            << "oep_paced_frames_total{kind=\"duplicate\"} " << snapshot.pacer_duplicates << "\n"
+            << "# HELP oep_pacer_dropped_total Frames dropped by the frame pacer on a full jitter buffer.\n"
+            << "# TYPE oep_pacer_dropped_total counter\n"
+            << "oep_pacer_dropped_total " << snapshot.pacer_drops << "\n";
+
+        out << "# HELP oep_stage_latency_seconds Wall time of the pipeline stages.\n"
+            << "# TYPE oep_stage_latency_seconds histogram\n";
+        for (size_t i = 0; i < snapshot.latency.size(); ++i) {
+            auto& histogram = snapshot.latency[i];
+            // the buckets and the count are read separately, take the count of the buckets for consistency
+            uint64_t count = 0;
+            for (auto& bucket : histogram.buckets) {
+                count += bucket.count;
+            }
+            uint64_t below = 0;
+            auto bucket = histogram.buckets.begin();
+            for (auto b = first_bucket_log2_us; b <= last_bucket_log2_us; ++b) {
+                auto bound_us = uint64_t(1) << b;
+                for (; bucket != histogram.buckets.end() && bucket->upper_bound_us < bound_us; ++bucket) {
+                    below += bucket->count;
+                }
+                out << "oep_stage_latency_seconds_bucket{stage=\"" << stage_names[i] << "\",le=\""
+                    << static_cast<double>(bound_us) / 1e6 << "\"} " << below << "\n";
+            }
+            out << "oep_stage_latency_seconds_bucket{stage=\"" << stage_names[i] << "\",le=\"+Inf\"} " << count << "\n"
+                << "oep_stage_latency_seconds_sum{stage=\"" << stage_names[i] << "\"} " << static_cast<double>(histogram.sum_us) / 1e6 << "\n"
+                << "oep_stage_latency_seconds_count{stage=\"" << stage_names[i] << "\"} " << count << "\n";
+        }
+
+        return out.str();
+    }
+
+    bool oep_metrics::write_prometheus(const std::string& path) const
+    {
+        // scrapers must never see a half written file
+        auto tmp_path = path + ".tmp";
+        {
+            std::ofstream file(tmp_path, std::ios::out | std::ios::trunc);
+            if (!file) {
+                return false;
+            }
+            file << to_prometheus(snapshot());
+            if (!file) {
+                return false;
+            }
+        }
+        return std::rename(tmp_path.c_str(), path.c_str()) == 0;
+    }
+
+    bool oep_metrics::serve(const std::string& socket_path)
+    {
+        stop_serving();
+        if (socket_path.empty()) {
+            return true;
+        }
+
+    #if BNB_METRICS_UNIX_SOCKET
+        sockaddr_un address{};
+        address.sun_family = AF_UNIX;
+        if (socket_path.size() >= sizeof(address.sun_path)) {
+            WRITE_LOG_MESSAGE(error, "Metrics socket path is too long: " << socket_path);
+            return false;
+        }
+        std::memcpy(address.sun_path, socket_path.c_str(), socket_path.size() + 1);
+
+        int listen_fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+        if (listen_fd < 0) {
+            WRITE_LOG_MESSAGE(error, "Failed to create the metrics socket");
+            return false;
+        }
+
+        ::unlink(socket_path.c_str());
+        if (::bind(listen_fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 || ::listen(listen_fd, 4) != 0) {
+            WRITE_LOG_MESSAGE(error, "Failed to listen on the metrics socket " << socket_path);
+            ::close(listen_fd);
+            return false;
+        }
+
+        std::lock_guard<std::mutex> lock(m_server_mutex);
+        m_socket_path = socket_path;
+        m_serving = true;
+        m_server_thread = std::thread([this, listen_fd]() { serve_loop(listen_fd); });
+        return true;
+    #else
+        WRITE_LOG_MESSAGE(error, "Metrics socket is not supported on this platform");
+        return false;
+    #endif
+    }
+
+    void oep_metrics::stop_serving()
+    {
+        std::lock_guard<std::mutex> lock(m_server_mutex);
+        m_serving = false;
+        if (m_server_thread.joinable()) {
+            m_server_thread.join();
+        }
+    #if BNB_METRICS_UNIX_SOCKET
+        if (!m_socket_path.empty()) {
+            ::unlink(m_socket_path.c_str());
+            m_socket_path.clear();
+        }
+    #endif
+    }
+
+    void oep_metrics::serve_loop(int listen_fd)
+    {
+    #if BNB_METRICS_UNIX_SOCKET
+        constexpr int poll_timeout_ms = 200;
+
+        while (m_serving) {
+            pollfd listen_poll{listen_fd, POLLIN, 0};
+            if (::poll(&listen_poll, 1, poll_timeout_ms) <= 0) {
+                continue;
+            }
+
+            int client_fd = ::accept(listen_fd, nullptr, nullptr);
+            if (client_fd < 0) {
+                continue;
+            }
+
+        #ifdef SO_NOSIGPIPE
+            int no_sigpipe = 1;
+            ::setsockopt(client_fd, SOL_SOCKET, SO_NOSIGPIPE, &no_sigpipe, sizeof(no_sigpipe));
+        #endif
+
+            // drain the request if the client sends one (curl does, nc may not)
+            pollfd client_poll{client_fd, POLLIN, 0};
+            if (::poll(&client_poll, 1, poll_timeout_ms) > 0) {
+                char request[1024];
+                ::recv(client_fd, request, sizeof(request), 0);
+            }
+
+            auto body = to_prometheus(snapshot());
+            std::ostringstream response;
+            response << "HTTP/1.0 200 OK\r\n"
+                     << "Content-Type: text/plain; version=0.0.4\r\n"
+                     << "Content-Length: " << body.size() << "\r\n\r\n"
+                     << body;
+            auto data = response.str();
+
+            int flags = 0;
+        #ifdef MSG_NOSIGNAL
+            flags = MSG_NOSIGNAL;
+        #endif
+            size_t sent = 0;
+            while (sent < data.size()) {
+                auto result = ::send(client_fd, data.data() + sent, data.size() - sent, flags);
+                if (result <= 0) {
+                    break;
+                }
+                sent += static_cast<size_t>(result);
+            }
+            ::close(client_fd);
+        }
+
+        ::close(listen_fd);
+    #endif
+    }
+
+} // bnb
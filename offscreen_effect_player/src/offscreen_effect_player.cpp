@@ -1,108 +1,618 @@
 #include "offscreen_effect_player.hpp"
 #include "offscreen_render_target.hpp"
+#include "sdk_effect_renderer.hpp"
 
-#include <iostream>
+#include "frame_tracer.hpp"
+#include "logger.hpp"
+
+#include <algorithm>
+#include <cmath>
 
 namespace bnb
 {
+    namespace
+    {
+        uint64_t elapsed_us(oep_metrics::clock::time_point from, oep_metrics::clock::time_point to = oep_metrics::clock::now())
+        {
+            return static_cast<uint64_t>(std::max<int64_t>(0, std::chrono::duration_cast<std::chrono::microseconds>(to - from).count()));
+        }
+
+        // pixel buffers of the realtime mode: one is rendered while the client holds the others
+        constexpr uint32_t max_frames = 3;
+
+        // weight of the last frame in the render time estimate of the latency budget
+        constexpr double render_estimate_weight = 0.125;
+        // of the frames skipped on the estimate alone one is rendered to measure the render time again
+        constexpr uint32_t deadline_probe_interval = 30;
+
+        // the tile of the stream in a grid of ceil(sqrt(count)) columns centered in the output, even sized for NV12
+        interfaces::grid_tile grid_tile_of(size_t index, size_t count, int32_t width, int32_t height)
+        {
+            auto columns = static_cast<int32_t>(std::ceil(std::sqrt(static_cast<double>(count))));
+            auto rows = static_cast<int32_t>((count + columns - 1) / columns);
+            interfaces::grid_tile tile;
+            tile.width = std::max(width / columns / 2 * 2, 2);
+            tile.height = std::max(height / rows / 2 * 2, 2);
+            tile.x = (width - columns * tile.width) / 4 * 2 + static_cast<int32_t>(index % columns) * tile.width;
+            tile.y = (height - rows * tile.height) / 4 * 2 + static_cast<int32_t>(index / columns) * tile.height;
+            return tile;
+        }
+    } // anonymous namespace
+
     ioep_sptr offscreen_effect_player::create(
         const std::vector<std::string>& path_to_resources, const std::string& client_token,
         int32_t width, int32_t height, bool manual_audio, std::optional<iort_sptr> ort = std::nullopt)
+    {
+        return create(path_to_resources, client_token, width, height, manual_audio, interfaces::startup_options{}, ort);
+    }
+
+    ioep_sptr offscreen_effect_player::create(
+        const std::vector<std::string>& path_to_resources, const std::string& client_token,
+        int32_t width, int32_t height, bool manual_audio, const interfaces::startup_options& options,
+        std::optional<iort_sptr> ort)
     {
         if (!ort.has_value()) {
             ort = std::make_shared<offscreen_render_target>(width, height);
         }
 
         // we use "new" instead of "make_shared" because the constructor in "offscreen_effect_player" is private
-        return oep_sptr(new offscreen_effect_player(
-                path_to_resources, client_token, width, height, manual_audio, *ort));
+        auto oep = oep_sptr(new offscreen_effect_player(path_to_resources, width, height, *ort));
+        if (!options.effect_path.empty()) {
+            oep->m_prefetcher.prefetch(options.effect_path);
+        }
+
+        // the render thread creates the GL context and the effect files are read meanwhile
+        auto utility_start = oep_metrics::clock::now();
+        // the SDK must be initialized before effect_player is created
+        auto utility = std::make_unique<bnb::utility>(path_to_resources, client_token);
+        auto renderer_start = oep_metrics::clock::now();
+        auto renderer_config = interfaces::effect_player_configuration{
+            width, height,
+            bnb::interfaces::nn_mode::automatically,
+            bnb::interfaces::face_search_mode::good,
+            false, manual_audio };
+        auto renderer = std::make_shared<sdk_effect_renderer>(renderer_config);
+        oep->m_renderer_factory = [renderer_config]() { return std::make_shared<sdk_effect_renderer>(renderer_config); };
+        {
+            std::lock_guard<std::mutex> lock(oep->m_startup_mutex);
+            oep->m_startup.utility_us = elapsed_us(utility_start, renderer_start);
+            oep->m_startup.renderer_us = elapsed_us(renderer_start);
+        }
+
+        oep->start(std::move(utility), std::move(renderer), options);
+        return oep;
     }
 
-    offscreen_effect_player::offscreen_effect_player(
-        const std::vector<std::string>& path_to_resources, const std::string& client_token,
-        int32_t width, int32_t height, bool manual_audio,
-        iort_sptr offscreen_render_target)
-            : m_utility(path_to_resources, client_token)
-            , m_ep(bnb::interfaces::effect_player::create( {
-                width, height,
-                bnb::interfaces::nn_mode::automatically,
-                bnb::interfaces::face_search_mode::good,
-                false, manual_audio }))
-            , m_ort(offscreen_render_target)
+    ioep_sptr offscreen_effect_player::create(effect_renderer_sptr renderer, int32_t width, int32_t height,
+                                              std::optional<iort_sptr> ort, effect_renderer_factory grid_renderers)
+    {
+        if (!ort.has_value()) {
+            ort = std::make_shared<offscreen_render_target>(width, height);
+        }
+
+        // we use "new" instead of "make_shared" because the constructor in "offscreen_effect_player" is private
+        auto oep = oep_sptr(new offscreen_effect_player({}, width, height, *ort));
+        oep->m_renderer_factory = std::move(grid_renderers);
+        oep->start(nullptr, std::move(renderer), interfaces::startup_options{});
+        return oep;
+    }
+
+    offscreen_effect_player::offscreen_effect_player(std::vector<std::string> resource_folders,
+        int32_t width, int32_t height, iort_sptr offscreen_render_target)
+            : m_ort(offscreen_render_target)
             , m_scheduler(1)
+            , m_prefetcher(std::move(resource_folders))
+            , m_width(width)
+            , m_height(height)
+            , m_render_width(width)
+            , m_render_height(height)
+            , m_trace_source_id(frame_tracer::instance().new_source_id())
     {
-        auto task = [this, width, height]() {
+        auto task = [this]() {
             render_thread_id = std::this_thread::get_id();
+            frame_tracer::instance().set_thread_name("oep render");
+            auto context_start = oep_metrics::clock::now();
             m_ort->init();
-            m_ep->surface_created(width, height);
+            std::lock_guard<std::mutex> lock(m_startup_mutex);
+            m_startup.context_us = elapsed_us(context_start);
         };
 
         m_scheduler.enqueue(task);
     }
 
-    offscreen_effect_player::~offscreen_effect_player()
+    void offscreen_effect_player::start(std::unique_ptr<bnb::utility> utility, effect_renderer_sptr renderer,
+                                        const interfaces::startup_options& options)
     {
-        m_ep->surface_destroyed();
+        m_utility = std::move(utility);
+        m_ep = std::move(renderer);
+        m_warmup_frames = options.warmup_frames;
+
+        // queued after the initialization of the render target
+        auto task = [this, effect_path = options.effect_path]() {
+            auto surface_start = oep_metrics::clock::now();
+            m_ep->surface_created(m_width, m_height);
+            auto effect_start = oep_metrics::clock::now();
+            if (!effect_path.empty()) {
+                m_ep->load_effect(effect_path);
+            }
+            m_ort->invalidate_gl_state();
+            auto warmup_start = oep_metrics::clock::now();
+            if (!effect_path.empty()) {
+                warm_up();
+            }
+            auto end = oep_metrics::clock::now();
+
+            std::lock_guard<std::mutex> lock(m_startup_mutex);
+            m_startup.surface_us = elapsed_us(surface_start, effect_start);
+            m_startup.effect_us = elapsed_us(effect_start, warmup_start);
+            m_startup.warmup_us = elapsed_us(warmup_start, end);
+            m_startup.total_us = elapsed_us(m_created, end);
+            m_startup.complete = true;
+            WRITE_LOG_MESSAGE(info, "Startup took " << m_startup.total_us / 1000.0 << " ms: utility "
+                << m_startup.utility_us / 1000.0 << " ms, effect player " << m_startup.renderer_us / 1000.0
+                << " ms, context " << m_startup.context_us / 1000.0 << " ms, surface " << m_startup.surface_us / 1000.0
+                << " ms, effect " << m_startup.effect_us / 1000.0 << " ms, warm-up " << m_startup.warmup_us / 1000.0 << " ms");
+        };
+
+        m_scheduler.enqueue(task);
     }
 
-    void offscreen_effect_player::process_image_async(std::shared_ptr<full_image_t> image, oep_pb_ready_cb callback,
-                                                      std::optional<interfaces::orient_format> target_orient)
+    offscreen_effect_player::~offscreen_effect_player()
     {
-        if (m_current_frame == nullptr) {
-            m_current_frame = std::make_shared<pixel_buffer>(shared_from_this(),
-                image->get_format().width, image->get_format().height, image->get_format().orientation);
-        }
-
-        if (m_current_frame->is_locked()) {
-            std::cout << "[Warning] The interface for processing the previous frame is lock" << std::endl;
+        // create() threw before the renderer was attached
+        if (m_ep == nullptr) {
             return;
         }
+        // the renderers release their GL objects, so the context of the render thread must be current
+        auto destroy = [this]() {
+            m_ep->surface_destroyed();
+            for (auto& stream : m_grid_streams) {
+                stream.renderer->surface_destroyed();
+            }
+            m_grid_streams.clear();
+        };
+        if (std::this_thread::get_id() == render_thread_id) {
+            destroy();
+        } else {
+            m_scheduler.enqueue(destroy).wait();
+        }
+    }
+
+    void offscreen_effect_player::process_image_async(std::shared_ptr<full_image_t> image, interfaces::frame_result_cb callback,
+                                                      std::optional<interfaces::orient_format> target_orient,
+                                                      interfaces::frame_timing timing)
+    {
+        bool lossless = admit_frame();
+
+        auto frame_id = ++m_last_frame_id;
+        auto enqueue_time = oep_metrics::clock::now();
+        auto& tracer = frame_tracer::instance();
+        tracer.trace(m_trace_source_id, frame_id, "enqueue");
+        m_metrics.on_submitted();
 
         if (!target_orient.has_value()) {
             target_orient = { image->get_format().orientation, true };
         }
 
-        auto task = [this, image, callback, target_orient]() {
-            if (m_incoming_frame_queue_task_count == 1) {
-                m_current_frame->lock();
+        auto task = [this, image, callback, target_orient, timing, lossless, frame_id, enqueue_time, &tracer]() {
+            using stage = interfaces::pipeline_stage;
+            auto render_start = oep_metrics::clock::now();
+            m_metrics.record(stage::queue_wait, enqueue_time, render_start);
+            m_metrics.add_queue_depth(-1);
+
+            // in the lossless mode every frame is rendered, otherwise only the latest one
+            bool render = lossless || m_incoming_frame_queue_task_count == 1;
+            // a frame that would reach the client past its budget is not worth the GPU time
+            bool late = render && !lossless && misses_deadline(timing, render_start);
+            render = render && !late;
+            std::shared_ptr<pixel_buffer> frame = render ? acquire_frame(lossless) : nullptr;
+            // the render thread holds a lease of the frame until the callback returns
+            interfaces::pixel_buffer_lease lease;
+            if (frame != nullptr) {
+                // a rendered frame is read back at the output size, a passed through one keeps the input
+                if (m_ep->has_effect()) {
+                    frame->begin_frame(uint32_t(m_width), uint32_t(m_height), camera_orientation::deg_0);
+                } else {
+                    frame->begin_frame(image->get_format().width, image->get_format().height, image->get_format().orientation);
+                }
+                lease = frame->lease();
+            }
+
+            if (render && frame == nullptr) {
+                WRITE_LOG_MESSAGE(warning, "The interface for processing the previous frame is lock");
+                callback(std::nullopt, interfaces::frame_drop_reason::locked_buffer);
+                tracer.trace(m_trace_source_id, frame_id, "dropped");
+                m_metrics.on_dropped(interfaces::frame_drop_reason::locked_buffer);
+            } else if (render && !m_ep->has_effect()) {
+                // nothing to draw: the input is handed over as the output, no GL work at all
+                m_current_frame_id = frame_id;
+                tracer.trace(m_trace_source_id, frame_id, "passthrough");
+                frame->set_passthrough(image, *target_orient);
+                frame->set_frame_timing(timing);
+                auto callback_start = oep_metrics::clock::now();
+                m_metrics.record(stage::render, render_start, callback_start);
+                m_metrics.on_rendered();
+                m_metrics.on_passthrough();
+                pace_frame(*frame, timing);
+                callback(frame, std::nullopt);
+                tracer.trace(m_trace_source_id, frame_id, "callback");
+                auto callback_end = oep_metrics::clock::now();
+                m_metrics.record(stage::callback, callback_start, callback_end);
+                m_metrics.record(stage::total, enqueue_time, callback_end);
+                lease.reset();
+            } else if (render) {
+                // the previous frame leaves the render target, a client still holding it gets a copy
+                detach_gpu_frame();
+                if (m_pending_quality_level.has_value()) {
+                    // applied between the frames, the previous frame may still be read back until now
+                    apply_quality_level(*m_pending_quality_level);
+                    m_pending_quality_level.reset();
+                }
+                m_current_frame_id = frame_id;
+                m_gpu_frame = frame;
+                tracer.trace(m_trace_source_id, frame_id, "render_start");
                 m_ort->prepare_rendering();
                 m_ep->push_frame(std::move(*image));
+                tracer.trace(m_trace_source_id, frame_id, "push_frame");
+                m_ort->begin_gpu_stage(interfaces::gpu_stage::effect_draw);
                 while (m_ep->draw() < 0) {
                     std::this_thread::yield();
                 }
+                m_ort->invalidate_gl_state();
+                m_ort->end_gpu_stage(interfaces::gpu_stage::effect_draw);
+                tracer.trace(m_trace_source_id, frame_id, "draw");
+                auto orientation_start = oep_metrics::clock::now();
+                m_metrics.record(stage::render, render_start, orientation_start);
                 m_ort->orient_image(*target_orient);
-                callback(m_current_frame);
-                m_current_frame->unlock();
+                tracer.trace(m_trace_source_id, frame_id, "orient_image");
+                auto callback_start = oep_metrics::clock::now();
+                m_metrics.record(stage::orientation, orientation_start, callback_start);
+                m_metrics.on_rendered();
+                update_render_estimate(callback_start - render_start);
+                frame->set_frame_timing(timing);
+                pace_frame(*frame, timing);
+                callback(frame, std::nullopt);
+                tracer.trace(m_trace_source_id, frame_id, "callback");
+                auto callback_end = oep_metrics::clock::now();
+                m_metrics.record(stage::callback, callback_start, callback_end);
+                m_metrics.record(stage::total, enqueue_time, callback_end);
+                // recycles the buffer at once unless the client took a lease
+                lease.reset();
+
+                if (m_quality_controller.has_value()) {
+                    auto render_ms = std::chrono::duration<double, std::milli>(callback_start - render_start).count();
+                    if (auto event = m_quality_controller->on_frame(frame_id, render_ms)) {
+                        m_pending_quality_level = event->level;
+                        m_metrics.on_quality_change(event->from_level, event->to_level);
+                        if (m_quality_cb) {
+                            m_quality_cb(*event);
+                        }
+                    }
+                }
             } else {
-                callback(std::nullopt);
+                auto reason = late ? interfaces::frame_drop_reason::timeout : interfaces::frame_drop_reason::queue;
+                callback(std::nullopt, reason);
+                tracer.trace(m_trace_source_id, frame_id, "dropped");
+                m_metrics.on_dropped(reason);
             }
             --m_incoming_frame_queue_task_count;
+
+            if (lossless) {
+                release_frame();
+            }
         };
 
         ++m_incoming_frame_queue_task_count;
+        m_metrics.add_queue_depth(1);
         m_scheduler.enqueue(task);
     }
 
+    void offscreen_effect_player::set_processing_mode(interfaces::processing_mode mode, uint32_t max_frames_in_flight)
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_in_flight_mutex);
+            m_max_frames_in_flight = std::max(max_frames_in_flight, 1u);
+        }
+        m_processing_mode = mode;
+        m_in_flight_cv.notify_all();
+    }
+
     void offscreen_effect_player::surface_changed(int32_t width, int32_t height)
     {
         auto task = [this, width, height]() {
-            m_ep->surface_changed(width, height);
-            m_ep->effect_manager()->set_effect_size(width, height);
+            m_width = width;
+            m_height = height;
 
-            m_current_frame.reset();
+            // the render target is reallocated
+            detach_gpu_frame();
             m_ort->surface_changed(width, height);
+            apply_render_size();
         };
 
         m_scheduler.enqueue(task);
     }
 
-    void offscreen_effect_player::load_effect(const std::string& effect_path)
+    void offscreen_effect_player::enable_adaptive_quality(std::optional<interfaces::adaptive_quality_config> config,
+                                                          interfaces::quality_event_cb on_change)
     {
-        auto task = [this, effect_path]() {
-            if (auto e_manager = m_ep->effect_manager()) {
-                e_manager->load(effect_path);
-            } else {
-                std::cout << "[Error] effect manager not initialized" << std::endl;
+        auto task = [this, config, on_change]() {
+            std::optional<interfaces::quality_level> best_level;
+            if (config.has_value()) {
+                m_quality_controller.emplace(*config);
+                best_level = m_quality_controller->current_level();
+            } else if (m_quality_controller.has_value()) {
+                best_level = m_quality_controller->config().levels.front();
+                m_quality_controller.reset();
+            }
+            m_quality_cb = on_change;
+            m_metrics.on_quality_change(0, 0);
+
+            if (best_level.has_value()) {
+                m_pending_quality_level = best_level;
+            }
+        };
+
+        m_scheduler.enqueue(task);
+    }
+
+    void offscreen_effect_player::enable_frame_pacing(std::optional<interfaces::frame_pacing_config> config,
+                                                      interfaces::paced_frame_cb on_frame)
+    {
+        auto task = [this, config, on_frame]() {
+            m_pacer.reset();
+            if (config.has_value()) {
+                m_pacer = std::make_unique<frame_pacer>(*config, on_frame, m_metrics);
+            }
+        };
+
+        m_scheduler.enqueue(task);
+    }
+
+    uint32_t offscreen_effect_player::add_grid_stream(const std::string& effect_path)
+    {
+        auto id = ++m_last_grid_stream;
+        if (!effect_path.empty()) {
+            m_prefetcher.prefetch(effect_path);
+        }
+
+        auto task = [this, id, effect_path]() {
+            if (!m_renderer_factory) {
+                WRITE_LOG_MESSAGE(error, "No effect renderers for the grid streams");
+                return;
+            }
+            grid_stream stream;
+            stream.id = id;
+            stream.renderer = m_renderer_factory();
+            stream.tile = grid_tile_of(m_grid_streams.size(), m_grid_streams.size() + 1, m_width, m_height);
+            stream.render_width = stream.tile.width;
+            stream.render_height = stream.tile.height;
+            // the other tiles shrink by the next composite
+            stream.renderer->surface_created(stream.render_width, stream.render_height);
+            if (!effect_path.empty() && !stream.renderer->load_effect(effect_path)) {
+                WRITE_LOG_MESSAGE(error, "Failed to load the effect of the grid stream " << id << ": " << effect_path);
+            }
+            m_ort->invalidate_gl_state();
+            m_grid_streams.push_back(std::move(stream));
+        };
+
+        m_scheduler.enqueue(task);
+        return id;
+    }
+
+    void offscreen_effect_player::remove_grid_stream(uint32_t stream)
+    {
+        auto task = [this, stream]() {
+            auto it = std::find_if(m_grid_streams.begin(), m_grid_streams.end(), [stream](const grid_stream& s) { return s.id == stream; });
+            if (it == m_grid_streams.end()) {
+                return;
+            }
+            it->renderer->surface_destroyed();
+            m_ort->invalidate_gl_state();
+            m_grid_streams.erase(it);
+        };
+
+        m_scheduler.enqueue(task);
+    }
+
+    void offscreen_effect_player::load_grid_effect(uint32_t stream, const std::string& effect_path, interfaces::effect_loaded_cb callback)
+    {
+        if (!effect_path.empty()) {
+            m_prefetcher.prefetch(effect_path);
+        }
+
+        auto task = [this, stream, effect_path, callback]() {
+            auto grid_stream = find_grid_stream(stream);
+            bool loaded = grid_stream != nullptr && grid_stream->renderer->load_effect(effect_path);
+            m_ort->invalidate_gl_state();
+            if (callback) {
+                callback(loaded);
+            }
+        };
+
+        m_scheduler.enqueue(task);
+    }
+
+    void offscreen_effect_player::push_grid_frame(uint32_t stream, std::shared_ptr<full_image_t> image,
+                                                  std::optional<interfaces::orient_format> target_orient)
+    {
+        if (!target_orient.has_value()) {
+            target_orient = { image->get_format().orientation, true };
+        }
+
+        auto task = [this, stream, image, target_orient]() {
+            if (auto grid_stream = find_grid_stream(stream)) {
+                grid_stream->pending = image;
+                grid_stream->orient = *target_orient;
+            }
+        };
+
+        m_scheduler.enqueue(task);
+    }
+
+    void offscreen_effect_player::composite_grid_async(interfaces::frame_result_cb callback, interfaces::frame_timing timing)
+    {
+        bool lossless = admit_frame();
+
+        auto frame_id = ++m_last_frame_id;
+        auto enqueue_time = oep_metrics::clock::now();
+        auto& tracer = frame_tracer::instance();
+        tracer.trace(m_trace_source_id, frame_id, "enqueue");
+        m_metrics.on_submitted();
+
+        auto task = [this, callback, timing, lossless, frame_id, enqueue_time, &tracer]() {
+            using stage = interfaces::pipeline_stage;
+            auto render_start = oep_metrics::clock::now();
+            m_metrics.record(stage::queue_wait, enqueue_time, render_start);
+            m_metrics.add_queue_depth(-1);
+
+            // like the frames, only the latest composite is rendered in the realtime mode
+            // and only if it can be delivered within its budget
+            bool latest = m_incoming_composite_count-- == 1;
+            std::optional<interfaces::frame_drop_reason> drop;
+            if (!lossless && !latest) {
+                drop = interfaces::frame_drop_reason::queue;
+            } else if (!lossless && misses_deadline(timing, render_start)) {
+                drop = interfaces::frame_drop_reason::timeout;
+            }
+            auto frame = drop.has_value() ? nullptr : acquire_frame(lossless);
+            if (frame == nullptr && !drop.has_value()) {
+                WRITE_LOG_MESSAGE(warning, "The interface for processing the previous frame is lock");
+                drop = interfaces::frame_drop_reason::locked_buffer;
+            }
+            if (drop.has_value()) {
+                callback(std::nullopt, drop);
+                tracer.trace(m_trace_source_id, frame_id, "dropped");
+                m_metrics.on_dropped(*drop);
+                if (lossless) {
+                    release_frame();
+                }
+                return;
+            }
+            // the composite is oriented tile by tile
+            frame->begin_frame(uint32_t(m_width), uint32_t(m_height), camera_orientation::deg_0);
+            auto lease = frame->lease();
+
+            detach_gpu_frame();
+            m_current_frame_id = frame_id;
+            m_gpu_frame = frame;
+            tracer.trace(m_trace_source_id, frame_id, "render_start");
+            apply_grid_layout();
+            // the frames go to the effect players before the render target binds anything
+            for (auto& stream : m_grid_streams) {
+                if (stream.pending != nullptr) {
+                    stream.renderer->push_frame(std::move(*stream.pending));
+                    stream.pending.reset();
+                    stream.has_frame = true;
+                }
+            }
+            m_ort->invalidate_gl_state();
+            m_ort->begin_composite();
+            m_ort->begin_gpu_stage(interfaces::gpu_stage::effect_draw);
+            for (auto& stream : m_grid_streams) {
+                if (!stream.has_frame) {
+                    continue;
+                }
+                m_ort->prepare_tile_rendering();
+                while (stream.renderer->draw() < 0) {
+                    std::this_thread::yield();
+                }
+                m_ort->invalidate_gl_state();
+                m_ort->compose_tile(stream.orient, stream.tile);
+            }
+            m_ort->end_gpu_stage(interfaces::gpu_stage::effect_draw);
+            tracer.trace(m_trace_source_id, frame_id, "composite");
+
+            auto callback_start = oep_metrics::clock::now();
+            m_metrics.record(stage::render, render_start, callback_start);
+            m_metrics.on_rendered();
+            update_render_estimate(callback_start - render_start);
+            frame->set_frame_timing(timing);
+            pace_frame(*frame, timing);
+            callback(frame, std::nullopt);
+            tracer.trace(m_trace_source_id, frame_id, "callback");
+            auto callback_end = oep_metrics::clock::now();
+            m_metrics.record(stage::callback, callback_start, callback_end);
+            m_metrics.record(stage::total, enqueue_time, callback_end);
+            lease.reset();
+
+            if (lossless) {
+                release_frame();
+            }
+        };
+
+        ++m_incoming_composite_count;
+        m_metrics.add_queue_depth(1);
+        m_scheduler.enqueue(task);
+    }
+
+    offscreen_effect_player::grid_stream* offscreen_effect_player::find_grid_stream(uint32_t stream)
+    {
+        auto it = std::find_if(m_grid_streams.begin(), m_grid_streams.end(), [stream](const grid_stream& s) { return s.id == stream; });
+        return it != m_grid_streams.end() ? &*it : nullptr;
+    }
+
+    void offscreen_effect_player::apply_grid_layout()
+    {
+        for (size_t i = 0; i < m_grid_streams.size(); ++i) {
+            auto& stream = m_grid_streams[i];
+            stream.tile = grid_tile_of(i, m_grid_streams.size(), m_width, m_height);
+            bool swapped = stream.orient.orientation == camera_orientation::deg_90 || stream.orient.orientation == camera_orientation::deg_270;
+            auto render_width = swapped ? stream.tile.height : stream.tile.width;
+            auto render_height = swapped ? stream.tile.width : stream.tile.height;
+            if (render_width != stream.render_width || render_height != stream.render_height) {
+                stream.renderer->surface_changed(render_width, render_height);
+                stream.render_width = render_width;
+                stream.render_height = render_height;
+            }
+        }
+    }
+
+    void offscreen_effect_player::set_render_scale(float scale, interfaces::upscale_filter filter)
+    {
+        auto task = [this, scale, filter]() {
+            m_render_scale = std::clamp(scale, 0.1f, 1.0f);
+            m_upscale_filter = filter;
+            apply_render_size();
+        };
+
+        m_scheduler.enqueue(task);
+    }
+
+    void offscreen_effect_player::apply_quality_level(const interfaces::quality_level& level)
+    {
+        m_ep->set_max_faces(level.max_faces);
+        if (level.render_scale != m_quality_render_scale) {
+            m_quality_render_scale = level.render_scale;
+            apply_render_size();
+        }
+    }
+
+    void offscreen_effect_player::apply_render_size()
+    {
+        auto scale = std::max(m_render_scale * m_quality_render_scale, 0.1f);
+        m_ort->set_render_scale(scale, m_upscale_filter);
+
+        auto width = std::max(1, static_cast<int32_t>(std::lround(m_width * scale)));
+        auto height = std::max(1, static_cast<int32_t>(std::lround(m_height * scale)));
+        if (width == m_render_width && height == m_render_height) {
+            return;
+        }
+        m_render_width = width;
+        m_render_height = height;
+        m_ep->surface_changed(width, height);
+        m_ort->invalidate_gl_state();
+    }
+
+    void offscreen_effect_player::load_effect(const std::string& effect_path, interfaces::effect_loaded_cb callback)
+    {
+        auto task = [this, effect_path, callback]() {
+            bool loaded = m_ep->load_effect(effect_path);
+            m_ort->invalidate_gl_state();
+            if (!effect_path.empty()) {
+                warm_up();
+            }
+            if (callback) {
+                callback(loaded);
             }
         };
 
@@ -114,49 +624,283 @@ namespace bnb
         load_effect("");
     }
 
+    std::shared_future<interfaces::prefetch_stats> offscreen_effect_player::prefetch_effect(const std::string& effect_path)
+    {
+        return m_prefetcher.prefetch(effect_path);
+    }
+
+    void offscreen_effect_player::warm_up()
+    {
+        if (m_warmup_frames == 0) {
+            return;
+        }
+
+        // the size the next real frame renders at, so the warmed up targets are the ones it uses
+        apply_render_size();
+
+        // black full range NV12, a face-tracking effect may still compile a few variants on the first face
+        image_format format;
+        format.width = static_cast<uint32_t>(m_render_width);
+        format.height = static_cast<uint32_t>(m_render_height);
+        format.orientation = camera_orientation::deg_0;
+        format.require_mirroring = false;
+        std::vector<uint8_t> y(size_t(format.width) * format.height, 0);
+        std::vector<uint8_t> uv(size_t((format.width + 1) / 2) * 2 * ((format.height + 1) / 2), 128);
+        full_image_t image(yuv_image_t(color_plane_vector(std::move(y)), color_plane_vector(std::move(uv)), format,
+                                       yuv_format_t{color_range::full, color_std::bt601, yuv_format::yuv_nv12}));
+
+        // the frames are neither counted in the metrics nor passed to the client
+        detach_gpu_frame();
+        for (uint32_t i = 0; i < m_warmup_frames; ++i) {
+            m_ort->prepare_rendering();
+            m_ep->push_frame(image);
+            while (m_ep->draw() < 0) {
+                std::this_thread::yield();
+            }
+            m_ort->invalidate_gl_state();
+        }
+    }
+
     void offscreen_effect_player::call_js_method(const std::string& method, const std::string& param)
     {
-        if (auto e_manager = m_ep->effect_manager()) {
-            if (auto effect = e_manager->current()) {
-                effect->call_js_method(method, param);
+        m_ep->call_js_method(method, param);
+    }
+
+    interfaces::gpu_stats offscreen_effect_player::get_gpu_stats()
+    {
+        return m_ort->get_gpu_stats();
+    }
+
+    void offscreen_effect_player::enable_tracing(bool enable)
+    {
+        frame_tracer::instance().set_enabled(enable);
+    }
+
+    bool offscreen_effect_player::dump_trace(const std::string& path)
+    {
+        return frame_tracer::instance().write_chrome_trace(path);
+    }
+
+    interfaces::metrics_snapshot offscreen_effect_player::get_metrics()
+    {
+        return m_metrics.snapshot();
+    }
+
+    bool offscreen_effect_player::write_metrics(const std::string& path)
+    {
+        return m_metrics.write_prometheus(path);
+    }
+
+    bool offscreen_effect_player::serve_metrics(const std::string& socket_path)
+    {
+        return m_metrics.serve(socket_path);
+    }
+
+    interfaces::startup_timings offscreen_effect_player::get_startup_timings()
+    {
+        std::lock_guard<std::mutex> lock(m_startup_mutex);
+        return m_startup;
+    }
+
+    bool offscreen_effect_player::admit_frame()
+    {
+        if (m_processing_mode != interfaces::processing_mode::lossless) {
+            return false;
+        }
+        std::unique_lock<std::mutex> lock(m_in_flight_mutex);
+        // the render thread would wait for itself
+        if (std::this_thread::get_id() != render_thread_id) {
+            m_in_flight_cv.wait(lock, [this]() { return m_frames_in_flight < m_max_frames_in_flight; });
+        }
+        ++m_frames_in_flight;
+        return true;
+    }
+
+    void offscreen_effect_player::release_frame()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_in_flight_mutex);
+            --m_frames_in_flight;
+        }
+        m_in_flight_cv.notify_all();
+    }
+
+    std::shared_ptr<pixel_buffer> offscreen_effect_player::acquire_frame(bool lossless)
+    {
+        // the lossless mode does not drop for the client leases up to the frames it admits,
+        // a client that never unlocks is still bounded
+        uint32_t frames_limit = max_frames;
+        if (lossless) {
+            std::lock_guard<std::mutex> lock(m_in_flight_mutex);
+            frames_limit += m_max_frames_in_flight;
+        }
+
+        std::shared_ptr<pixel_buffer> frame;
+        {
+            std::lock_guard<std::mutex> lock(m_frames_mutex);
+            if (!m_free_frames.empty()) {
+                frame = std::move(m_free_frames.back());
+                m_free_frames.pop_back();
+            } else if (m_frames_created >= frames_limit) {
+                // every buffer is leased by the client
+                return nullptr;
             } else {
-                std::cout << "[Error] effect not loaded" << std::endl;
+                ++m_frames_created;
             }
-        } else {
-            std::cout << "[Error] effect manager not initialized" << std::endl;
         }
+        if (frame == nullptr) {
+            frame = std::make_shared<pixel_buffer>(shared_from_this(), m_width, m_height, camera_orientation::deg_0);
+        }
+        // a free buffer may still be named by the render target, it is about to hold another frame
+        if (frame == m_gpu_frame) {
+            m_gpu_frame.reset();
+        }
+        return frame;
+    }
+
+    void offscreen_effect_player::recycle_frame(std::shared_ptr<pixel_buffer> frame)
+    {
+        std::lock_guard<std::mutex> lock(m_frames_mutex);
+        // a client may lock and unlock a buffer which is free already, it is listed once
+        if (std::find(m_free_frames.begin(), m_free_frames.end(), frame) == m_free_frames.end()) {
+            m_free_frames.push_back(std::move(frame));
+        }
+    }
+
+    void offscreen_effect_player::detach_gpu_frame()
+    {
+        if (m_gpu_frame != nullptr && m_gpu_frame->is_locked() && !m_gpu_frame->in_memory()) {
+            auto readback_start = oep_metrics::clock::now();
+            auto data = m_ort->read_current_buffer();
+            m_metrics.record(interfaces::pipeline_stage::readback, readback_start);
+            m_gpu_frame->detach(std::move(data));
+        }
+        m_gpu_frame.reset();
+    }
+
+    void offscreen_effect_player::pace_frame(pixel_buffer& frame, const interfaces::frame_timing& timing)
+    {
+        if (m_pacer == nullptr) {
+            return;
+        }
+        // a single readback serves the pacer and the client: the frame is kept in memory before the
+        // callback, so the reads of the client convert it from there instead of reading the GPU again
+        if (m_gpu_frame.get() == &frame && !frame.in_memory()) {
+            auto readback_start = oep_metrics::clock::now();
+            auto data = m_ort->read_current_buffer();
+            m_metrics.record(interfaces::pipeline_stage::readback, readback_start);
+            frame.detach(std::move(data));
+        }
+        // on the render thread the read is synchronous, the lease of the render task keeps the frame
+        frame.get_image(m_pacer->config().format, [this, timing](std::optional<full_image_t> image) {
+            if (image.has_value()) {
+                m_pacer->push(std::move(*image), timing);
+            }
+        });
+    }
+
+    bool offscreen_effect_player::misses_deadline(const interfaces::frame_timing& timing, oep_metrics::clock::time_point now)
+    {
+        if (timing.latency_budget_us <= 0) {
+            return false;
+        }
+        auto now_us = std::chrono::duration_cast<std::chrono::microseconds>(now.time_since_epoch()).count();
+        auto deadline_us = timing.capture_timestamp_us + timing.latency_budget_us;
+        // the input is handed over at once without an effect
+        auto expected_us = m_ep->has_effect() ? static_cast<int64_t>(m_render_estimate_us) : int64_t(0);
+        if (now_us + expected_us <= deadline_us) {
+            m_deadline_skips = 0;
+            return false;
+        }
+        // the estimate is only updated by rendered frames, e.g. after a heavy effect is replaced by a light one
+        if (now_us <= deadline_us && ++m_deadline_skips >= deadline_probe_interval) {
+            m_deadline_skips = 0;
+            return false;
+        }
+        return true;
+    }
+
+    void offscreen_effect_player::update_render_estimate(oep_metrics::clock::duration render_time)
+    {
+        auto us = static_cast<double>(std::chrono::duration_cast<std::chrono::microseconds>(render_time).count());
+        m_render_estimate_us = m_render_estimate_us == 0.0 ? us : m_render_estimate_us + render_estimate_weight * (us - m_render_estimate_us);
+    }
+
+    void offscreen_effect_player::read_current_buffer(std::shared_ptr<pixel_buffer> frame, uint64_t generation,
+                                                      std::function<void(std::optional<bnb::data_t> data)> callback)
+    {
+        auto read = [frame, generation, callback](offscreen_effect_player& oep) {
+            if (oep.m_gpu_frame != frame || frame->get_generation() != generation) {
+                callback(std::nullopt);
+                return;
+            }
+            auto readback_start = oep_metrics::clock::now();
+            auto data = oep.m_ort->read_current_buffer();
+            oep.m_metrics.record(interfaces::pipeline_stage::readback, readback_start);
+            frame_tracer::instance().trace(oep.m_trace_source_id, oep.m_current_frame_id, "readback");
+            callback(std::move(data));
+        };
+
+        if (std::this_thread::get_id() == render_thread_id) {
+            read(*this);
+            return;
+        }
+
+        oep_wptr this_ = shared_from_this();
+        auto task = [this_, read]() {
+            if (auto this_sp = this_.lock()) {
+                read(*this_sp);
+            }
+        };
+        m_scheduler.enqueue(task);
     }
 
-    void offscreen_effect_player::read_current_buffer(std::function<void(bnb::data_t data)> callback)
+    #ifdef __APPLE__
+    void offscreen_effect_player::make_pixel_buffer(full_image_t image, oep_image_ready_pb_cb callback)
     {
+        // the surface pool of the render target is used from the render thread only
         if (std::this_thread::get_id() == render_thread_id) {
-            callback(m_ort->read_current_buffer());
+            callback(m_ort->make_pixel_buffer(image));
             return;
         }
 
         oep_wptr this_ = shared_from_this();
-        auto task = [this_, callback]() {
+        auto task = [this_, image = std::move(image), callback]() {
             if (auto this_sp = this_.lock()) {
-                callback(this_sp->m_ort->read_current_buffer());
+                callback(this_sp->m_ort->make_pixel_buffer(image));
             }
         };
         m_scheduler.enqueue(task);
     }
 
-    void offscreen_effect_player::read_pixel_buffer(oep_image_ready_pb_cb callback)
+    void offscreen_effect_player::read_pixel_buffer(std::shared_ptr<pixel_buffer> frame, uint64_t generation,
+                                                    std::function<void(std::optional<void*> pixel_buffer)> callback)
     {
+        auto read = [frame, generation, callback](offscreen_effect_player& oep) {
+            if (oep.m_gpu_frame != frame || frame->get_generation() != generation) {
+                callback(std::nullopt);
+                return;
+            }
+            auto readback_start = oep_metrics::clock::now();
+            auto pixel_buffer = oep.m_ort->get_pixel_buffer();
+            oep.m_metrics.record(interfaces::pipeline_stage::readback, readback_start);
+            frame_tracer::instance().trace(oep.m_trace_source_id, oep.m_current_frame_id, "readback");
+            callback(pixel_buffer);
+        };
+
         if (std::this_thread::get_id() == render_thread_id) {
-            callback(m_ort->get_pixel_buffer());
+            read(*this);
             return;
         }
 
         oep_wptr this_ = shared_from_this();
-        auto task = [this_, callback]() {
+        auto task = [this_, read]() {
             if (auto this_sp = this_.lock()) {
-                callback(this_sp->m_ort->get_pixel_buffer());
+                read(*this_sp);
             }
         };
         m_scheduler.enqueue(task);
     }
+    #endif
 
 } // bnb
@@ -2,7 +2,76 @@
 
 #include <bnb/types/full_image.hpp>
 
-#include <iostream>
+#include <tuple>
+#include <utility>
+
+#include "conversion.hpp"
+#include "logger.hpp"
+#include "rotation.hpp"
+
+namespace
+{
+    using namespace bnb;
+
+    uint32_t orientation_degrees(camera_orientation orientation)
+    {
+        switch (orientation) {
+            case camera_orientation::deg_90:
+                return 90;
+            case camera_orientation::deg_180:
+                return 180;
+            case camera_orientation::deg_270:
+                return 270;
+            default:
+                return 0;
+        }
+    }
+
+    // the planes reference the memory of the holder, no copy
+    color_plane alias_plane(uint8_t* data, std::shared_ptr<full_image_t> holder)
+    {
+        return color_plane(data, [holder](color_plane_data_t*) {});
+    }
+
+    // transforms the plane into a new plane of the pool
+    color_plane rotated_plane(plane_pool& pool, const uint8_t* src, uint32_t width, uint32_t height,
+                              uint32_t bytes_per_pixel, image_transform transform)
+    {
+        auto dst = pool.acquire(size_t(width) * height * bytes_per_pixel);
+        auto dst_width = transform.degrees % 180 == 0 ? width : height;
+        rotate_plane(
+            // clang-format off
+            src, int32_t(width * bytes_per_pixel),
+            width, height, bytes_per_pixel, transform,
+            dst.get(), int32_t(dst_width * bytes_per_pixel)
+            // clang-format on
+        );
+        return dst;
+    }
+
+    // NV12 chroma of the I420 one in a new plane of the pool
+    color_plane interleaved_plane(plane_pool& pool, const uint8_t* u, const uint8_t* v, size_t samples)
+    {
+        auto uv = pool.acquire(samples * 2);
+        for (size_t i = 0; i < samples; ++i) {
+            uv.get()[i * 2] = u[i];
+            uv.get()[i * 2 + 1] = v[i];
+        }
+        return uv;
+    }
+
+    // I420 chroma of the NV12 one in new planes of the pool
+    std::pair<color_plane, color_plane> deinterleaved_planes(plane_pool& pool, const uint8_t* uv, size_t samples)
+    {
+        auto u = pool.acquire(samples);
+        auto v = pool.acquire(samples);
+        for (size_t i = 0; i < samples; ++i) {
+            u.get()[i] = uv[i * 2];
+            v.get()[i] = uv[i * 2 + 1];
+        }
+        return {u, v};
+    }
+} // anonymous namespace
 
 namespace bnb
 {
@@ -14,40 +83,406 @@ namespace bnb
 
     void pixel_buffer::lock()
     {
-        ++lock_count;
+        ++m_lock_count;
     }
 
     void pixel_buffer::unlock()
     {
-        if (lock_count > 0) {
-            --lock_count;
+        auto count = m_lock_count.load();
+        do {
+            if (count == 0) {
+                throw std::runtime_error("pixel_buffer already unlocked");
+            }
+        } while (!m_lock_count.compare_exchange_weak(count, count - 1));
+
+        if (count == 1) {
+            if (auto oep_sp = m_oep_ptr.lock()) {
+                oep_sp->recycle_frame(std::static_pointer_cast<pixel_buffer>(shared_from_this()));
+            }
+        }
+    }
+
+    bool pixel_buffer::is_locked()
+    {
+        return m_lock_count != 0;
+    }
+
+    uint64_t pixel_buffer::get_generation()
+    {
+        return m_generation;
+    }
+
+    interfaces::frame_timing pixel_buffer::get_frame_timing()
+    {
+        std::lock_guard<std::mutex> lock(m_passthrough_mutex);
+        return m_frame_timing;
+    }
+
+    void pixel_buffer::set_frame_timing(interfaces::frame_timing timing)
+    {
+        std::lock_guard<std::mutex> lock(m_passthrough_mutex);
+        m_frame_timing = timing;
+    }
+
+    void pixel_buffer::set_passthrough(std::shared_ptr<full_image_t> image, interfaces::orient_format target_orient)
+    {
+        std::lock_guard<std::mutex> lock(m_passthrough_mutex);
+        m_passthrough_image = std::move(image);
+        m_passthrough_orient = target_orient;
+    }
+
+    void pixel_buffer::begin_frame(uint32_t width, uint32_t height, camera_orientation orientation)
+    {
+        // a reader of a previous lease sees either the old frame or the new one as a whole
+        std::lock_guard<std::mutex> lock(m_passthrough_mutex);
+        ++m_generation;
+        m_width = width;
+        m_height = height;
+        m_orientation = orientation;
+        m_passthrough_image = nullptr;
+        m_passthrough_orient = {camera_orientation::deg_0, true};
+    }
+
+    void pixel_buffer::detach(data_t rgba)
+    {
+        auto image_format = rendered_format();
+
+        if (rgba.data == nullptr || rgba.size < size_t(image_format.width) * image_format.height * 4) {
+            WRITE_LOG_MESSAGE(error, "Failed to keep the frame of a leased pixel buffer");
             return;
         }
+        auto holder = std::make_shared<data_t>(std::move(rgba));
+        color_plane rgba_plane(holder->data.get(), [holder](color_plane_data_t*) {});
+        auto image = std::make_shared<full_image_t>(bpc8_image_t(rgba_plane, bpc8_image_t::pixel_format_t::rgba, image_format));
+        // the readback is oriented already
+        set_passthrough(std::move(image), {camera_orientation::deg_0, true});
+    }
 
-        throw std::runtime_error("pixel_buffer already unlocked");
+    bool pixel_buffer::in_memory()
+    {
+        return passthrough_image() != nullptr;
     }
 
-    bool pixel_buffer::is_locked()
+    std::shared_ptr<full_image_t> pixel_buffer::passthrough_image()
     {
-        if (lock_count == 0) {
-            return false;
+        std::lock_guard<std::mutex> lock(m_passthrough_mutex);
+        return m_passthrough_image;
+    }
+
+    image_format pixel_buffer::rendered_format(uint64_t* generation)
+    {
+        auto image_format = bnb::image_format();
+        image_format.orientation = camera_orientation::deg_0;
+        image_format.require_mirroring = false;
+
+        std::lock_guard<std::mutex> lock(m_passthrough_mutex);
+        image_format.width = m_width;
+        image_format.height = m_height;
+        if (generation != nullptr) {
+            *generation = m_generation;
         }
-        return true;
+        return image_format;
     }
 
     void pixel_buffer::get_pixel_buffer(oep_image_ready_pb_cb callback)
     {
         if (!is_locked()) {
-            std::cout << "[WARNING] The pixel buffer must be locked" << std::endl;
+            WRITE_LOG_MESSAGE(warning, "The pixel buffer must be locked");
             callback(nullptr);
             return;
         }
 
+    #ifdef __APPLE__
         if (auto oep_sp = m_oep_ptr.lock()) {
-            oep_sp->read_pixel_buffer(callback);
+            if (passthrough_image() != nullptr) {
+                auto image = get_passthrough_image(interfaces::output_image_format::nv12, *oep_sp->m_plane_pool);
+                if (!image.has_value()) {
+                    callback(nullptr);
+                    return;
+                }
+                oep_sp->make_pixel_buffer(std::move(*image), callback);
+                return;
+            }
+            auto self = std::static_pointer_cast<pixel_buffer>(shared_from_this());
+            auto generation = get_generation();
+            oep_sp->read_pixel_buffer(self, generation, [self, generation, callback](std::optional<void*> pixel_buffer) {
+                if (pixel_buffer.has_value()) {
+                    callback(*pixel_buffer);
+                } else if (self->get_generation() == generation && self->passthrough_image() != nullptr) {
+                    // detached before the read, the frame is in memory now
+                    self->get_pixel_buffer(callback);
+                } else {
+                    WRITE_LOG_MESSAGE(warning, "The pixel buffer was reused before the read, it must be locked");
+                    callback(nullptr);
+                }
+            });
         }
         else {
-            std::cout << "[ERROR] Offscreen effect player destroyed" << std::endl;
+            WRITE_LOG_MESSAGE(error, "Offscreen effect player destroyed");
+        }
+    #else
+        WRITE_LOG_MESSAGE(warning, "CVPixelBufferRef is available only on Apple platforms, use get_image");
+        callback(nullptr);
+    #endif
+    }
+
+    void pixel_buffer::get_image(interfaces::output_image_format format, oep_image_ready_cb callback)
+    {
+        if (!is_locked()) {
+            WRITE_LOG_MESSAGE(warning, "The pixel buffer must be locked");
+            callback(std::nullopt);
+            return;
+        }
+
+        auto oep_sp = m_oep_ptr.lock();
+        if (oep_sp == nullptr) {
+            WRITE_LOG_MESSAGE(error, "Offscreen effect player destroyed");
+            callback(std::nullopt);
+            return;
+        }
+
+        if (passthrough_image() != nullptr) {
+            callback(get_passthrough_image(format, *oep_sp->m_plane_pool));
+            return;
+        }
+
+        // the size and the generation of the same frame, begin_frame may run meanwhile
+        uint64_t generation = 0;
+        auto image_format = rendered_format(&generation);
+
+        auto convert_callback = [image_format, format, callback, pool = oep_sp->m_plane_pool](data_t data) {
+            const auto width = image_format.width;
+            const auto height = image_format.height;
+            const auto rgba_row_stride = static_cast<int32_t>(width * 4);
+
+            if (data.data == nullptr || data.size < size_t(rgba_row_stride) * height) {
+                WRITE_LOG_MESSAGE(error, "Failed to read the current buffer");
+                callback(std::nullopt);
+                return;
+            }
+
+            switch (format) {
+                case interfaces::output_image_format::rgba: {
+                    // the read buffer already has the requested layout, hand it over without a copy
+                    auto holder = std::make_shared<data_t>(std::move(data));
+                    color_plane rgba_plane(holder->data.get(), [holder](color_plane_data_t*) {});
+                    callback(full_image_t(bpc8_image_t(rgba_plane, bpc8_image_t::pixel_format_t::rgba, image_format)));
+                } break;
+                case interfaces::output_image_format::nv12: {
+                    auto y_plane = pool->acquire(size_t(width) * height);
+                    auto uv_plane = pool->acquire(size_t(chroma_size(width)) * chroma_size(height) * 2);
+                    rgba_to_nv12(
+                        // clang-format off
+                        data.data.get(), rgba_row_stride,
+                        width, height,
+                        y_plane.get(), int32_t(width),
+                        uv_plane.get(), int32_t(chroma_size(width) * 2)
+                        // clang-format on
+                    );
+                    yuv_format_t yuv_format{color_range::full, color_std::bt601, yuv_format::yuv_nv12};
+                    callback(full_image_t(yuv_image_t(y_plane, uv_plane, image_format, yuv_format)));
+                } break;
+                case interfaces::output_image_format::i420: {
+                    auto y_plane = pool->acquire(size_t(width) * height);
+                    auto u_plane = pool->acquire(size_t(chroma_size(width)) * chroma_size(height));
+                    auto v_plane = pool->acquire(size_t(chroma_size(width)) * chroma_size(height));
+                    rgba_to_i420(
+                        // clang-format off
+                        data.data.get(), rgba_row_stride,
+                        width, height,
+                        y_plane.get(), int32_t(width),
+                        u_plane.get(), int32_t(chroma_size(width)),
+                        v_plane.get(), int32_t(chroma_size(width))
+                        // clang-format on
+                    );
+                    yuv_format_t yuv_format{color_range::full, color_std::bt601, yuv_format::yuv_i420};
+                    callback(full_image_t(yuv_image_t(y_plane, u_plane, v_plane, image_format, yuv_format)));
+                } break;
+            }
+        };
+
+        // the frame may leave the render target before the read runs, then it is read from memory
+        auto self = std::static_pointer_cast<pixel_buffer>(shared_from_this());
+        oep_sp->read_current_buffer(self, generation, [self, generation, format, callback, convert_callback, pool = oep_sp->m_plane_pool](std::optional<data_t> data) {
+            if (data.has_value()) {
+                convert_callback(std::move(*data));
+            } else if (self->get_generation() == generation && self->passthrough_image() != nullptr) {
+                callback(self->get_passthrough_image(format, *pool));
+            } else {
+                WRITE_LOG_MESSAGE(warning, "The pixel buffer was reused before the read, it must be locked");
+                callback(std::nullopt);
+            }
+        });
+    }
+
+    std::optional<full_image_t> pixel_buffer::get_passthrough_image(interfaces::output_image_format format, plane_pool& pool)
+    {
+        using interfaces::output_image_format;
+
+        std::shared_ptr<full_image_t> source;
+        interfaces::orient_format target_orient;
+        {
+            std::lock_guard<std::mutex> lock(m_passthrough_mutex);
+            source = m_passthrough_image;
+            target_orient = m_passthrough_orient;
+        }
+        if (source == nullptr) {
+            return std::nullopt;
+        }
+
+        const auto source_format = source->get_format();
+        const auto width = source_format.width;
+        const auto height = source_format.height;
+        // the rotation from the orientation of the input to the requested one and the mirroring the
+        // input requires, as the effect player applies it to a rendered frame
+        const auto degrees = (orientation_degrees(source_format.orientation) + 360
+                              - orientation_degrees(target_orient.orientation)) % 360;
+        // is_y_flip is the default of process_image_async and gives the rows top down, without it a
+        // rendered frame keeps the bottom up rows of OpenGL: the vertical flip after the rotation is
+        // the rotation by 180 degrees the other way with the other mirroring
+        const auto transform = target_orient.is_y_flip
+                                   ? image_transform{degrees, source_format.require_mirroring}
+                                   : image_transform{(540 - degrees) % 360, !source_format.require_mirroring};
+        const bool identity = transform.degrees == 0 && !transform.mirror;
+
+        auto image_format = bnb::image_format();
+        image_format.width = transform.degrees % 180 == 0 ? width : height;
+        image_format.height = transform.degrees % 180 == 0 ? height : width;
+        image_format.orientation = camera_orientation::deg_0;
+        image_format.require_mirroring = false;
+        const auto chroma_width = chroma_size(width);
+        const auto chroma_height = chroma_size(height);
+        // the (de)interleaving goes straight into the planes of the pool, a rotation is done first on the source layout
+        const auto chroma_samples = size_t(chroma_width) * chroma_height;
+
+        // RGBA of the input size, from which the other formats are converted
+        std::vector<uint8_t> rgba_storage;
+        const uint8_t* rgba = nullptr;
+
+        if (source->has_data<yuv_image_t>()) {
+            auto& yuv = source->get_data<yuv_image_t>();
+            auto yuv_format = yuv.get_yuv_format();
+            bool nv12 = yuv_format.format == yuv_format::yuv_nv12;
+
+            if (format == output_image_format::rgba) {
+                rgba_storage.resize(size_t(width) * height * 4);
+                rgba = rgba_storage.data();
+                yuv_to_rgba(
+                    // clang-format off
+                    yuv.get_y_plane(), int32_t(width),
+                    nv12 ? yuv.get_uv_plane() : yuv.get_u_plane(),
+                    nv12 ? yuv.get_uv_plane() + 1 : yuv.get_v_plane(),
+                    int32_t(nv12 ? chroma_width * 2 : chroma_width), nv12 ? 2 : 1,
+                    width, height, yuv_format,
+                    rgba_storage.data(), int32_t(width * 4)
+                    // clang-format on
+                );
+            } else {
+                auto y_plane = identity
+                    ? alias_plane(yuv.get_y_plane(), source)
+                    : rotated_plane(pool, yuv.get_y_plane(), width, height, 1, transform);
+
+                if (format == output_image_format::nv12) {
+                    color_plane uv_plane;
+                    if (nv12) {
+                        uv_plane = identity
+                            ? alias_plane(yuv.get_uv_plane(), source)
+                            : rotated_plane(pool, yuv.get_uv_plane(), chroma_width, chroma_height, 2, transform);
+                    } else if (identity) {
+                        uv_plane = interleaved_plane(pool, yuv.get_u_plane(), yuv.get_v_plane(), chroma_samples);
+                    } else {
+                        auto u = rotated_plane(pool, yuv.get_u_plane(), chroma_width, chroma_height, 1, transform);
+                        auto v = rotated_plane(pool, yuv.get_v_plane(), chroma_width, chroma_height, 1, transform);
+                        uv_plane = interleaved_plane(pool, u.get(), v.get(), chroma_samples);
+                    }
+                    yuv_format.format = yuv_format::yuv_nv12;
+                    return full_image_t(yuv_image_t(y_plane, uv_plane, image_format, yuv_format));
+                }
+
+                color_plane u_plane;
+                color_plane v_plane;
+                if (nv12 && identity) {
+                    std::tie(u_plane, v_plane) = deinterleaved_planes(pool, yuv.get_uv_plane(), chroma_samples);
+                } else if (nv12) {
+                    auto uv = rotated_plane(pool, yuv.get_uv_plane(), chroma_width, chroma_height, 2, transform);
+                    std::tie(u_plane, v_plane) = deinterleaved_planes(pool, uv.get(), chroma_samples);
+                } else if (identity) {
+                    u_plane = alias_plane(yuv.get_u_plane(), source);
+                    v_plane = alias_plane(yuv.get_v_plane(), source);
+                } else {
+                    u_plane = rotated_plane(pool, yuv.get_u_plane(), chroma_width, chroma_height, 1, transform);
+                    v_plane = rotated_plane(pool, yuv.get_v_plane(), chroma_width, chroma_height, 1, transform);
+                }
+                yuv_format.format = yuv_format::yuv_i420;
+                return full_image_t(yuv_image_t(y_plane, u_plane, v_plane, image_format, yuv_format));
+            }
+        } else {
+            auto& bpc8 = source->get_data<bpc8_image_t>();
+            auto pixel_format = bpc8.get_pixel_format();
+            if (pixel_format == bpc8_image_t::pixel_format_t::rgba) {
+                rgba = bpc8.get_data();
+            } else {
+                auto bytes_per_pixel = bpc8_image_t::bytes_per_pixel(pixel_format);
+                auto [r, g, b] = bpc8_image_t::rgb_offsets(pixel_format);
+                rgba_storage.resize(size_t(width) * height * 4);
+                rgba = rgba_storage.data();
+                const uint8_t* src = bpc8.get_data();
+                for (size_t i = 0; i < size_t(width) * height; ++i, src += bytes_per_pixel) {
+                    rgba_storage[i * 4] = src[r];
+                    rgba_storage[i * 4 + 1] = src[g];
+                    rgba_storage[i * 4 + 2] = src[b];
+                    rgba_storage[i * 4 + 3] = 255;
+                }
+            }
+        }
+
+        color_plane rgba_plane;
+        if (!identity) {
+            rgba_plane = rotated_plane(pool, rgba, width, height, 4, transform);
+        } else if (rgba_storage.empty()) {
+            // the input is RGBA already
+            rgba_plane = alias_plane(const_cast<uint8_t*>(rgba), source);
+        } else {
+            auto holder = std::make_shared<std::vector<uint8_t>>(std::move(rgba_storage));
+            rgba_plane = color_plane(holder->data(), [holder](color_plane_data_t*) {});
+        }
+
+        const auto out_width = image_format.width;
+        const auto out_height = image_format.height;
+        switch (format) {
+            case output_image_format::rgba:
+                return full_image_t(bpc8_image_t(rgba_plane, bpc8_image_t::pixel_format_t::rgba, image_format));
+            case output_image_format::nv12: {
+                auto y_plane = pool.acquire(size_t(out_width) * out_height);
+                auto uv_plane = pool.acquire(size_t(chroma_size(out_width)) * chroma_size(out_height) * 2);
+                rgba_to_nv12(
+                    // clang-format off
+                    rgba_plane.get(), int32_t(out_width * 4),
+                    out_width, out_height,
+                    y_plane.get(), int32_t(out_width),
+                    uv_plane.get(), int32_t(chroma_size(out_width) * 2)
+                    // clang-format on
+                );
+                yuv_format_t yuv_format{color_range::full, color_std::bt601, yuv_format::yuv_nv12};
+                return full_image_t(yuv_image_t(y_plane, uv_plane, image_format, yuv_format));
+            }
+            case output_image_format::i420: {
+                auto y_plane = pool.acquire(size_t(out_width) * out_height);
+                auto u_plane = pool.acquire(size_t(chroma_size(out_width)) * chroma_size(out_height));
+                auto v_plane = pool.acquire(size_t(chroma_size(out_width)) * chroma_size(out_height));
+                rgba_to_i420(
+                    // clang-format off
+                    rgba_plane.get(), int32_t(out_width * 4),
+                    out_width, out_height,
+                    y_plane.get(), int32_t(out_width),
+                    u_plane.get(), int32_t(chroma_size(out_width)),
+                    v_plane.get(), int32_t(chroma_size(out_width))
+                    // clang-format on
+                );
+                yuv_format_t yuv_format{color_range::full, color_std::bt601, yuv_format::yuv_i420};
+                return full_image_t(yuv_image_t(y_plane, u_plane, v_plane, image_format, yuv_format));
+            }
         }
+        return std::nullopt;
     }
 } // bnb
@@ -0,0 +1,56 @@
+#include "quality_controller.hpp"
+
+#include <algorithm>
+
+namespace bnb
+{
+    quality_controller::quality_controller(interfaces::adaptive_quality_config config)
+        : m_config(std::move(config))
+    {
+        if (m_config.levels.empty()) {
+            m_config.levels.push_back({1, 1.0f});
+        }
+        for (auto& level : m_config.levels) {
+            level.max_faces = std::max(level.max_faces, 1);
+            level.render_scale = std::clamp(level.render_scale, 0.1f, 1.0f);
+        }
+        m_config.window_frames = std::max(m_config.window_frames, 1u);
+        m_config.step_up_windows = std::max(m_config.step_up_windows, 1u);
+        m_budget_ms = 1000.0 / std::max(m_config.target_fps, 1.0f);
+    }
+
+    std::optional<interfaces::quality_event> quality_controller::on_frame(uint64_t frame_id, double render_ms)
+    {
+        m_window_sum_ms += render_ms;
+        if (++m_window_frames < m_config.window_frames) {
+            return std::nullopt;
+        }
+
+        auto average_ms = m_window_sum_ms / m_window_frames;
+        m_window_sum_ms = 0;
+        m_window_frames = 0;
+
+        auto last_level = static_cast<uint32_t>(m_config.levels.size() - 1);
+        if (average_ms > m_budget_ms * m_config.step_down_threshold) {
+            m_headroom_windows = 0;
+            if (m_level < last_level) {
+                return change_level(frame_id, m_level + 1, average_ms);
+            }
+        } else if (average_ms < m_budget_ms * m_config.step_up_threshold) {
+            if (m_level > 0 && ++m_headroom_windows >= m_config.step_up_windows) {
+                return change_level(frame_id, m_level - 1, average_ms);
+            }
+        } else {
+            m_headroom_windows = 0;
+        }
+        return std::nullopt;
+    }
+
+    interfaces::quality_event quality_controller::change_level(uint64_t frame_id, uint32_t level, double average_ms)
+    {
+        interfaces::quality_event event{frame_id, m_level, level, m_config.levels[level], average_ms, m_budget_ms};
+        m_level = level;
+        m_headroom_windows = 0;
+        return event;
+    }
+} // bnb
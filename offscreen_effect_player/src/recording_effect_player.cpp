@@ -0,0 +1,167 @@
+#include "recording_effect_player.hpp"
+
+#include "logger.hpp"
+
+namespace bnb
+{
+    ioep_sptr recording_effect_player::create(ioep_sptr target, const std::string& path, session_compression compression)
+    {
+        auto writer = session_writer::create(path, compression);
+        if (writer == nullptr) {
+            return nullptr;
+        }
+        // we use "new" instead of "make_shared" because the constructor is private
+        return ioep_sptr(new recording_effect_player(std::move(target), std::move(writer)));
+    }
+
+    recording_effect_player::recording_effect_player(ioep_sptr target, std::unique_ptr<session_writer> writer)
+        : m_target(std::move(target))
+        , m_writer(std::move(writer)) {}
+
+    void recording_effect_player::process_image_async(std::shared_ptr<full_image_t> image, interfaces::frame_result_cb callback,
+                                                      std::optional<interfaces::orient_format> target_orient,
+                                                      interfaces::frame_timing timing)
+    {
+        // before the call, the player moves the image out when it renders it
+        m_writer->write_frame(*image, target_orient, timing);
+        m_target->process_image_async(std::move(image), std::move(callback), target_orient, timing);
+    }
+
+    void recording_effect_player::set_processing_mode(interfaces::processing_mode mode, uint32_t max_frames_in_flight)
+    {
+        session_event event;
+        event.type = session_event_type::processing_mode;
+        event.mode = mode;
+        event.max_frames_in_flight = max_frames_in_flight;
+        m_writer->write(event);
+        m_target->set_processing_mode(mode, max_frames_in_flight);
+    }
+
+    void recording_effect_player::surface_changed(int32_t width, int32_t height)
+    {
+        session_event event;
+        event.type = session_event_type::surface_changed;
+        event.width = width;
+        event.height = height;
+        m_writer->write(event);
+        m_target->surface_changed(width, height);
+    }
+
+    void recording_effect_player::load_effect(const std::string& effect_path, interfaces::effect_loaded_cb callback)
+    {
+        session_event event;
+        event.type = session_event_type::load_effect;
+        event.text = effect_path;
+        m_writer->write(event);
+        m_target->load_effect(effect_path, std::move(callback));
+    }
+
+    void recording_effect_player::unload_effect()
+    {
+        session_event event;
+        event.type = session_event_type::load_effect;
+        m_writer->write(event);
+        m_target->unload_effect();
+    }
+
+    std::shared_future<interfaces::prefetch_stats> recording_effect_player::prefetch_effect(const std::string& effect_path)
+    {
+        // not recorded, it doesn't change the output
+        return m_target->prefetch_effect(effect_path);
+    }
+
+    void recording_effect_player::call_js_method(const std::string& method, const std::string& param)
+    {
+        session_event event;
+        event.type = session_event_type::call_js_method;
+        event.text = method;
+        event.param = param;
+        m_writer->write(event);
+        m_target->call_js_method(method, param);
+    }
+
+    interfaces::gpu_stats recording_effect_player::get_gpu_stats()
+    {
+        return m_target->get_gpu_stats();
+    }
+
+    void recording_effect_player::enable_tracing(bool enable)
+    {
+        m_target->enable_tracing(enable);
+    }
+
+    bool recording_effect_player::dump_trace(const std::string& path)
+    {
+        return m_target->dump_trace(path);
+    }
+
+    interfaces::metrics_snapshot recording_effect_player::get_metrics()
+    {
+        return m_target->get_metrics();
+    }
+
+    bool recording_effect_player::write_metrics(const std::string& path)
+    {
+        return m_target->write_metrics(path);
+    }
+
+    bool recording_effect_player::serve_metrics(const std::string& socket_path)
+    {
+        return m_target->serve_metrics(socket_path);
+    }
+
+    void recording_effect_player::set_render_scale(float scale, interfaces::upscale_filter filter)
+    {
+        session_event event;
+        event.type = session_event_type::render_scale;
+        event.scale = scale;
+        event.filter = filter;
+        m_writer->write(event);
+        m_target->set_render_scale(scale, filter);
+    }
+
+    void recording_effect_player::enable_adaptive_quality(std::optional<interfaces::adaptive_quality_config> config,
+                                                          interfaces::quality_event_cb on_change)
+    {
+        m_target->enable_adaptive_quality(std::move(config), std::move(on_change));
+    }
+
+    void recording_effect_player::enable_frame_pacing(std::optional<interfaces::frame_pacing_config> config,
+                                                      interfaces::paced_frame_cb on_frame)
+    {
+        m_target->enable_frame_pacing(std::move(config), std::move(on_frame));
+    }
+
+    uint32_t recording_effect_player::add_grid_stream(const std::string& effect_path)
+    {
+        WRITE_LOG_MESSAGE(warning, "The grid mode is not recorded, the session will not replay the composites");
+        return m_target->add_grid_stream(effect_path);
+    }
+
+    void recording_effect_player::remove_grid_stream(uint32_t stream)
+    {
+        m_target->remove_grid_stream(stream);
+    }
+
+    void recording_effect_player::load_grid_effect(uint32_t stream, const std::string& effect_path,
+                                                   interfaces::effect_loaded_cb callback)
+    {
+        m_target->load_grid_effect(stream, effect_path, std::move(callback));
+    }
+
+    void recording_effect_player::push_grid_frame(uint32_t stream, std::shared_ptr<full_image_t> image,
+                                                  std::optional<interfaces::orient_format> target_orient)
+    {
+        m_target->push_grid_frame(stream, std::move(image), target_orient);
+    }
+
+    void recording_effect_player::composite_grid_async(interfaces::frame_result_cb callback, interfaces::frame_timing timing)
+    {
+        m_target->composite_grid_async(std::move(callback), timing);
+    }
+
+    interfaces::startup_timings recording_effect_player::get_startup_timings()
+    {
+        return m_target->get_startup_timings();
+    }
+} // bnb
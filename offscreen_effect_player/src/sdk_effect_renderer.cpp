@@ -0,0 +1,71 @@
+#include "sdk_effect_renderer.hpp"
+
+#include "logger.hpp"
+
+namespace bnb
+{
+    sdk_effect_renderer::sdk_effect_renderer(const interfaces::effect_player_configuration& config)
+        : m_ep(interfaces::effect_player::create(config)) {}
+
+    void sdk_effect_renderer::surface_created(int32_t width, int32_t height)
+    {
+        m_ep->surface_created(width, height);
+    }
+
+    void sdk_effect_renderer::surface_changed(int32_t width, int32_t height)
+    {
+        m_ep->surface_changed(width, height);
+        if (auto e_manager = m_ep->effect_manager()) {
+            e_manager->set_effect_size(width, height);
+        }
+    }
+
+    void sdk_effect_renderer::surface_destroyed()
+    {
+        m_ep->surface_destroyed();
+    }
+
+    void sdk_effect_renderer::push_frame(full_image_t image)
+    {
+        m_ep->push_frame(std::move(image));
+    }
+
+    int64_t sdk_effect_renderer::draw()
+    {
+        return m_ep->draw();
+    }
+
+    void sdk_effect_renderer::set_max_faces(int32_t max_faces)
+    {
+        m_ep->set_max_faces(max_faces);
+    }
+
+    bool sdk_effect_renderer::load_effect(const std::string& effect_path)
+    {
+        if (auto e_manager = m_ep->effect_manager()) {
+            e_manager->load(effect_path);
+            m_has_effect = !effect_path.empty();
+            return true;
+        }
+        WRITE_LOG_MESSAGE(error, "effect manager not initialized");
+        return false;
+    }
+
+    bool sdk_effect_renderer::has_effect() const
+    {
+        return m_has_effect;
+    }
+
+    void sdk_effect_renderer::call_js_method(const std::string& method, const std::string& param)
+    {
+        if (auto e_manager = m_ep->effect_manager()) {
+            if (auto effect = e_manager->current()) {
+                effect->call_js_method(method, param);
+            } else {
+                WRITE_LOG_MESSAGE(error, "effect not loaded");
+            }
+        } else {
+            WRITE_LOG_MESSAGE(error, "effect manager not initialized");
+        }
+    }
+} // bnb
@@ -0,0 +1,526 @@
+#include "session_file.hpp"
+#include "logger.hpp"
+#include "rotation.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifdef __APPLE__
+    #include <compression.h>
+    #define BNB_SESSION_LZ4 1
+#else
+    #define BNB_SESSION_LZ4 0
+#endif
+
+namespace
+{
+    constexpr char file_magic[8] = {'O', 'E', 'P', 'S', 'E', 'S', 'S', '1'};
+    constexpr uint32_t file_version = 1;
+    constexpr size_t file_header_size = 16;
+    constexpr size_t record_header_size = 16;
+    // the mapping grows by this step at least
+    constexpr size_t min_growth = 64 * 1024 * 1024;
+
+    enum class image_kind : uint32_t
+    {
+        bpc8,
+        nv12,
+        i420
+    };
+
+    struct frame_record
+    {
+        uint32_t width;
+        uint32_t height;
+        uint32_t orientation;
+        uint32_t require_mirroring;
+        int32_t face_orientation;
+        uint32_t has_target_orient;
+        uint32_t target_orientation;
+        uint32_t target_y_flip;
+        image_kind kind;
+        uint32_t pixel_format;
+        uint32_t color_range;
+        uint32_t color_std;
+        uint32_t plane_count;
+        uint32_t plane_size[3];
+        uint32_t stored_size[3];
+        uint32_t plane_compression[3];
+        int64_t capture_timestamp_us;
+    };
+
+    size_t align8(size_t size)
+    {
+        return (size + 7) & ~size_t(7);
+    }
+
+    template<typename T>
+    T read_value(const uint8_t*& ptr)
+    {
+        T value;
+        std::memcpy(&value, ptr, sizeof(T));
+        ptr += sizeof(T);
+        return value;
+    }
+} // anonymous namespace
+
+namespace bnb
+{
+    /* session_writer */
+
+    std::unique_ptr<session_writer> session_writer::create(const std::string& path, session_compression compression)
+    {
+        int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0) {
+            WRITE_LOG_MESSAGE(error, "Failed to create the session file " << path);
+            return nullptr;
+        }
+        if (compression == session_compression::lz4 && !BNB_SESSION_LZ4) {
+            WRITE_LOG_MESSAGE(warning, "LZ4 is not available on this platform, the session is stored uncompressed");
+            compression = session_compression::none;
+        }
+
+        // we use "new" instead of "make_unique" because the constructor is private
+        std::unique_ptr<session_writer> writer(new session_writer(fd, compression));
+        std::lock_guard<std::mutex> lock(writer->m_mutex);
+        auto header = writer->reserve(file_header_size);
+        if (header == nullptr) {
+            return nullptr;
+        }
+        std::memset(header, 0, file_header_size);
+        std::memcpy(header, file_magic, sizeof(file_magic));
+        std::memcpy(header + sizeof(file_magic), &file_version, sizeof(file_version));
+        writer->m_size = file_header_size;
+        return writer;
+    }
+
+    session_writer::session_writer(int fd, session_compression compression)
+        : m_fd(fd)
+        , m_compression(compression)
+        , m_start(std::chrono::steady_clock::now())
+    {
+#if BNB_SESSION_LZ4
+        if (m_compression == session_compression::lz4) {
+            m_scratch.resize(compression_encode_scratch_buffer_size(COMPRESSION_LZ4));
+        }
+#endif
+    }
+
+    session_writer::~session_writer()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_map != nullptr) {
+            munmap(m_map, m_capacity);
+        }
+        // cut the preallocated tail
+        if (ftruncate(m_fd, static_cast<off_t>(m_size)) != 0) {
+            WRITE_LOG_MESSAGE(error, "Failed to truncate the session file");
+        }
+        ::close(m_fd);
+    }
+
+    uint64_t session_writer::size() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_size;
+    }
+
+    int64_t session_writer::now_us() const
+    {
+        return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - m_start).count();
+    }
+
+    uint8_t* session_writer::reserve(size_t size)
+    {
+        if (m_size + size > m_capacity) {
+            auto capacity = std::max(m_capacity * 2, m_size + size + min_growth);
+            if (m_map != nullptr) {
+                munmap(m_map, m_capacity);
+                m_map = nullptr;
+            }
+            if (ftruncate(m_fd, static_cast<off_t>(capacity)) != 0) {
+                WRITE_LOG_MESSAGE(error, "Failed to grow the session file");
+                m_capacity = 0;
+                return nullptr;
+            }
+            auto map = mmap(nullptr, capacity, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0);
+            if (map == MAP_FAILED) {
+                WRITE_LOG_MESSAGE(error, "Failed to map the session file");
+                m_capacity = 0;
+                return nullptr;
+            }
+            m_map = static_cast<uint8_t*>(map);
+            m_capacity = capacity;
+        }
+        return m_map + m_size;
+    }
+
+    void session_writer::write_header(size_t offset, session_event_type type, uint32_t payload_size, int64_t timestamp_us)
+    {
+        auto ptr = m_map + offset;
+        std::memcpy(ptr, &type, sizeof(type));
+        std::memcpy(ptr + 4, &payload_size, sizeof(payload_size));
+        std::memcpy(ptr + 8, &timestamp_us, sizeof(timestamp_us));
+    }
+
+    void session_writer::write_plane(const uint8_t* data, uint32_t size, uint32_t& stored_size, uint32_t& plane_compression)
+    {
+        auto dst = m_map + m_size;
+#if BNB_SESSION_LZ4
+        if (m_compression == session_compression::lz4) {
+            // 0 when the compressed plane would be larger than the raw one
+            auto compressed = compression_encode_buffer(dst, size, data, size, m_scratch.data(), COMPRESSION_LZ4);
+            if (compressed > 0) {
+                stored_size = static_cast<uint32_t>(compressed);
+                plane_compression = static_cast<uint32_t>(session_compression::lz4);
+                m_size += compressed;
+                return;
+            }
+        }
+#endif
+        std::memcpy(dst, data, size);
+        stored_size = size;
+        plane_compression = static_cast<uint32_t>(session_compression::none);
+        m_size += size;
+    }
+
+    void session_writer::write_frame(const full_image_t& image, std::optional<interfaces::orient_format> target_orient,
+                                     interfaces::frame_timing timing)
+    {
+        auto format = image.get_format();
+
+        frame_record record{};
+        record.width = format.width;
+        record.height = format.height;
+        record.orientation = static_cast<uint32_t>(format.orientation);
+        record.require_mirroring = format.require_mirroring;
+        record.face_orientation = format.face_orientation;
+        record.has_target_orient = target_orient.has_value();
+        if (target_orient.has_value()) {
+            record.target_orientation = static_cast<uint32_t>(target_orient->orientation);
+            record.target_y_flip = target_orient->is_y_flip;
+        }
+        record.capture_timestamp_us = timing.capture_timestamp_us;
+
+        const uint8_t* planes[3] = {};
+        const auto pixels = size_t(format.width) * format.height;
+        const auto chroma = size_t(chroma_size(format.width)) * chroma_size(format.height);
+        if (image.has_data<bpc8_image_t>()) {
+            auto& bpc8 = image.get_data<bpc8_image_t>();
+            record.kind = image_kind::bpc8;
+            record.pixel_format = static_cast<uint32_t>(bpc8.get_pixel_format());
+            record.plane_count = 1;
+            planes[0] = bpc8.get_data();
+            record.plane_size[0] = static_cast<uint32_t>(pixels * bpc8_image_t::bytes_per_pixel(bpc8.get_pixel_format()));
+        } else {
+            auto& yuv = image.get_data<yuv_image_t>();
+            auto yuv_format = yuv.get_yuv_format();
+            record.color_range = static_cast<uint32_t>(yuv_format.range);
+            record.color_std = static_cast<uint32_t>(yuv_format.standard);
+            planes[0] = yuv.get_y_plane();
+            record.plane_size[0] = static_cast<uint32_t>(pixels);
+            if (yuv_format.format == yuv_format::yuv_i420) {
+                record.kind = image_kind::i420;
+                record.plane_count = 3;
+                planes[1] = yuv.get_u_plane();
+                planes[2] = yuv.get_v_plane();
+                record.plane_size[1] = record.plane_size[2] = static_cast<uint32_t>(chroma);
+            } else {
+                record.kind = image_kind::nv12;
+                record.plane_count = 2;
+                planes[1] = yuv.get_uv_plane();
+                record.plane_size[1] = static_cast<uint32_t>(chroma * 2);
+            }
+        }
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        // the planes are stored raw if they don't compress, so this is the upper bound
+        size_t max_size = record_header_size + sizeof(record) + 8;
+        for (uint32_t i = 0; i < record.plane_count; ++i) {
+            max_size += record.plane_size[i];
+        }
+        if (reserve(max_size) == nullptr) {
+            return;
+        }
+
+        auto record_start = m_size;
+        m_size += record_header_size + sizeof(record);
+        for (uint32_t i = 0; i < record.plane_count; ++i) {
+            write_plane(planes[i], record.plane_size[i], record.stored_size[i], record.plane_compression[i]);
+        }
+        auto payload_size = static_cast<uint32_t>(m_size - record_start - record_header_size);
+        std::memcpy(m_map + record_start + record_header_size, &record, sizeof(record));
+        write_header(record_start, session_event_type::frame, payload_size, now_us());
+        m_size = align8(m_size);
+    }
+
+    void session_writer::write_string(const std::string& value)
+    {
+        auto length = static_cast<uint32_t>(value.size());
+        std::memcpy(m_map + m_size, &length, sizeof(length));
+        std::memcpy(m_map + m_size + sizeof(length), value.data(), value.size());
+        m_size += sizeof(length) + value.size();
+    }
+
+    void session_writer::write(const session_event& control_event)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto payload_size = 2 * sizeof(uint32_t) + control_event.text.size() + control_event.param.size() + 4 * sizeof(uint32_t);
+        if (reserve(record_header_size + payload_size + 8) == nullptr) {
+            return;
+        }
+
+        auto record_start = m_size;
+        m_size += record_header_size;
+        uint32_t values[4] = {};
+        switch (control_event.type) {
+            case session_event_type::surface_changed:
+                values[0] = static_cast<uint32_t>(control_event.width);
+                values[1] = static_cast<uint32_t>(control_event.height);
+                break;
+            case session_event_type::processing_mode:
+                values[0] = static_cast<uint32_t>(control_event.mode);
+                values[1] = control_event.max_frames_in_flight;
+                break;
+            case session_event_type::render_scale:
+                std::memcpy(&values[0], &control_event.scale, sizeof(float));
+                values[1] = static_cast<uint32_t>(control_event.filter);
+                break;
+            default:
+                break;
+        }
+        std::memcpy(m_map + m_size, values, sizeof(values));
+        m_size += sizeof(values);
+        write_string(control_event.text);
+        write_string(control_event.param);
+
+        auto written = static_cast<uint32_t>(m_size - record_start - record_header_size);
+        write_header(record_start, control_event.type, written, now_us());
+        m_size = align8(m_size);
+    }
+
+    /* session_reader */
+
+    struct session_reader::mapping
+    {
+        uint8_t* data{nullptr};
+        size_t size{0};
+
+        ~mapping()
+        {
+            if (data != nullptr) {
+                munmap(data, size);
+            }
+        }
+    };
+
+    std::unique_ptr<session_reader> session_reader::open(const std::string& path)
+    {
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            WRITE_LOG_MESSAGE(error, "Failed to open the session file " << path);
+            return nullptr;
+        }
+        struct stat info;
+        if (fstat(fd, &info) != 0 || size_t(info.st_size) < file_header_size) {
+            WRITE_LOG_MESSAGE(error, "The session file " << path << " is empty");
+            ::close(fd);
+            return nullptr;
+        }
+
+        auto file = std::make_shared<mapping>();
+        file->size = static_cast<size_t>(info.st_size);
+        // private writable pages: the planes handed out may be modified in place, the file is not
+        auto map = mmap(nullptr, file->size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (map == MAP_FAILED) {
+            WRITE_LOG_MESSAGE(error, "Failed to map the session file " << path);
+            return nullptr;
+        }
+        file->data = static_cast<uint8_t*>(map);
+
+        uint32_t version = 0;
+        std::memcpy(&version, file->data + sizeof(file_magic), sizeof(version));
+        if (std::memcmp(file->data, file_magic, sizeof(file_magic)) != 0 || version != file_version) {
+            WRITE_LOG_MESSAGE(error, "The file " << path << " is not a session of a supported version");
+            return nullptr;
+        }
+
+        // we use "new" instead of "make_unique" because the constructor is private
+        return std::unique_ptr<session_reader>(new session_reader(std::move(file)));
+    }
+
+    session_reader::session_reader(std::shared_ptr<mapping> file)
+        : m_file(std::move(file))
+        , m_offset(file_header_size) {}
+
+    void session_reader::rewind()
+    {
+        m_offset = file_header_size;
+    }
+
+    std::optional<image_format> session_reader::first_frame_format()
+    {
+        auto offset = m_offset;
+        rewind();
+        std::optional<image_format> result;
+        while (auto event = next()) {
+            if (event->type == session_event_type::frame) {
+                result = event->image->get_format();
+                break;
+            }
+        }
+        m_offset = offset;
+        return result;
+    }
+
+    std::optional<session_event> session_reader::next()
+    {
+        if (m_offset + record_header_size > m_file->size) {
+            return std::nullopt;
+        }
+        const uint8_t* ptr = m_file->data + m_offset;
+        auto type = read_value<session_event_type>(ptr);
+        auto payload_size = read_value<uint32_t>(ptr);
+        auto timestamp_us = read_value<int64_t>(ptr);
+        if (m_offset + record_header_size + payload_size > m_file->size) {
+            WRITE_LOG_MESSAGE(error, "The session file is truncated");
+            return std::nullopt;
+        }
+        m_offset = align8(m_offset + record_header_size + payload_size);
+
+        if (type == session_event_type::frame) {
+            auto event = read_frame(ptr, payload_size);
+            if (event.has_value()) {
+                event->timestamp_us = timestamp_us;
+            }
+            return event;
+        }
+
+        session_event event;
+        event.type = type;
+        event.timestamp_us = timestamp_us;
+        uint32_t values[4];
+        std::memcpy(values, ptr, sizeof(values));
+        ptr += sizeof(values);
+        auto end = ptr + payload_size - sizeof(values);
+        auto read_string = [&ptr, end](std::string& value) {
+            if (ptr + sizeof(uint32_t) > end) {
+                return false;
+            }
+            auto length = read_value<uint32_t>(ptr);
+            if (ptr + length > end) {
+                return false;
+            }
+            value.assign(reinterpret_cast<const char*>(ptr), length);
+            ptr += length;
+            return true;
+        };
+        if (!read_string(event.text) || !read_string(event.param)) {
+            WRITE_LOG_MESSAGE(error, "Broken control event in the session file");
+            return std::nullopt;
+        }
+
+        switch (type) {
+            case session_event_type::surface_changed:
+                event.width = static_cast<int32_t>(values[0]);
+                event.height = static_cast<int32_t>(values[1]);
+                break;
+            case session_event_type::processing_mode:
+                event.mode = static_cast<interfaces::processing_mode>(values[0]);
+                event.max_frames_in_flight = values[1];
+                break;
+            case session_event_type::render_scale:
+                std::memcpy(&event.scale, &values[0], sizeof(float));
+                event.filter = static_cast<interfaces::upscale_filter>(values[1]);
+                break;
+            default:
+                break;
+        }
+        return event;
+    }
+
+    std::optional<session_event> session_reader::read_frame(const uint8_t* payload, uint32_t size)
+    {
+        frame_record record;
+        if (size < sizeof(record)) {
+            WRITE_LOG_MESSAGE(error, "Broken frame in the session file");
+            return std::nullopt;
+        }
+        std::memcpy(&record, payload, sizeof(record));
+        if (record.plane_count < 1 || record.plane_count > 3) {
+            WRITE_LOG_MESSAGE(error, "Broken frame in the session file");
+            return std::nullopt;
+        }
+
+        color_plane planes[3];
+        auto data = payload + sizeof(record);
+        auto end = payload + size;
+        for (uint32_t i = 0; i < record.plane_count; ++i) {
+            if (data + record.stored_size[i] > end) {
+                WRITE_LOG_MESSAGE(error, "Broken frame in the session file");
+                return std::nullopt;
+            }
+            if (record.plane_compression[i] == static_cast<uint32_t>(session_compression::none)) {
+                // the plane keeps the mapping alive
+                auto file = m_file;
+                planes[i] = color_plane(const_cast<uint8_t*>(data), [file](color_plane_data_t*) {});
+            } else {
+#if BNB_SESSION_LZ4
+                auto plane = m_plane_pool->acquire(record.plane_size[i]);
+                auto decoded = compression_decode_buffer(plane.get(), record.plane_size[i], data, record.stored_size[i],
+                                                         nullptr, COMPRESSION_LZ4);
+                if (decoded != record.plane_size[i]) {
+                    WRITE_LOG_MESSAGE(error, "Failed to decompress a frame of the session file");
+                    return std::nullopt;
+                }
+                planes[i] = plane;
+#else
+                WRITE_LOG_MESSAGE(error, "The session is compressed with LZ4 which is not available on this platform");
+                return std::nullopt;
+#endif
+            }
+            data += record.stored_size[i];
+        }
+
+        image_format format;
+        format.width = record.width;
+        format.height = record.height;
+        format.orientation = static_cast<camera_orientation>(record.orientation);
+        format.require_mirroring = record.require_mirroring != 0;
+        format.face_orientation = record.face_orientation;
+
+        session_event event;
+        event.type = session_event_type::frame;
+        event.timing.capture_timestamp_us = record.capture_timestamp_us;
+        if (record.has_target_orient != 0) {
+            event.target_orient = interfaces::orient_format{static_cast<camera_orientation>(record.target_orientation),
+                                                            record.target_y_flip != 0};
+        }
+
+        yuv_format_t yuv_format{static_cast<color_range>(record.color_range), static_cast<color_std>(record.color_std),
+                                yuv_format::yuv_nv12};
+        switch (record.kind) {
+            case image_kind::bpc8:
+                event.image = std::make_shared<full_image_t>(
+                    bpc8_image_t(planes[0], static_cast<bpc8_image_t::pixel_format_t>(record.pixel_format), format));
+                break;
+            case image_kind::nv12:
+                event.image = std::make_shared<full_image_t>(yuv_image_t(planes[0], planes[1], format, yuv_format));
+                break;
+            case image_kind::i420:
+                yuv_format.format = yuv_format::yuv_i420;
+                event.image = std::make_shared<full_image_t>(yuv_image_t(planes[0], planes[1], planes[2], format, yuv_format));
+                break;
+            default:
+                WRITE_LOG_MESSAGE(error, "Unknown image kind in the session file");
+                return std::nullopt;
+        }
+        return event;
+    }
+} // bnb
@@ -4,10 +4,16 @@
 
 #include "interfaces/offscreen_render_target.hpp"
 
+#include "gpu_timer.hpp"
 #include "program.hpp"
+#include "rolling_histogram.hpp"
+#include "state_cache.hpp"
+#include "surface_allocator.hpp"
 
 #include <glad/glad.h>
 
+#include <mutex>
+
 namespace bnb
 {
     class ort_frame_surface_handler;
@@ -23,32 +29,87 @@ namespace bnb
 
         void surface_changed(int32_t width, int32_t height) override;
 
+        void set_render_scale(float scale, interfaces::upscale_filter filter) override;
+
         void activate_context() override;
+        void invalidate_gl_state() override;
         void prepare_rendering() override;
         void orient_image(interfaces::orient_format orient) override;
 
+        void begin_composite() override;
+        void prepare_tile_rendering() override;
+        void compose_tile(interfaces::orient_format orient, interfaces::grid_tile tile) override;
+
         bnb::data_t read_current_buffer() override;
 
         void* get_pixel_buffer() override;
+        void* make_pixel_buffer(const full_image_t& image) override;
+
+        void begin_gpu_stage(interfaces::gpu_stage stage) override;
+        void end_gpu_stage(interfaces::gpu_stage stage) override;
+        interfaces::gpu_stats get_gpu_stats() override;
+
+        /**
+         * Stats of the output surfaces pool. May be called from any thread.
+         */
+        surface_allocator_stats get_surface_stats();
+
+        /**
+         * Debug counters of GL calls issued and elided by the state cache during the last complete frame,
+         * the binds and the attachments apart.
+         * Must be called from the render thread.
+         */
+        gl::state_cache::counters_t get_last_frame_gl_counters() const;
 
     private:
         void create_context();
         void load_glad_functions();
 
-        void generate_texture(GLuint& texture);
+        void generate_texture(GLuint& texture, GLint filter);
         void prepare_post_processing_rendering();
+        // the bookkeeping of a new frame, common to prepare_rendering() and begin_composite()
+        void begin_frame();
+        // the orientation pass sampling the area of the render texture into the bound viewport
+        void draw_oriented(interfaces::orient_format orient, uint32_t source_width, uint32_t source_height, bool bicubic);
 
         void delete_textures();
+        void update_render_size();
 
+        void collect_gpu_stats();
+
+        // binds the framebuffer of the processed frame for a readback, false if there is no frame
+        bool bind_output_framebuffer();
+
+        // the output size
         uint32_t m_width;
         uint32_t m_height;
 
+        // the area of the render texture effect_player renders into, the texture has the output size
+        float m_render_scale{1.0f};
+        uint32_t m_render_width;
+        uint32_t m_render_height;
+        interfaces::upscale_filter m_upscale_filter{interfaces::upscale_filter::bicubic_sharp};
+
         GLuint m_framebuffer{ 0 };
         GLuint m_post_processing_framebuffer{ 0 };
         GLuint m_offscreen_render_texture{ 0 };
         GLuint m_offscreen_post_processuing_render_texture{ 0 };
+        // m_framebuffer if the orientation pass is skipped, m_post_processing_framebuffer otherwise;
+        // the readbacks bind it since the clients and effect_player change the binding between them
+        GLuint m_output_framebuffer{ 0 };
+
+        gl::state_cache m_state_cache;
 
         std::unique_ptr<program> m_program;
+        GLint m_uv_scale_location{-1};
+        GLint m_uv_max_location{-1};
+        GLint m_texture_size_location{-1};
+        GLint m_filter_location{-1};
         std::unique_ptr<ort_frame_surface_handler> m_frame_surface_handler;
+        std::unique_ptr<surface_allocator> m_surface_allocator;
+
+        std::unique_ptr<gl::gpu_timer> m_gpu_timer;
+        std::mutex m_gpu_stats_mutex;
+        std::array<rolling_histogram, static_cast<size_t>(interfaces::gpu_stage::count)> m_gpu_histograms;
     };
 } // bnb
@@ -0,0 +1,98 @@
+#pragma once
+
+#include "plane_pool.hpp"
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+namespace bnb
+{
+    enum class surface_format
+    {
+        bgra,
+        nv12
+    };
+
+    struct surface_allocator_stats
+    {
+        uint32_t outstanding{0};     // surfaces acquired and not yet given back with release()
+        uint32_t high_water_mark{0}; // max number of outstanding surfaces at once
+        uint64_t allocations{0};     // surfaces created by the pool
+        uint64_t acquisitions{0};    // surfaces handed out, including reused ones
+    };
+
+    /**
+     * Allocator of output surfaces for offscreen_render_target. Surfaces are recycled
+     * instead of being created for every frame, stats make leaks and churn visible:
+     * a growing outstanding count means consumers don't release surfaces.
+     */
+    class surface_allocator
+    {
+    public:
+        virtual ~surface_allocator() = default;
+
+        /**
+         * Get the surface of the requested size and format. The caller owns one reference.
+         *
+         * @param width width of the surface
+         * @param height height of the surface
+         * @param format pixel format of the surface
+         *
+         * @return platform surface (CVPixelBufferRef on Apple platforms, pointer to
+         *         tightly packed host memory elsewhere) or nullptr on failure
+         *
+         * Example acquire(1280, 720, surface_format::nv12)
+         */
+        virtual void* acquire(uint32_t width, uint32_t height, surface_format format) = 0;
+
+        /**
+         * Give the reference of the surface back, the surface is no longer outstanding.
+         * On Apple platforms a consumer the surface is handed over to may hold a reference
+         * of its own and drop it with CVPixelBufferRelease, the pool recycles the surface then.
+         *
+         * Example release(surface)
+         */
+        virtual void release(void* surface) = 0;
+
+        /**
+         * Drop all idle surfaces, e.g. after the surface size has changed.
+         *
+         * Example flush()
+         */
+        virtual void flush() = 0;
+
+        virtual surface_allocator_stats get_stats() = 0;
+    };
+
+    /**
+     * Size-keyed pool of host memory surfaces, available on every platform.
+     */
+    class host_surface_allocator : public surface_allocator
+    {
+    public:
+        host_surface_allocator();
+
+        void* acquire(uint32_t width, uint32_t height, surface_format format) override;
+        void release(void* surface) override;
+        void flush() override;
+        surface_allocator_stats get_stats() override;
+
+        static size_t surface_size(uint32_t width, uint32_t height, surface_format format);
+
+    private:
+        std::shared_ptr<plane_pool> m_pool;
+
+        std::mutex m_mutex;
+        std::unordered_map<void*, plane_pool::plane_sptr> m_outstanding;
+        uint32_t m_high_water_mark{0};
+        uint64_t m_acquisitions{0};
+    };
+
+    /**
+     * The fastest pooled allocator on the current platform:
+     * CVPixelBufferPool based one on Apple platforms, host_surface_allocator elsewhere.
+     */
+    std::unique_ptr<surface_allocator> make_pooled_surface_allocator();
+} // bnb
@@ -0,0 +1,159 @@
+#import <CoreVideo/CoreVideo.h>
+#import <Foundation/Foundation.h>
+#import <IOSurface/IOSurface.h>
+
+#include "surface_allocator.hpp"
+
+#include <atomic>
+#include <unordered_set>
+
+namespace bnb
+{
+    /**
+     * CVPixelBufferPool backed allocator. Buffers go back to the pool when the last
+     * reference is released, so a consumer the surface is handed over to may keep using
+     * CVPixelBufferRelease after the owner has released its reference with release().
+     */
+    class cv_surface_allocator : public surface_allocator
+    {
+    public:
+        ~cv_surface_allocator()
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            for (auto& pool : m_pools) {
+                destroy_pool(pool);
+            }
+        }
+
+        void* acquire(uint32_t width, uint32_t height, surface_format format) override
+        {
+            CVPixelBufferRef buffer = nullptr;
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                auto& pool = m_pools[static_cast<size_t>(format)];
+                if (pool.pool == nullptr || pool.width != width || pool.height != height) {
+                    // the buffers of the previous size keep their pool until they are released
+                    destroy_pool(pool);
+                    create_pool(pool, width, height, format);
+                    if (pool.pool == nullptr) {
+                        return nullptr;
+                    }
+                }
+
+                CVReturn err = CVPixelBufferPoolCreatePixelBuffer(kCFAllocatorDefault, pool.pool, &buffer);
+                if (err != kCVReturnSuccess || buffer == nullptr) {
+                    NSLog(@"Pixel buffer not created from the pool: %d", err);
+                    return nullptr;
+                }
+                if (auto surface = CVPixelBufferGetIOSurface(buffer)) {
+                    // the pool creates a surface only when all of its surfaces are in use
+                    if (pool.surfaces.insert(IOSurfaceGetID(surface)).second) {
+                        ++m_allocations;
+                    }
+                }
+            }
+
+            auto outstanding = ++m_outstanding;
+            auto high_water_mark = m_high_water_mark.load();
+            while (outstanding > high_water_mark && !m_high_water_mark.compare_exchange_weak(high_water_mark, outstanding)) {
+            }
+            ++m_acquisitions;
+            return buffer;
+        }
+
+        void release(void* surface) override
+        {
+            if (surface == nullptr) {
+                return;
+            }
+            --m_outstanding;
+            CVPixelBufferRelease(static_cast<CVPixelBufferRef>(surface));
+        }
+
+        void flush() override
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            for (auto& pool : m_pools) {
+                if (pool.pool != nullptr) {
+                    CVPixelBufferPoolFlush(pool.pool, kCVPixelBufferPoolFlushExcessBuffers);
+                }
+            }
+        }
+
+        surface_allocator_stats get_stats() override
+        {
+            surface_allocator_stats stats;
+            stats.outstanding = m_outstanding;
+            stats.high_water_mark = m_high_water_mark;
+            stats.allocations = m_allocations;
+            stats.acquisitions = m_acquisitions;
+            return stats;
+        }
+
+    private:
+        struct pool_t
+        {
+            CVPixelBufferPoolRef pool{nullptr};
+            uint32_t width{0};
+            uint32_t height{0};
+            // the surfaces the pool has created, to count the allocations
+            std::unordered_set<IOSurfaceID> surfaces;
+        };
+
+        static OSType pixel_format_type(surface_format format)
+        {
+            switch (format) {
+                case surface_format::bgra:
+                    // We get data from oep in RGBA, macos defined kCVPixelFormatType_32RGBA but not supported
+                    // and we have to choose a different type. This does not in any way affect further
+                    // processing, inside bytes still remain in the order of the RGBA.
+                    return kCVPixelFormatType_32BGRA;
+                case surface_format::nv12:
+                    return kCVPixelFormatType_420YpCbCr8BiPlanarVideoRange;
+            }
+            return kCVPixelFormatType_32BGRA;
+        }
+
+        static void create_pool(pool_t& pool, uint32_t width, uint32_t height, surface_format format)
+        {
+            NSDictionary* buffer_attributes = @{
+                (id) kCVPixelBufferPixelFormatTypeKey: @(pixel_format_type(format)),
+                (id) kCVPixelBufferWidthKey: @(width),
+                (id) kCVPixelBufferHeightKey: @(height),
+                (id) kCVPixelBufferIOSurfacePropertiesKey: @{},
+                (id) kCVPixelBufferOpenGLCompatibilityKey: @YES,
+            };
+
+            CVReturn err = CVPixelBufferPoolCreate(
+                kCFAllocatorDefault, nullptr, (__bridge CFDictionaryRef)(buffer_attributes), &pool.pool);
+            if (err != kCVReturnSuccess) {
+                NSLog(@"Pixel buffer pool not created: %d", err);
+                pool.pool = nullptr;
+                return;
+            }
+            pool.width = width;
+            pool.height = height;
+        }
+
+        static void destroy_pool(pool_t& pool)
+        {
+            if (pool.pool != nullptr) {
+                CVPixelBufferPoolRelease(pool.pool);
+            }
+            pool = pool_t{};
+        }
+
+        std::mutex m_mutex;
+        pool_t m_pools[2];
+
+        std::atomic<uint32_t> m_outstanding{0};
+        std::atomic<uint32_t> m_high_water_mark{0};
+        std::atomic<uint64_t> m_allocations{0};
+        std::atomic<uint64_t> m_acquisitions{0};
+    };
+
+    std::unique_ptr<surface_allocator> make_pooled_surface_allocator()
+    {
+        return std::make_unique<cv_surface_allocator>();
+    }
+} // bnb
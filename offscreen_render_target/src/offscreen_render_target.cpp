@@ -1,10 +1,14 @@
 #include "offscreen_render_target.hpp"
 
 #include "opengl.hpp"
+#include "logger.hpp"
 
 #include <bnb/effect_player/utility.hpp>
 #include <bnb/postprocess/interfaces/postprocess_helper.hpp>
 
+#include <algorithm>
+#include <cmath>
+
 namespace bnb
 {
     const char* vs_default_base =
@@ -12,20 +16,56 @@ namespace bnb
             " layout (location = 0) in vec3 aPos; \n"
             " layout (location = 1) in vec2 aTexCoord; \n"
             "out vec2 vTexCoord;\n"
+            "uniform vec2 uUvScale;\n"
             "void main()\n"
             "{\n"
                 " gl_Position = vec4(aPos, 1.0); \n"
-                " vTexCoord = aTexCoord; \n"
+                " vTexCoord = aTexCoord * uUvScale; \n"
             "}\n";
 
+    // uUvMax is the center of the last texel effect_player rendered, the texture is larger than
+    // the rendered area when the render scale is below 1 and nothing must be sampled beyond it
     const char* ps_default_base =
-            "precision mediump float;\n"
+            "precision highp float;\n"
             "in vec2 vTexCoord;\n"
             "out vec4 FragColor;\n"
             "uniform sampler2D uTexture;\n"
+            "uniform vec2 uUvMax;\n"
+            "uniform vec2 uTextureSize;\n"
+            "uniform int uFilter;\n"
+            "vec4 sample_clamped(vec2 uv)\n"
+            "{\n"
+                "return texture(uTexture, min(uv, uUvMax));\n"
+            "}\n"
+            // Catmull-Rom in 9 bilinear taps instead of 16 point ones
+            "vec4 catmull_rom(vec2 uv)\n"
+            "{\n"
+                "vec2 pos = uv * uTextureSize;\n"
+                "vec2 pos1 = floor(pos - 0.5) + 0.5;\n"
+                "vec2 f = pos - pos1;\n"
+                "vec2 w0 = f * (-0.5 + f * (1.0 - 0.5 * f));\n"
+                "vec2 w1 = 1.0 + f * f * (-2.5 + 1.5 * f);\n"
+                "vec2 w2 = f * (0.5 + f * (2.0 - 1.5 * f));\n"
+                "vec2 w3 = f * f * (-0.5 + 0.5 * f);\n"
+                "vec2 w12 = w1 + w2;\n"
+                "vec2 p0 = (pos1 - 1.0) / uTextureSize;\n"
+                "vec2 p12 = (pos1 + w2 / w12) / uTextureSize;\n"
+                "vec2 p3 = (pos1 + 2.0) / uTextureSize;\n"
+                "vec4 result = vec4(0.0);\n"
+                "result += sample_clamped(vec2(p0.x, p0.y)) * w0.x * w0.y;\n"
+                "result += sample_clamped(vec2(p12.x, p0.y)) * w12.x * w0.y;\n"
+                "result += sample_clamped(vec2(p3.x, p0.y)) * w3.x * w0.y;\n"
+                "result += sample_clamped(vec2(p0.x, p12.y)) * w0.x * w12.y;\n"
+                "result += sample_clamped(vec2(p12.x, p12.y)) * w12.x * w12.y;\n"
+                "result += sample_clamped(vec2(p3.x, p12.y)) * w3.x * w12.y;\n"
+                "result += sample_clamped(vec2(p0.x, p3.y)) * w0.x * w3.y;\n"
+                "result += sample_clamped(vec2(p12.x, p3.y)) * w12.x * w3.y;\n"
+                "result += sample_clamped(vec2(p3.x, p3.y)) * w3.x * w3.y;\n"
+                "return clamp(result, 0.0, 1.0);\n"
+            "}\n"
             "void main()\n"
             "{\n"
-                "FragColor = texture(uTexture, vTexCoord);\n"
+                "FragColor = uFilter == 1 ? catmull_rom(vTexCoord) : sample_clamped(vTexCoord);\n"
             "}\n";
 
     class ort_frame_surface_handler
@@ -51,8 +91,9 @@ namespace bnb
 
             glBindVertexArray(m_vao);
 
+            // All the orientation and flip variants are uploaded once, draw() selects one by the base vertex
             glBindBuffer(GL_ARRAY_BUFFER, m_vbo);
-            glBufferData(GL_ARRAY_BUFFER, sizeof(vertices[m_y_flip][m_orientation]), vertices[m_y_flip][m_orientation], GL_STATIC_DRAW);
+            glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
 
             // clang-format off
 
@@ -102,13 +143,6 @@ namespace bnb
         ort_frame_surface_handler& operator=(const ort_frame_surface_handler&) = delete;
         ort_frame_surface_handler& operator=(ort_frame_surface_handler&&) = delete;
 
-        void update_vertices_buffer()
-        {
-            glBindBuffer(GL_ARRAY_BUFFER, m_vbo);
-            glBufferData(GL_ARRAY_BUFFER, sizeof(vertices[m_y_flip][m_orientation]), vertices[m_y_flip][m_orientation], GL_STATIC_DRAW);
-            glBindBuffer(GL_ARRAY_BUFFER, 0);
-        }
-
         void set_orientation(bnb::camera_orientation orientation)
         {
             if (m_orientation != static_cast<uint32_t>(orientation)) {
@@ -123,11 +157,14 @@ namespace bnb
             }
         }
 
-        void draw()
+        void draw(gl::state_cache& state_cache)
         {
-            glBindVertexArray(m_vao);
-            glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, nullptr);
-            glBindVertexArray(0);
+            const auto vertices_per_variant = 4;
+            const auto base_vertex = static_cast<GLint>((m_y_flip * v_size + m_orientation) * vertices_per_variant);
+
+            state_cache.bind_vertex_array(m_vao);
+            glDrawElementsBaseVertex(GL_TRIANGLES, 6, GL_UNSIGNED_INT, nullptr, base_vertex);
+            state_cache.bind_vertex_array(0);
         }
 
     private:
@@ -206,33 +243,47 @@ extern void create_context_NS();
 extern void activate_context_NS();
 extern void destroy_context_NS();
 extern void* ns_GL_get_proc_address(const char *name);
-extern void* get_pixel_buffer_native(int width, int height);
+extern void* get_pixel_buffer_native(bnb::surface_allocator& allocator, int width, int height);
+extern void* make_pixel_buffer_native(bnb::surface_allocator& allocator, const bnb::full_image_t& image);
 
 namespace bnb
 {
     offscreen_render_target::offscreen_render_target(uint32_t width, uint32_t height)
         : m_width(width)
-        , m_height(height) {}
+        , m_height(height)
+        , m_render_width(width)
+        , m_render_height(height)
+        , m_surface_allocator(make_pooled_surface_allocator()) {}
 
     offscreen_render_target::~offscreen_render_target()
     {
+        auto surface_stats = m_surface_allocator->get_stats();
+        if (surface_stats.outstanding != 0) {
+            WRITE_LOG_MESSAGE(warning, surface_stats.outstanding << " output surfaces are not released");
+        }
+
         if (m_framebuffer != 0) {
+            m_state_cache.forget_framebuffer(m_framebuffer);
             GL_CALL(glDeleteFramebuffers(1, &m_framebuffer));
         }
         if (m_post_processing_framebuffer != 0) {
+            m_state_cache.forget_framebuffer(m_post_processing_framebuffer);
             GL_CALL(glDeleteFramebuffers(1, &m_post_processing_framebuffer));
         }
         delete_textures();
+        m_gpu_timer.reset();
         destroy_context_NS();
     }
 
     void offscreen_render_target::delete_textures()
     {
         if (m_offscreen_render_texture != 0) {
+            m_state_cache.forget_texture(m_offscreen_render_texture);
             GL_CALL(glDeleteTextures(1, &m_offscreen_render_texture));
             m_offscreen_render_texture = 0;
         }
         if (m_offscreen_post_processuing_render_texture != 0) {
+            m_state_cache.forget_texture(m_offscreen_post_processuing_render_texture);
             GL_CALL(glDeleteTextures(1, &m_offscreen_post_processuing_render_texture));
             m_offscreen_post_processuing_render_texture = 0;
         }
@@ -242,20 +293,44 @@ namespace bnb
     {
         create_context();
         activate_context();
+        // e.g. the debug callback goes to the context of the render thread
+        gl::context_info::instance().init_current_context();
 
         GL_CALL(glGenFramebuffers(1, &m_framebuffer));
         GL_CALL(glGenFramebuffers(1, &m_post_processing_framebuffer));
 
         m_program = std::make_unique<program>("OrientationChange", vs_default_base, ps_default_base);
+        m_uv_scale_location = glGetUniformLocation(m_program->handle(), "uUvScale");
+        m_uv_max_location = glGetUniformLocation(m_program->handle(), "uUvMax");
+        m_texture_size_location = glGetUniformLocation(m_program->handle(), "uTextureSize");
+        m_filter_location = glGetUniformLocation(m_program->handle(), "uFilter");
         m_frame_surface_handler = std::make_unique<ort_frame_surface_handler>(bnb::camera_orientation::deg_0, false);
+        m_gpu_timer = std::make_unique<gl::gpu_timer>(static_cast<uint32_t>(interfaces::gpu_stage::count));
     }
 
     void offscreen_render_target::surface_changed(int32_t width, int32_t height)
     {
         m_width = width;
         m_height = height;
+        update_render_size();
 
         delete_textures();
+        m_output_framebuffer = 0;
+        m_surface_allocator->flush();
+    }
+
+    void offscreen_render_target::set_render_scale(float scale, interfaces::upscale_filter filter)
+    {
+        // the render texture has the output size, only the area effect_player renders into changes
+        m_render_scale = std::clamp(scale, 0.1f, 1.0f);
+        m_upscale_filter = filter;
+        update_render_size();
+    }
+
+    void offscreen_render_target::update_render_size()
+    {
+        m_render_width = std::max(1u, static_cast<uint32_t>(std::lround(m_width * m_render_scale)));
+        m_render_height = std::max(1u, static_cast<uint32_t>(std::lround(m_height * m_render_scale)));
     }
 
     void offscreen_render_target::create_context()
@@ -272,6 +347,11 @@ namespace bnb
         activate_context_NS();
     }
 
+    void offscreen_render_target::invalidate_gl_state()
+    {
+        m_state_cache.invalidate_bindings();
+    }
+
     void offscreen_render_target::load_glad_functions()
     {
     #if BNB_OS_WINDOWS || BNB_OS_MACOS
@@ -285,95 +365,252 @@ namespace bnb
         }
     }
 
-    void offscreen_render_target::generate_texture(GLuint& texture)
+    void offscreen_render_target::generate_texture(GLuint& texture, GLint filter)
     {
         GL_CALL(glGenTextures(1, &texture));
-        GL_CALL(glBindTexture(GL_TEXTURE_2D, texture));
+        m_state_cache.bind_texture_2d(texture);
         GL_CALL(glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA,  m_width, m_height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL));
 
-        GL_CALL(glTexParameteri(GLenum(GL_TEXTURE_2D), GLenum(GL_TEXTURE_MIN_FILTER), GL_NEAREST));
-        GL_CALL(glTexParameteri(GLenum(GL_TEXTURE_2D), GLenum(GL_TEXTURE_MAG_FILTER), GL_NEAREST));
+        GL_CALL(glTexParameteri(GLenum(GL_TEXTURE_2D), GLenum(GL_TEXTURE_MIN_FILTER), filter));
+        GL_CALL(glTexParameteri(GLenum(GL_TEXTURE_2D), GLenum(GL_TEXTURE_MAG_FILTER), filter));
         GL_CALL(glTexParameterf(GLenum(GL_TEXTURE_2D), GLenum(GL_TEXTURE_WRAP_S), GLfloat(GL_CLAMP_TO_EDGE)));
         GL_CALL(glTexParameterf(GLenum(GL_TEXTURE_2D), GLenum(GL_TEXTURE_WRAP_T), GLfloat(GL_CLAMP_TO_EDGE)));
     }
 
+    void offscreen_render_target::begin_frame()
+    {
+        collect_gpu_stats();
+
+        m_state_cache.begin_frame();
+    }
+
     void offscreen_render_target::prepare_rendering()
     {
+        gl::context_info::instance().begin_frame();
+        BNB_GL_SCOPE("prepare_rendering");
+
+        begin_frame();
+
         if (m_offscreen_render_texture == 0) {
-            generate_texture(m_offscreen_render_texture);
+            // sampled by the orientation pass, the bilinear filter is the base of both upscale filters
+            generate_texture(m_offscreen_render_texture, GL_LINEAR);
         }
 
-        GL_CALL(glBindFramebuffer(GL_FRAMEBUFFER, m_framebuffer));
-        GL_CALL(glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, m_offscreen_render_texture, 0));
+        m_state_cache.attach_color_texture(m_framebuffer, m_offscreen_render_texture);
+        // until orient_image draws the orientation pass
+        m_output_framebuffer = m_framebuffer;
+    }
+
+    void offscreen_render_target::begin_composite()
+    {
+        gl::context_info::instance().begin_frame();
+        BNB_GL_SCOPE("begin_composite");
+
+        begin_frame();
 
-        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
-            GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
-            std::cout << "[ERROR] Failed to make complete framebuffer object " << status << std::endl;
+        if (m_offscreen_post_processuing_render_texture == 0) {
+            generate_texture(m_offscreen_post_processuing_render_texture, GL_NEAREST);
+        }
+        if (!m_state_cache.attach_color_texture(m_post_processing_framebuffer, m_offscreen_post_processuing_render_texture)) {
+            m_output_framebuffer = 0;
             return;
         }
+        m_output_framebuffer = m_post_processing_framebuffer;
+        m_state_cache.viewport(0, 0, GLsizei(m_width), GLsizei(m_height));
+        GL_CALL(glClearColor(0.0f, 0.0f, 0.0f, 1.0f));
+        GL_CALL(glClear(GL_COLOR_BUFFER_BIT));
+    }
+
+    void offscreen_render_target::prepare_tile_rendering()
+    {
+        BNB_GL_SCOPE("prepare_tile_rendering");
+
+        if (m_offscreen_render_texture == 0) {
+            generate_texture(m_offscreen_render_texture, GL_LINEAR);
+        }
+
+        m_state_cache.attach_color_texture(m_framebuffer, m_offscreen_render_texture);
+    }
+
+    void offscreen_render_target::compose_tile(interfaces::orient_format orient, interfaces::grid_tile tile)
+    {
+        if (m_program == nullptr || m_frame_surface_handler == nullptr) {
+            WRITE_LOG_MESSAGE(error, "Not initialization m_program");
+            return;
+        }
+        if (tile.width <= 0 || tile.height <= 0) {
+            return;
+        }
+
+        BNB_GL_SCOPE("compose_tile");
+
+        if (!m_state_cache.attach_color_texture(m_post_processing_framebuffer, m_offscreen_post_processuing_render_texture)) {
+            return;
+        }
+        m_state_cache.viewport(tile.x, tile.y, tile.width, tile.height);
+        GL_CALL(glActiveTexture(GLenum(GL_TEXTURE0)));
+        m_state_cache.bind_texture_2d(m_offscreen_render_texture);
+
+        // the tile is drawn 1:1, effect_player rendered it with the swapped size if it is rotated by 90 degrees
+        bool swapped = orient.orientation == camera_orientation::deg_90 || orient.orientation == camera_orientation::deg_270;
+        auto source_width = uint32_t(swapped ? tile.height : tile.width);
+        auto source_height = uint32_t(swapped ? tile.width : tile.height);
+        draw_oriented(orient, source_width, source_height, false);
     }
 
     void offscreen_render_target::prepare_post_processing_rendering()
     {
         if (m_offscreen_post_processuing_render_texture == 0) {
-            generate_texture(m_offscreen_post_processuing_render_texture);
+            generate_texture(m_offscreen_post_processuing_render_texture, GL_NEAREST);
         }
-        GL_CALL(glBindFramebuffer(GL_FRAMEBUFFER, m_post_processing_framebuffer));
-        GL_CALL(glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, m_offscreen_post_processuing_render_texture, 0));
 
-        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
-            GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
-            std::cout << "[ERROR] Failed to make complete post processing framebuffer object " << status << std::endl;
+        if (!m_state_cache.attach_color_texture(m_post_processing_framebuffer, m_offscreen_post_processuing_render_texture)) {
             return;
         }
 
-        GL_CALL(glViewport(0, 0, GLsizei(m_width), GLsizei(m_height)));
+        m_state_cache.viewport(0, 0, GLsizei(m_width), GLsizei(m_height));
 
         GL_CALL(glActiveTexture(GLenum(GL_TEXTURE0)));
-        GL_CALL(glBindTexture(GL_TEXTURE_2D, m_offscreen_render_texture));
+        m_state_cache.bind_texture_2d(m_offscreen_render_texture);
     }
 
     void offscreen_render_target::orient_image(interfaces::orient_format orient)
     {
         GL_CALL(glFlush());
 
-        if (orient.orientation == camera_orientation::deg_0 && !orient.is_y_flip) {
+        bool scaled = m_render_width != m_width || m_render_height != m_height;
+        if (orient.orientation == camera_orientation::deg_0 && !orient.is_y_flip && !scaled) {
             return;
         }
 
         if (m_program == nullptr) {
-            std::cout << "[ERROR] Not initialization m_program" << std::endl;
+            WRITE_LOG_MESSAGE(error, "Not initialization m_program");
             return;
         }
         if (m_frame_surface_handler == nullptr) {
-            std::cout << "[ERROR] Not initialization m_frame_surface_handler" << std::endl;
+            WRITE_LOG_MESSAGE(error, "Not initialization m_frame_surface_handler");
             return;
         }
 
+        BNB_GL_SCOPE("orient_image");
+
         prepare_post_processing_rendering();
-        m_program->use();
+        begin_gpu_stage(interfaces::gpu_stage::orientation);
+        bool bicubic = scaled && m_upscale_filter == interfaces::upscale_filter::bicubic_sharp;
+        draw_oriented(orient, m_render_width, m_render_height, bicubic);
+        end_gpu_stage(interfaces::gpu_stage::orientation);
+        m_output_framebuffer = m_post_processing_framebuffer;
+        glFlush();
+    }
+
+    void offscreen_render_target::draw_oriented(interfaces::orient_format orient, uint32_t source_width, uint32_t source_height, bool bicubic)
+    {
+        m_state_cache.use_program(m_program->handle());
+        auto width = static_cast<float>(m_width);
+        auto height = static_cast<float>(m_height);
+        GL_CALL(glUniform2f(m_uv_scale_location, source_width / width, source_height / height));
+        GL_CALL(glUniform2f(m_uv_max_location, (source_width - 0.5f) / width, (source_height - 0.5f) / height));
+        GL_CALL(glUniform2f(m_texture_size_location, width, height));
+        GL_CALL(glUniform1i(m_filter_location, bicubic ? 1 : 0));
         m_frame_surface_handler->set_orientation(orient.orientation);
         m_frame_surface_handler->set_y_flip(orient.is_y_flip);
-        // Call once for perf
-        m_frame_surface_handler->update_vertices_buffer();
-        m_frame_surface_handler->draw();
-        m_program->unuse();
-        glFlush();
+        m_frame_surface_handler->draw(m_state_cache);
+        m_state_cache.use_program(0);
+    }
+
+    bool offscreen_render_target::bind_output_framebuffer()
+    {
+        if (m_output_framebuffer == 0) {
+            WRITE_LOG_MESSAGE(error, "No processed frame to read");
+            return false;
+        }
+        m_state_cache.bind_framebuffer(m_output_framebuffer);
+        return true;
     }
 
     data_t offscreen_render_target::read_current_buffer()
     {
+        BNB_GL_SCOPE("read_current_buffer");
+
+        if (!bind_output_framebuffer()) {
+            return data_t{ nullptr, 0 };
+        }
+
         size_t size = m_width * m_height * 4;
         data_t data = data_t{ std::make_unique<uint8_t[]>(size), size };
 
+        begin_gpu_stage(interfaces::gpu_stage::readback);
         GL_CALL(glReadPixels(0, 0, m_width, m_height, GL_RGBA, GL_UNSIGNED_BYTE, data.data.get()));
-        GL_CALL(glBindFramebuffer(GL_FRAMEBUFFER, 0));
+        end_gpu_stage(interfaces::gpu_stage::readback);
+        m_state_cache.bind_framebuffer(0);
 
         return data;
     }
 
     void* offscreen_render_target::get_pixel_buffer()
     {
-        return get_pixel_buffer_native(m_width, m_height);
+        BNB_GL_SCOPE("get_pixel_buffer");
+        if (!bind_output_framebuffer()) {
+            return nullptr;
+        }
+        begin_gpu_stage(interfaces::gpu_stage::readback);
+        auto pixel_buffer = get_pixel_buffer_native(*m_surface_allocator, m_width, m_height);
+        end_gpu_stage(interfaces::gpu_stage::readback);
+        m_state_cache.bind_framebuffer(0);
+        return pixel_buffer;
+    }
+
+    void* offscreen_render_target::make_pixel_buffer(const full_image_t& image)
+    {
+        return make_pixel_buffer_native(*m_surface_allocator, image);
+    }
+
+    void offscreen_render_target::begin_gpu_stage(interfaces::gpu_stage stage)
+    {
+        if (m_gpu_timer != nullptr) {
+            m_gpu_timer->begin(static_cast<uint32_t>(stage));
+        }
+    }
+
+    void offscreen_render_target::end_gpu_stage(interfaces::gpu_stage stage)
+    {
+        if (m_gpu_timer != nullptr) {
+            m_gpu_timer->end(static_cast<uint32_t>(stage));
+        }
+    }
+
+    void offscreen_render_target::collect_gpu_stats()
+    {
+        if (m_gpu_timer == nullptr) {
+            return;
+        }
+
+        m_gpu_timer->collect([this](uint32_t stage, double milliseconds) {
+            std::lock_guard<std::mutex> lock(m_gpu_stats_mutex);
+            m_gpu_histograms[stage].add(milliseconds);
+        });
+    }
+
+    interfaces::gpu_stats offscreen_render_target::get_gpu_stats()
+    {
+        interfaces::gpu_stats stats;
+
+        std::lock_guard<std::mutex> lock(m_gpu_stats_mutex);
+        for (size_t i = 0; i < m_gpu_histograms.size(); ++i) {
+            auto histogram = m_gpu_histograms[i].snapshot();
+            stats.stages[i] = {histogram.total_samples, histogram.window_samples, histogram.min,
+                               histogram.mean, histogram.p50, histogram.p90, histogram.p99, histogram.max};
+        }
+        return stats;
+    }
+
+    gl::state_cache::counters_t offscreen_render_target::get_last_frame_gl_counters() const
+    {
+        return m_state_cache.last_frame_counters();
+    }
+
+    surface_allocator_stats offscreen_render_target::get_surface_stats()
+    {
+        return m_surface_allocator->get_stats();
     }
 } // bnb
@@ -0,0 +1,75 @@
+#include "surface_allocator.hpp"
+#include "logger.hpp"
+
+#include <algorithm>
+
+namespace bnb
+{
+    host_surface_allocator::host_surface_allocator()
+        : m_pool(plane_pool::create()) {}
+
+    size_t host_surface_allocator::surface_size(uint32_t width, uint32_t height, surface_format format)
+    {
+        switch (format) {
+            case surface_format::bgra:
+                return size_t(width) * height * 4;
+            case surface_format::nv12:
+                // the chroma of an odd last row or column is a sample of its own
+                return size_t(width) * height + size_t((width + 1) / 2) * 2 * ((height + 1) / 2);
+        }
+        return 0;
+    }
+
+    void* host_surface_allocator::acquire(uint32_t width, uint32_t height, surface_format format)
+    {
+        auto plane = m_pool->acquire(surface_size(width, height, format));
+        void* surface = plane.get();
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_outstanding.emplace(surface, std::move(plane));
+        m_high_water_mark = std::max(m_high_water_mark, static_cast<uint32_t>(m_outstanding.size()));
+        ++m_acquisitions;
+        return surface;
+    }
+
+    void host_surface_allocator::release(void* surface)
+    {
+        plane_pool::plane_sptr plane;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            auto it = m_outstanding.find(surface);
+            if (it == m_outstanding.end()) {
+                WRITE_LOG_MESSAGE(error, "Release of the surface not acquired from the allocator");
+                return;
+            }
+            plane = std::move(it->second);
+            m_outstanding.erase(it);
+        }
+        // the plane goes back to the pool outside of the lock
+    }
+
+    void host_surface_allocator::flush()
+    {
+        m_pool->clear();
+    }
+
+    surface_allocator_stats host_surface_allocator::get_stats()
+    {
+        auto pool_stats = m_pool->get_stats();
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        surface_allocator_stats stats;
+        stats.outstanding = static_cast<uint32_t>(m_outstanding.size());
+        stats.high_water_mark = m_high_water_mark;
+        stats.allocations = pool_stats.allocations;
+        stats.acquisitions = m_acquisitions;
+        return stats;
+    }
+
+#ifndef __APPLE__
+    std::unique_ptr<surface_allocator> make_pooled_surface_allocator()
+    {
+        return std::make_unique<host_surface_allocator>();
+    }
+#endif
+} // bnb
@@ -6,8 +6,13 @@
 #import <OpenGL/gl.h>
 #import <QuartzCore/QuartzCore.h>
 
+#include <algorithm>
 #include <functional>
 
+#include <bnb/types/full_image.hpp>
+
+#include "surface_allocator.hpp"
+
 void run_main_loop()
 {
     int argc = 0;
@@ -50,7 +55,7 @@ enum class vrange
     full_range
 };
 
-CVPixelBufferRef convert_rgba_to_nv12(CVPixelBufferRef inputPixelBuffer, vrange range)
+void convert_rgba_to_nv12(CVPixelBufferRef inputPixelBuffer, CVPixelBufferRef pixelBuffer, vrange range)
 {
     CVPixelBufferLockBaseAddress(inputPixelBuffer, kCVPixelBufferLock_ReadOnly);
     unsigned char* baseAddress = (unsigned char*) CVPixelBufferGetBaseAddress(inputPixelBuffer);
@@ -58,16 +63,6 @@ CVPixelBufferRef convert_rgba_to_nv12(CVPixelBufferRef inputPixelBuffer, vrange
     auto height = CVPixelBufferGetHeight(inputPixelBuffer);
     auto bytesPerRow = CVPixelBufferGetBytesPerRow(inputPixelBuffer);
 
-    NSDictionary* pixelAttributes = @{(id) kCVPixelBufferIOSurfacePropertiesKey: @{}};
-    CVPixelBufferRef pixelBuffer = NULL;
-    CVPixelBufferCreate(
-        kCFAllocatorDefault,
-        width,
-        height,
-        kCVPixelFormatType_420YpCbCr8BiPlanarVideoRange,
-        (__bridge CFDictionaryRef)(pixelAttributes),
-        &pixelBuffer);
-
     CVPixelBufferLockBaseAddress(pixelBuffer, 0);
     void* yDestPlane = CVPixelBufferGetBaseAddressOfPlane(pixelBuffer, 0);
     size_t yWidth = CVPixelBufferGetWidthOfPlane(pixelBuffer, 0);
@@ -126,42 +121,81 @@ CVPixelBufferRef convert_rgba_to_nv12(CVPixelBufferRef inputPixelBuffer, vrange
     CVPixelBufferUnlockBaseAddress(pixelBuffer, 0);
 
     CVPixelBufferUnlockBaseAddress(inputPixelBuffer, kCVPixelBufferLock_ReadOnly);
-
-    return pixelBuffer;
 }
 
-void* get_pixel_buffer_native(int width, int height)
+// The consumer owns the returned reference and releases it with CVPixelBufferRelease,
+// the allocator counts the surface as released from now on.
+static void* hand_over(bnb::surface_allocator& allocator, CVPixelBufferRef buffer)
 {
-    CVPixelBufferRef pixel_buffer = NULL;
-
-    NSDictionary* cvBufferProperties = @{
-        (__bridge NSString*)kCVPixelBufferOpenGLCompatibilityKey : @YES,
-    };
+    if (buffer == nullptr) {
+        return nullptr;
+    }
+    CVPixelBufferRetain(buffer);
+    allocator.release(buffer);
+    return (void*)buffer;
+}
 
-    CVReturn err = CVPixelBufferCreate(
-        kCFAllocatorDefault,
-        width,
-        height,
-        // We get data from oep in RGBA, macos defined kCVPixelFormatType_32RGBA but not supported
-        // and we have to choose a different type. This does not in any way affect further
-        // processing, inside bytes still remain in the order of the RGBA.
-        kCVPixelFormatType_32BGRA,
-        (__bridge CFDictionaryRef)(cvBufferProperties),
-        &pixel_buffer);
-
-    if (err) {
+void* get_pixel_buffer_native(bnb::surface_allocator& allocator, int width, int height)
+{
+    // Both buffers come from the pools, the rgba one goes back right after the conversion
+    // and the nv12 one when the consumer releases it after the hand over.
+    auto rgba_buffer = static_cast<CVPixelBufferRef>(allocator.acquire(width, height, bnb::surface_format::bgra));
+    if (rgba_buffer == nullptr) {
         NSLog(@"Pixel buffer not created");
         return nullptr;
     }
 
-    CVPixelBufferLockBaseAddress(pixel_buffer, 0);
-    
-    GLubyte *pixelBufferData = (GLubyte *)CVPixelBufferGetBaseAddress(pixel_buffer);
+    CVPixelBufferLockBaseAddress(rgba_buffer, 0);
+
+    GLubyte *pixelBufferData = (GLubyte *)CVPixelBufferGetBaseAddress(rgba_buffer);
+    glPixelStorei(GL_PACK_ROW_LENGTH, GLint(CVPixelBufferGetBytesPerRow(rgba_buffer) / 4));
     glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, pixelBufferData);
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glPixelStorei(GL_PACK_ROW_LENGTH, 0);
+
+    CVPixelBufferUnlockBaseAddress(rgba_buffer, 0);
+
+    auto nv12_buffer = static_cast<CVPixelBufferRef>(allocator.acquire(width, height, bnb::surface_format::nv12));
+    if (nv12_buffer != nullptr) {
+        convert_rgba_to_nv12(rgba_buffer, nv12_buffer, vrange::full_range);
+    } else {
+        NSLog(@"Pixel buffer not created");
+    }
+    allocator.release(rgba_buffer);
+
+    return hand_over(allocator, nv12_buffer);
+}
 
-    CVPixelBufferUnlockBaseAddress(pixel_buffer, 0);
-    pixel_buffer = convert_rgba_to_nv12(pixel_buffer, vrange::full_range);
+void* make_pixel_buffer_native(bnb::surface_allocator& allocator, const bnb::full_image_t& image)
+{
+    if (!image.has_data<bnb::yuv_image_t>()
+        || image.get_data<bnb::yuv_image_t>().get_yuv_format().format != bnb::yuv_format::yuv_nv12) {
+        NSLog(@"Only NV12 images are copied into pixel buffers");
+        return nullptr;
+    }
+    auto& yuv = image.get_data<bnb::yuv_image_t>();
+    auto format = image.get_format();
 
-    return (void*)pixel_buffer;
+    auto nv12_buffer = static_cast<CVPixelBufferRef>(allocator.acquire(format.width, format.height, bnb::surface_format::nv12));
+    if (nv12_buffer == nullptr) {
+        NSLog(@"Pixel buffer not created");
+        return nullptr;
+    }
+
+    CVPixelBufferLockBaseAddress(nv12_buffer, 0);
+    auto copy_plane = [nv12_buffer](size_t plane, const uint8_t* src, size_t src_row_bytes, size_t rows) {
+        auto dst = static_cast<uint8_t*>(CVPixelBufferGetBaseAddressOfPlane(nv12_buffer, plane));
+        auto dst_row_bytes = CVPixelBufferGetBytesPerRowOfPlane(nv12_buffer, plane);
+        rows = std::min(rows, CVPixelBufferGetHeightOfPlane(nv12_buffer, plane));
+        for (size_t row = 0; row < rows; ++row) {
+            memcpy(dst + row * dst_row_bytes, src + row * src_row_bytes, std::min(src_row_bytes, dst_row_bytes));
+        }
+    };
+    // the chroma of an odd last row or column is a sample of its own, as of bnb::chroma_size
+    const size_t chroma_width = (format.width + 1) / 2;
+    const size_t chroma_height = (format.height + 1) / 2;
+    copy_plane(0, yuv.get_y_plane(), format.width, format.height);
+    copy_plane(1, yuv.get_uv_plane(), chroma_width * 2, chroma_height);
+    CVPixelBufferUnlockBaseAddress(nv12_buffer, 0);
+
+    return hand_over(allocator, nv12_buffer);
 }
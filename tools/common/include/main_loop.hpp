@@ -0,0 +1,13 @@
+#pragma once
+
+#include <atomic>
+
+namespace bnb::tools
+{
+    /**
+     * Serve the main thread until done is set. offscreen_render_target creates the GL
+     * context on the main queue, so the main thread of a command line tool must run
+     * the loop while the pipeline works on the other threads.
+     */
+    void run_main_loop_until(const std::atomic<bool>& done);
+} // bnb::tools
@@ -0,0 +1,23 @@
+#include "main_loop.hpp"
+
+#ifdef __APPLE__
+    #include <CoreFoundation/CoreFoundation.h>
+#else
+    #include <chrono>
+    #include <thread>
+#endif
+
+namespace bnb::tools
+{
+    void run_main_loop_until(const std::atomic<bool>& done)
+    {
+        while (!done) {
+        #ifdef __APPLE__
+            // the main dispatch queue is drained by the run loop of the main thread
+            CFRunLoopRunInMode(kCFRunLoopDefaultMode, 0.01, true);
+        #else
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        #endif
+        }
+    }
+} // bnb::tools
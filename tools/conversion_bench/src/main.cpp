@@ -0,0 +1,497 @@
+#include "conversion.hpp"
+#include "rotation.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+    #include <x86intrin.h>
+    #define BNB_HAS_TSC 1
+#else
+    #define BNB_HAS_TSC 0
+#endif
+
+using namespace bnb;
+
+namespace
+{
+    using clock_type = std::chrono::steady_clock;
+
+    // extra bytes at the end of every row of the padded layouts, as camera buffers usually have
+    constexpr int32_t row_padding = 64;
+
+    struct resolution
+    {
+        const char* name;
+        uint32_t width;
+        uint32_t height;
+    };
+
+    const resolution resolutions[] = {
+        {"480p", 640, 480},
+        {"720p", 1280, 720},
+        {"1080p", 1920, 1080},
+        {"4k", 3840, 2160},
+    };
+
+    struct options
+    {
+        std::string output{"-"};
+        std::string filter;
+        double min_seconds{0.2};
+        std::optional<double> cpu_ghz;
+    };
+
+    struct bench_case
+    {
+        std::string name;
+        std::string pixel_format;
+        const resolution* res;
+        bool padded;
+        // bytes read and written by one call, 0 if the buffer is wrapped without a copy
+        size_t bytes;
+        std::function<void()> run;
+    };
+
+    struct result
+    {
+        const bench_case* bc;
+        uint64_t iterations{0};
+        double median_ns{0};
+        double min_ns{0};
+        std::optional<double> cycles_per_pixel;
+    };
+
+    volatile uint8_t sink;
+
+    void consume(const full_image_t& image)
+    {
+        if (image.has_data<yuv_image_t>()) {
+            sink = image.get_data<yuv_image_t>().get_y_plane()[0];
+        } else {
+            sink = image.get_data<bpc8_image_t>().get_data()[0];
+        }
+    }
+
+    std::vector<uint8_t> make_buffer(size_t size)
+    {
+        std::vector<uint8_t> buffer(size);
+        for (size_t i = 0; i < size; ++i) {
+            buffer[i] = static_cast<uint8_t>(i * 31 + (i >> 8));
+        }
+        return buffer;
+    }
+
+    image_format make_format(const resolution& res)
+    {
+        image_format format;
+        format.width = res.width;
+        format.height = res.height;
+        format.orientation = camera_orientation::deg_0;
+        format.require_mirroring = false;
+        return format;
+    }
+
+    const char* pixel_format_name(bpc8_image_t::pixel_format_t format)
+    {
+        switch (format) {
+            case bpc8_image_t::pixel_format_t::rgb:
+                return "rgb";
+            case bpc8_image_t::pixel_format_t::rgba:
+                return "rgba";
+            case bpc8_image_t::pixel_format_t::bgr:
+                return "bgr";
+            case bpc8_image_t::pixel_format_t::bgra:
+                return "bgra";
+            case bpc8_image_t::pixel_format_t::argb:
+                return "argb";
+        }
+        return "unknown";
+    }
+
+    // the buffers are shared by the closures of every case of one resolution and layout
+    struct source_buffers
+    {
+        std::vector<uint8_t> packed;
+        std::vector<uint8_t> r, g, b;
+        std::vector<uint8_t> y, uv;
+        std::vector<uint8_t> out_y, out_u, out_v;
+        std::vector<uint8_t> rotated;
+    };
+
+    void add_cases(std::vector<bench_case>& cases, std::vector<std::shared_ptr<source_buffers>>& storage,
+                   const resolution& res, bool padded)
+    {
+        using pf = bpc8_image_t::pixel_format_t;
+
+        const auto width = int32_t(res.width);
+        const auto height = int32_t(res.height);
+        const auto pixels = size_t(width) * height;
+        const auto padding = padded ? row_padding : 0;
+        auto format = make_format(res);
+
+        auto buffers = std::make_shared<source_buffers>();
+        storage.push_back(buffers);
+        buffers->packed = make_buffer(size_t(width * 4 + padding) * height);
+        buffers->r = make_buffer(size_t(width + padding) * height);
+        buffers->g = make_buffer(size_t(width + padding) * height);
+        buffers->b = make_buffer(size_t(width + padding) * height);
+        buffers->y = make_buffer(size_t(width + padding) * height);
+        buffers->uv = make_buffer(size_t(width + padding) * (height / 2));
+        buffers->out_y.resize(pixels);
+        buffers->out_u.resize(pixels / 2);
+        buffers->out_v.resize(pixels / 4);
+        buffers->rotated.resize(pixels * 4);
+        auto* b = buffers.get();
+
+        // make_full_image_from_rgb_planes, the fast path: interleaved channels in the RGB or BGR order
+        const std::tuple<const char*, int32_t, bool> interleaved[] = {{"rgb", 3, false}, {"rgba", 4, false}, {"bgr", 3, true}, {"bgra", 4, true}};
+        for (auto [name, channels, bgr] : interleaved) {
+            const auto stride = width * channels + padding;
+            const auto* base = b->packed.data();
+            cases.push_back({"rgb_planes_fast", name, &res, padded, 2 * pixels * channels, [=]() {
+                                 const auto* r = bgr ? base + 2 : base;
+                                 const auto* bl = bgr ? base : base + 2;
+                                 consume(make_full_image_from_rgb_planes(format, r, stride, channels, base + 1, stride, channels, bl, stride, channels));
+                             }});
+        }
+
+        // the slow path: separate planes
+        {
+            const auto stride = width + padding;
+            cases.push_back({"rgb_planes_slow", "planar", &res, padded, 2 * pixels * 3, [=]() {
+                                 consume(make_full_image_from_rgb_planes(format, b->r.data(), stride, 1, b->g.data(), stride, 1, b->b.data(), stride, 1));
+                             }});
+        }
+
+        // make_full_image_from_nonplanar_bpc8_no_copy, wraps the buffer when unpadded, copies otherwise
+        for (auto pixel_format : {pf::rgb, pf::rgba, pf::bgr, pf::bgra, pf::argb}) {
+            const auto channels = int32_t(bpc8_image_t::bytes_per_pixel(pixel_format));
+            const auto stride = width * channels + padding;
+            cases.push_back({"nonplanar_bpc8_no_copy", pixel_format_name(pixel_format), &res, padded,
+                             padded ? 2 * pixels * channels : 0, [=]() {
+                                 consume(make_full_image_from_nonplanar_bpc8_no_copy(format, pixel_format, b->packed.data(), stride, []() {}));
+                             }});
+        }
+
+        // make_full_image_from_biplanar_yuv and its _no_copy variant
+        {
+            const auto stride = width + padding;
+            const auto nv12_bytes = pixels * 3 / 2;
+            cases.push_back({"biplanar_yuv", "nv12", &res, padded, 2 * nv12_bytes, [=]() {
+                                 consume(make_full_image_from_biplanar_yuv(format, b->y.data(), stride, b->uv.data(), stride));
+                             }});
+            cases.push_back({"biplanar_yuv_no_copy", "nv12", &res, padded, padded ? 2 * nv12_bytes : 0, [=]() {
+                                 consume(make_full_image_from_biplanar_yuv_no_copy(format, b->y.data(), stride, []() {}, b->uv.data(), stride, []() {}));
+                             }});
+        }
+
+        // rotate_plane per orientation: Y, interleaved UV and RGBA planes
+        {
+            const std::tuple<const char*, uint32_t, uint32_t, uint32_t, const uint8_t*> planes[] = {
+                {"y", res.width, res.height, 1, b->y.data()},
+                {"uv", res.width / 2, res.height / 2, 2, b->uv.data()},
+                {"rgba", res.width, res.height, 4, b->packed.data()}};
+            const std::tuple<const char*, image_transform> transforms[] = {
+                {"90", {90, false}}, {"180", {180, false}}, {"270", {270, false}}, {"mirror", {0, true}}, {"90_mirror", {90, true}}};
+            for (auto [plane_name, plane_width, plane_height, bytes_per_pixel, src] : planes) {
+                const auto stride = int32_t(plane_width * bytes_per_pixel) + padding;
+                const auto plane_bytes = size_t(plane_width) * plane_height * bytes_per_pixel;
+                for (auto [transform_name, transform] : transforms) {
+                    const auto dst_width = transform.degrees % 180 == 0 ? plane_width : plane_height;
+                    cases.push_back({"rotate_plane", std::string(plane_name) + "_" + transform_name, &res, padded, 2 * plane_bytes, [=]() {
+                                         rotate_plane(src, stride, plane_width, plane_height, bytes_per_pixel, transform,
+                                                      b->rotated.data(), int32_t(dst_width * bytes_per_pixel));
+                                         sink = b->rotated[0];
+                                     }});
+                }
+            }
+
+            // the pre-rotation of a portrait camera frame while it is copied, on one and four threads
+            const auto y_stride = width + padding;
+            const auto nv12_bytes = pixels * 3 / 2;
+            for (uint32_t threads : {1u, 4u}) {
+                cases.push_back({"biplanar_yuv_rotated", "nv12_90_t" + std::to_string(threads), &res, padded, 2 * nv12_bytes, [=]() {
+                                     consume(make_full_image_from_biplanar_yuv(format, b->y.data(), y_stride, b->uv.data(), y_stride,
+                                                                               image_transform{90, false}, threads));
+                                 }});
+            }
+        }
+
+        // conversion of the output, RGBA is read back from the GPU
+        {
+            const auto stride = width * 4 + padding;
+            cases.push_back({"rgba_to_nv12", "rgba", &res, padded, pixels * 4 + pixels * 3 / 2, [=]() {
+                                 rgba_to_nv12(b->packed.data(), stride, res.width, res.height,
+                                              b->out_y.data(), width, b->out_u.data(), width);
+                                 sink = b->out_y[0];
+                             }});
+            cases.push_back({"rgba_to_i420", "rgba", &res, padded, pixels * 4 + pixels * 3 / 2, [=]() {
+                                 rgba_to_i420(b->packed.data(), stride, res.width, res.height,
+                                              b->out_y.data(), width, b->out_u.data(), width / 2, b->out_v.data(), width / 2);
+                                 sink = b->out_y[0];
+                             }});
+        }
+    }
+
+    // rotate_plane by the definition: mirrored columns first, then the clockwise rotation, pixel by pixel
+    void rotate_plane_reference(const uint8_t* src, int32_t src_row_stride, uint32_t width, uint32_t height,
+                                uint32_t bytes_per_pixel, image_transform transform, uint8_t* dst, int32_t dst_row_stride)
+    {
+        for (uint32_t y = 0; y < height; ++y) {
+            for (uint32_t x = 0; x < width; ++x) {
+                const uint32_t mx = transform.mirror ? width - 1 - x : x;
+                uint32_t dx = mx;
+                uint32_t dy = y;
+                switch (transform.degrees % 360) {
+                    case 90:
+                        dx = height - 1 - y;
+                        dy = mx;
+                        break;
+                    case 180:
+                        dx = width - 1 - mx;
+                        dy = height - 1 - y;
+                        break;
+                    case 270:
+                        dx = y;
+                        dy = width - 1 - mx;
+                        break;
+                }
+                std::memcpy(dst + size_t(dy) * dst_row_stride + size_t(dx) * bytes_per_pixel,
+                            src + size_t(y) * src_row_stride + size_t(x) * bytes_per_pixel, bytes_per_pixel);
+            }
+        }
+    }
+
+    /**
+     * Compares the SIMD kernels of rotate_plane (SSE2, AVX2 or NEON, whichever the CPU runs) with
+     * the reference for every orientation, mirror flag and pixel size, on sizes which are not
+     * multiples of the blocks and tiles, padded rows and split rows. Returns the number of mismatches.
+     */
+    uint32_t check_rotate_plane()
+    {
+        const std::pair<uint32_t, uint32_t> sizes[] = {{64, 64}, {67, 45}, {130, 97}, {33, 260}};
+        uint32_t cases = 0;
+        uint32_t mismatches = 0;
+        for (auto [width, height] : sizes) {
+            for (uint32_t bytes_per_pixel : {1u, 2u, 3u, 4u}) {
+                const auto src_stride = int32_t(width * bytes_per_pixel) + 7;
+                const auto src = make_buffer(size_t(src_stride) * height);
+                for (uint32_t degrees : {0u, 90u, 180u, 270u}) {
+                    for (bool mirror : {false, true}) {
+                        for (uint32_t threads : {1u, 4u}) {
+                            const image_transform transform{degrees, mirror};
+                            const auto dst_width = degrees % 180 == 0 ? width : height;
+                            const auto dst_height = degrees % 180 == 0 ? height : width;
+                            const auto dst_stride = int32_t(dst_width * bytes_per_pixel) + 5;
+                            std::vector<uint8_t> expected(size_t(dst_stride) * dst_height, 0);
+                            std::vector<uint8_t> actual(expected.size(), 0);
+                            rotate_plane_reference(src.data(), src_stride, width, height, bytes_per_pixel, transform, expected.data(), dst_stride);
+                            rotate_plane(src.data(), src_stride, width, height, bytes_per_pixel, transform, actual.data(), dst_stride, threads);
+                            ++cases;
+                            if (actual != expected) {
+                                ++mismatches;
+                                std::fprintf(stderr, "[ERROR] rotate_plane %ux%u, %u bytes per pixel, %u degrees%s, %u threads differs from the reference\n",
+                                             width, height, bytes_per_pixel, degrees, mirror ? " mirrored" : "", threads);
+                            }
+                        }
+                    }
+                }
+            }
+        }
+        std::fprintf(stderr, "rotate_plane: %u of %u cases match the reference\n", cases - mismatches, cases);
+        return mismatches;
+    }
+
+    uint64_t read_cycles()
+    {
+#if BNB_HAS_TSC
+        return __rdtsc();
+#else
+        return 0;
+#endif
+    }
+
+    // the ratio of TSC ticks to nanoseconds, TSC runs at the nominal frequency
+    std::optional<double> measure_tsc_ghz()
+    {
+#if BNB_HAS_TSC
+        auto start_time = clock_type::now();
+        auto start_cycles = read_cycles();
+        while (clock_type::now() - start_time < std::chrono::milliseconds(100)) {
+        }
+        auto ns = std::chrono::duration<double, std::nano>(clock_type::now() - start_time).count();
+        return double(read_cycles() - start_cycles) / ns;
+#else
+        return std::nullopt;
+#endif
+    }
+
+    result measure(const bench_case& bc, const options& opts, std::optional<double> ghz)
+    {
+        // warm up the caches and the allocator
+        for (int i = 0; i < 3; ++i) {
+            bc.run();
+        }
+
+        std::vector<double> samples;
+        auto deadline = clock_type::now() + std::chrono::duration<double>(opts.min_seconds);
+        while (samples.size() < 5 || clock_type::now() < deadline) {
+            auto start = clock_type::now();
+            bc.run();
+            samples.push_back(std::chrono::duration<double, std::nano>(clock_type::now() - start).count());
+        }
+
+        result r;
+        r.bc = &bc;
+        r.iterations = samples.size();
+        std::sort(samples.begin(), samples.end());
+        r.median_ns = samples[samples.size() / 2];
+        r.min_ns = samples.front();
+        if (ghz.has_value()) {
+            r.cycles_per_pixel = r.median_ns * *ghz / (double(bc.res->width) * bc.res->height);
+        }
+        return r;
+    }
+
+    double gb_per_s(const result& r)
+    {
+        return double(r.bc->bytes) / r.median_ns;
+    }
+
+    std::string to_json(const std::vector<result>& results, std::optional<double> ghz)
+    {
+        std::ostringstream out;
+        out << "{\"version\":1,\"timestamp\":" << std::time(nullptr) << ",\"cpu_ghz\":";
+        if (ghz.has_value()) {
+            out << *ghz;
+        } else {
+            out << "null";
+        }
+        out << ",\"results\":[";
+        for (size_t i = 0; i < results.size(); ++i) {
+            auto& r = results[i];
+            out << (i == 0 ? "" : ",") << "\n{\"name\":\"" << r.bc->name << "\",\"pixel_format\":\"" << r.bc->pixel_format
+                << "\",\"resolution\":\"" << r.bc->res->name << "\",\"width\":" << r.bc->res->width
+                << ",\"height\":" << r.bc->res->height << ",\"padded\":" << (r.bc->padded ? "true" : "false")
+                << ",\"bytes\":" << r.bc->bytes << ",\"iterations\":" << r.iterations
+                << ",\"median_ns\":" << r.median_ns << ",\"min_ns\":" << r.min_ns
+                << ",\"gb_per_s\":" << gb_per_s(r) << ",\"cycles_per_pixel\":";
+            if (r.cycles_per_pixel.has_value()) {
+                out << *r.cycles_per_pixel;
+            } else {
+                out << "null";
+            }
+            out << "}";
+        }
+        out << "\n]}\n";
+        return out.str();
+    }
+
+    void print_usage()
+    {
+        std::cerr << "Usage: conversion_bench [options]\n"
+                  << "  --output <file|->   JSON results, stdout by default\n"
+                  << "  --filter <text>     run the cases whose name/format/size/stride id contains the text\n"
+                  << "  --min-time <s>      measurement time per case, 0.2 by default\n"
+                  << "  --cpu-ghz <f>       clock of the core for cycles per pixel, measured with TSC on x86\n";
+    }
+
+    std::optional<options> parse_options(int argc, char** argv)
+    {
+        options result;
+        for (int i = 1; i < argc; ++i) {
+            std::string arg = argv[i];
+            auto next = [&]() -> std::string {
+                if (i + 1 >= argc) {
+                    throw std::runtime_error("missing value of " + arg);
+                }
+                return argv[++i];
+            };
+
+            if (arg == "--output") {
+                result.output = next();
+            } else if (arg == "--filter") {
+                result.filter = next();
+            } else if (arg == "--min-time") {
+                result.min_seconds = std::stod(next());
+            } else if (arg == "--cpu-ghz") {
+                result.cpu_ghz = std::stod(next());
+            } else if (arg == "--help" || arg == "-h") {
+                return std::nullopt;
+            } else {
+                throw std::runtime_error("unknown option " + arg);
+            }
+        }
+        return result;
+    }
+} // anonymous namespace
+
+int main(int argc, char** argv)
+{
+    std::optional<options> opts;
+    try {
+        opts = parse_options(argc, argv);
+    } catch (const std::exception& e) {
+        std::cerr << "[ERROR] " << e.what() << std::endl;
+        print_usage();
+        return EXIT_FAILURE;
+    }
+    if (!opts.has_value()) {
+        print_usage();
+        return EXIT_SUCCESS;
+    }
+
+    // fast kernels which are wrong are not worth measuring
+    if (check_rotate_plane() != 0) {
+        return EXIT_FAILURE;
+    }
+
+    auto ghz = opts->cpu_ghz.has_value() ? opts->cpu_ghz : measure_tsc_ghz();
+
+    std::vector<bench_case> cases;
+    std::vector<std::shared_ptr<source_buffers>> storage;
+    for (auto& res : resolutions) {
+        add_cases(cases, storage, res, false);
+        add_cases(cases, storage, res, true);
+    }
+
+    std::vector<result> results;
+    std::fprintf(stderr, "%-24s %-7s %-6s %-6s %11s %8s %12s\n", "case", "format", "size", "stride", "median us", "GB/s", "cycles/px");
+    for (auto& bc : cases) {
+        auto id = bc.name + "/" + bc.pixel_format + "/" + bc.res->name + (bc.padded ? "/padded" : "/packed");
+        if (!opts->filter.empty() && id.find(opts->filter) == std::string::npos) {
+            continue;
+        }
+        auto r = measure(bc, *opts, ghz);
+        std::fprintf(stderr, "%-24s %-7s %-6s %-6s %11.1f %8.2f %12.2f\n", bc.name.c_str(), bc.pixel_format.c_str(),
+                     bc.res->name, bc.padded ? "padded" : "packed", r.median_ns / 1000.0, gb_per_s(r),
+                     r.cycles_per_pixel.value_or(0.0));
+        results.push_back(r);
+    }
+
+    auto json = to_json(results, ghz);
+    if (opts->output == "-") {
+        std::cout << json;
+    } else {
+        std::ofstream file(opts->output);
+        file << json;
+        if (!file) {
+            std::cerr << "[ERROR] Failed to write " << opts->output << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+    return EXIT_SUCCESS;
+}
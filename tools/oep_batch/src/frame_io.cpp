@@ -0,0 +1,254 @@
+#include "frame_io.hpp"
+
+#include "conversion.hpp"
+#include "logger.hpp"
+
+#include <algorithm>
+#include <sstream>
+
+namespace
+{
+    std::FILE* open_file(const std::string& path, bool write)
+    {
+        if (path == "-") {
+            return write ? stdout : stdin;
+        }
+        return std::fopen(path.c_str(), write ? "wb" : "rb");
+    }
+
+    void close_file(std::FILE* file)
+    {
+        if (file != nullptr && file != stdin && file != stdout) {
+            std::fclose(file);
+        } else if (file == stdout) {
+            std::fflush(stdout);
+        }
+    }
+
+    bool read_line(std::FILE* file, std::string& line)
+    {
+        line.clear();
+        for (int c = std::fgetc(file); c != EOF; c = std::fgetc(file)) {
+            if (c == '\n') {
+                return true;
+            }
+            line.push_back(static_cast<char>(c));
+            if (line.size() > 4096) {
+                return false;
+            }
+        }
+        return false;
+    }
+
+    // bytes of a U or V plane
+    size_t chroma_plane_size(const bnb::batch::video_info& info)
+    {
+        return size_t(bnb::chroma_size(info.width)) * bnb::chroma_size(info.height);
+    }
+} // anonymous namespace
+
+namespace bnb::batch
+{
+    std::unique_ptr<frame_reader> frame_reader::open(const std::string& path, std::optional<video_info> raw_info)
+    {
+        auto file = open_file(path, false);
+        if (file == nullptr) {
+            WRITE_LOG_MESSAGE(error, "Failed to open the input " << path);
+            return nullptr;
+        }
+
+        auto type = raw_info.has_value() ? container::raw : container::y4m;
+        // we use "new" instead of "make_unique" because the constructor is private
+        std::unique_ptr<frame_reader> reader(new frame_reader(file, raw_info.value_or(video_info{}), type));
+        if (type == container::y4m && !reader->read_y4m_header()) {
+            return nullptr;
+        }
+
+        auto& info = reader->m_info;
+        if (info.width == 0 || info.height == 0 || info.width % 2 != 0 || info.height % 2 != 0) {
+            WRITE_LOG_MESSAGE(error, "The frame size must be even, got " << info.width << "x" << info.height);
+            return nullptr;
+        }
+        if (info.layout == pixel_layout::rgba) {
+            WRITE_LOG_MESSAGE(error, "The input must be I420 or NV12");
+            return nullptr;
+        }
+        return reader;
+    }
+
+    frame_reader::frame_reader(std::FILE* file, video_info info, container type)
+        : m_file(file)
+        , m_info(info)
+        , m_container(type) {}
+
+    frame_reader::~frame_reader()
+    {
+        close_file(m_file);
+    }
+
+    bool frame_reader::read_y4m_header()
+    {
+        std::string line;
+        if (!read_line(m_file, line) || line.rfind("YUV4MPEG2", 0) != 0) {
+            WRITE_LOG_MESSAGE(error, "The input is not a Y4M stream");
+            return false;
+        }
+
+        m_info.layout = pixel_layout::i420;
+        std::istringstream tokens(line.substr(9));
+        std::string token;
+        while (tokens >> token) {
+            auto value = token.substr(1);
+            switch (token[0]) {
+                case 'W':
+                    m_info.width = static_cast<uint32_t>(std::stoul(value));
+                    break;
+                case 'H':
+                    m_info.height = static_cast<uint32_t>(std::stoul(value));
+                    break;
+                case 'F': {
+                    auto colon = value.find(':');
+                    if (colon != std::string::npos) {
+                        m_info.fps_num = static_cast<uint32_t>(std::stoul(value.substr(0, colon)));
+                        m_info.fps_den = std::max(1u, static_cast<uint32_t>(std::stoul(value.substr(colon + 1))));
+                    }
+                } break;
+                case 'C':
+                    if (value.rfind("420", 0) != 0) {
+                        WRITE_LOG_MESSAGE(error, "Only 4:2:0 Y4M is supported, got C" << value);
+                        return false;
+                    }
+                    break;
+                case 'X':
+                    if (value == "COLORRANGE=FULL") {
+                        m_info.full_range = true;
+                    }
+                    break;
+                default:
+                    break;
+            }
+        }
+        return true;
+    }
+
+    std::optional<full_image_t> frame_reader::read(plane_pool& pool)
+    {
+        if (m_container == container::y4m) {
+            std::string line;
+            if (!read_line(m_file, line)) {
+                return std::nullopt;
+            }
+            if (line.rfind("FRAME", 0) != 0) {
+                WRITE_LOG_MESSAGE(error, "Broken Y4M frame header");
+                return std::nullopt;
+            }
+        }
+
+        auto y_size = size_t(m_info.width) * m_info.height;
+        auto y_plane = pool.acquire(y_size);
+        auto u_plane = pool.acquire(chroma_plane_size(m_info) * (m_info.layout == pixel_layout::nv12 ? 2 : 1));
+        if (std::fread(y_plane.get(), 1, y_size, m_file) != y_size) {
+            return std::nullopt;
+        }
+
+        bnb::image_format format;
+        format.width = m_info.width;
+        format.height = m_info.height;
+        format.orientation = camera_orientation::deg_0;
+        format.require_mirroring = false;
+        yuv_format_t yuv_format{m_info.full_range ? color_range::full : color_range::video, color_std::bt601, yuv_format::yuv_nv12};
+
+        if (m_info.layout == pixel_layout::nv12) {
+            auto uv_size = chroma_plane_size(m_info) * 2;
+            if (std::fread(u_plane.get(), 1, uv_size, m_file) != uv_size) {
+                return std::nullopt;
+            }
+            return full_image_t(yuv_image_t(y_plane, u_plane, format, yuv_format));
+        }
+
+        auto v_plane = pool.acquire(chroma_plane_size(m_info));
+        if (std::fread(u_plane.get(), 1, chroma_plane_size(m_info), m_file) != chroma_plane_size(m_info)
+            || std::fread(v_plane.get(), 1, chroma_plane_size(m_info), m_file) != chroma_plane_size(m_info)) {
+            return std::nullopt;
+        }
+        yuv_format.format = yuv_format::yuv_i420;
+        return full_image_t(yuv_image_t(y_plane, u_plane, v_plane, format, yuv_format));
+    }
+
+    std::unique_ptr<frame_writer> frame_writer::open(const std::string& path, container type, video_info info)
+    {
+        if (type == container::y4m) {
+            info.layout = pixel_layout::i420;
+        }
+        // the output is converted to full range
+        info.full_range = true;
+
+        auto file = open_file(path, true);
+        if (file == nullptr) {
+            WRITE_LOG_MESSAGE(error, "Failed to open the output " << path);
+            return nullptr;
+        }
+        // we use "new" instead of "make_unique" because the constructor is private
+        return std::unique_ptr<frame_writer>(new frame_writer(file, type, info));
+    }
+
+    frame_writer::frame_writer(std::FILE* file, container type, video_info info)
+        : m_file(file)
+        , m_container(type)
+        , m_info(info) {}
+
+    frame_writer::~frame_writer()
+    {
+        close_file(m_file);
+    }
+
+    bool frame_writer::write_rgba(const uint8_t* rgba, int32_t row_stride)
+    {
+        const auto width = m_info.width;
+        const auto height = m_info.height;
+        const auto y_size = size_t(width) * height;
+
+        if (m_container == container::y4m) {
+            if (!m_header_written) {
+                std::fprintf(m_file, "YUV4MPEG2 W%u H%u F%u:%u Ip A1:1 C420jpeg XCOLORRANGE=FULL\n",
+                             width, height, m_info.fps_num, m_info.fps_den);
+                m_header_written = true;
+            }
+            std::fputs("FRAME\n", m_file);
+        }
+
+        switch (m_info.layout) {
+            case pixel_layout::rgba:
+                for (uint32_t row = 0; row < height; ++row) {
+                    if (std::fwrite(rgba + size_t(row) * row_stride, 1, size_t(width) * 4, m_file) != size_t(width) * 4) {
+                        return false;
+                    }
+                }
+                return true;
+            case pixel_layout::nv12:
+                m_buffer.resize(y_size + chroma_plane_size(m_info) * 2);
+                rgba_to_nv12(
+                    // clang-format off
+                    rgba, row_stride,
+                    width, height,
+                    m_buffer.data(), int32_t(width),
+                    m_buffer.data() + y_size, int32_t(chroma_size(width) * 2)
+                    // clang-format on
+                );
+                break;
+            case pixel_layout::i420:
+                m_buffer.resize(y_size + chroma_plane_size(m_info) * 2);
+                rgba_to_i420(
+                    // clang-format off
+                    rgba, row_stride,
+                    width, height,
+                    m_buffer.data(), int32_t(width),
+                    m_buffer.data() + y_size, int32_t(chroma_size(width)),
+                    m_buffer.data() + y_size + chroma_plane_size(m_info), int32_t(chroma_size(width))
+                    // clang-format on
+                );
+                break;
+        }
+        return std::fwrite(m_buffer.data(), 1, m_buffer.size(), m_file) == m_buffer.size();
+    }
+} // bnb::batch
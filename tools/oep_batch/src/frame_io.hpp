@@ -0,0 +1,93 @@
+#pragma once
+
+#include <bnb/types/full_image.hpp>
+
+#include "plane_pool.hpp"
+
+#include <cstdio>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace bnb::batch
+{
+    enum class container
+    {
+        y4m,
+        raw
+    };
+
+    enum class pixel_layout
+    {
+        i420,
+        nv12,
+        rgba // output only
+    };
+
+    struct video_info
+    {
+        uint32_t width{0};
+        uint32_t height{0};
+        pixel_layout layout{pixel_layout::i420};
+        uint32_t fps_num{30};
+        uint32_t fps_den{1};
+        bool full_range{false};
+    };
+
+    /**
+     * Reads frames from Y4M (4:2:0 only) or headerless raw I420/NV12 file, "-" is stdin.
+     * The frames are built over planes of the pool.
+     */
+    class frame_reader
+    {
+    public:
+        /**
+         * @param raw_info size and layout of a raw stream, std::nullopt for Y4M
+         */
+        static std::unique_ptr<frame_reader> open(const std::string& path, std::optional<video_info> raw_info);
+
+        ~frame_reader();
+
+        const video_info& info() const { return m_info; }
+
+        /**
+         * @return the next frame, std::nullopt at the end of the stream
+         */
+        std::optional<full_image_t> read(plane_pool& pool);
+
+    private:
+        frame_reader(std::FILE* file, video_info info, container type);
+
+        bool read_y4m_header();
+
+        std::FILE* m_file;
+        video_info m_info;
+        container m_container;
+    };
+
+    /**
+     * Writes RGBA frames converted to I420/NV12 (BT.601 full range) or as is, to Y4M or raw file,
+     * "-" is stdout. Y4M is always I420.
+     */
+    class frame_writer
+    {
+    public:
+        static std::unique_ptr<frame_writer> open(const std::string& path, container type, video_info info);
+
+        ~frame_writer();
+
+        const video_info& info() const { return m_info; }
+
+        bool write_rgba(const uint8_t* rgba, int32_t row_stride);
+
+    private:
+        frame_writer(std::FILE* file, container type, video_info info);
+
+        std::FILE* m_file;
+        container m_container;
+        video_info m_info;
+        bool m_header_written{false};
+        std::vector<uint8_t> m_buffer;
+    };
+} // bnb::batch
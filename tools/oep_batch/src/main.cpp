@@ -0,0 +1,339 @@
+#include "frame_io.hpp"
+#include "main_loop.hpp"
+
+#include "offscreen_effect_player.hpp"
+#include "oep_metrics.hpp"
+
+#include "blocking_queue.hpp"
+#include "logger.hpp"
+#include "metrics.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <thread>
+
+using namespace bnb;
+using namespace bnb::batch;
+using namespace bnb::tools;
+
+namespace
+{
+    using clock_type = std::chrono::steady_clock;
+
+    struct options
+    {
+        std::string input{"-"};
+        std::string output{"-"};
+        std::string effect;
+        std::string token;
+        std::vector<std::string> resources{BNB_RESOURCES_FOLDER};
+        std::optional<pixel_layout> raw_input;
+        container output_container{container::y4m};
+        pixel_layout output_layout{pixel_layout::i420};
+        uint32_t width{0};
+        uint32_t height{0};
+        uint32_t fps{0};
+        uint64_t max_frames{0};
+        uint32_t frames_in_flight{2};
+        bool json{false};
+    };
+
+    struct output_frame
+    {
+        uint64_t index;
+        full_image_t image;
+    };
+
+    void print_usage()
+    {
+        std::cerr << "Usage: oep_batch --effect <path> [options]\n"
+                  << "  --input <file|->            Y4M or raw frames, stdin by default\n"
+                  << "  --input-format y4m|i420|nv12  raw formats need --size\n"
+                  << "  --size <W>x<H>              size of raw input\n"
+                  << "  --fps <N>                   frame rate of raw input, 30 by default\n"
+                  << "  --output <file|->           stdout by default, /dev/null for benchmarks\n"
+                  << "  --output-format y4m|i420|nv12|rgba\n"
+                  << "  --frames <N>                stop after N frames\n"
+                  << "  --in-flight <N>             frames queued for rendering, 2 by default\n"
+                  << "  --resources <dir>           additional resources folder\n"
+                  << "  --token <token>             client token, BNB_CLIENT_TOKEN by default\n"
+                  << "  --json                      print the report as JSON\n";
+    }
+
+    std::optional<options> parse_options(int argc, char** argv)
+    {
+        options result;
+        if (auto token = std::getenv("BNB_CLIENT_TOKEN")) {
+            result.token = token;
+        }
+
+        for (int i = 1; i < argc; ++i) {
+            std::string arg = argv[i];
+            auto next = [&]() -> std::string {
+                if (i + 1 >= argc) {
+                    throw std::runtime_error("missing value of " + arg);
+                }
+                return argv[++i];
+            };
+
+            if (arg == "--input") {
+                result.input = next();
+            } else if (arg == "--output") {
+                result.output = next();
+            } else if (arg == "--effect") {
+                result.effect = next();
+            } else if (arg == "--token") {
+                result.token = next();
+            } else if (arg == "--resources") {
+                result.resources.push_back(next());
+            } else if (arg == "--input-format") {
+                auto value = next();
+                if (value == "i420") {
+                    result.raw_input = pixel_layout::i420;
+                } else if (value == "nv12") {
+                    result.raw_input = pixel_layout::nv12;
+                } else if (value != "y4m") {
+                    throw std::runtime_error("unknown input format " + value);
+                }
+            } else if (arg == "--output-format") {
+                auto value = next();
+                result.output_container = value == "y4m" ? container::y4m : container::raw;
+                if (value == "nv12") {
+                    result.output_layout = pixel_layout::nv12;
+                } else if (value == "rgba") {
+                    result.output_layout = pixel_layout::rgba;
+                } else if (value != "y4m" && value != "i420") {
+                    throw std::runtime_error("unknown output format " + value);
+                }
+            } else if (arg == "--size") {
+                auto value = next();
+                auto x = value.find('x');
+                if (x == std::string::npos) {
+                    throw std::runtime_error("the size must be <W>x<H>");
+                }
+                result.width = static_cast<uint32_t>(std::stoul(value.substr(0, x)));
+                result.height = static_cast<uint32_t>(std::stoul(value.substr(x + 1)));
+            } else if (arg == "--fps") {
+                result.fps = static_cast<uint32_t>(std::stoul(next()));
+            } else if (arg == "--frames") {
+                result.max_frames = std::stoull(next());
+            } else if (arg == "--in-flight") {
+                result.frames_in_flight = static_cast<uint32_t>(std::stoul(next()));
+            } else if (arg == "--json") {
+                result.json = true;
+            } else if (arg == "--help" || arg == "-h") {
+                return std::nullopt;
+            } else {
+                throw std::runtime_error("unknown option " + arg);
+            }
+        }
+
+        if (result.effect.empty()) {
+            throw std::runtime_error("--effect is required");
+        }
+        if (result.raw_input.has_value() && (result.width == 0 || result.height == 0)) {
+            throw std::runtime_error("raw input requires --size");
+        }
+        return result;
+    }
+
+    void record_since(metrics::latency_histogram& histogram, clock_type::time_point from)
+    {
+        auto us = std::chrono::duration_cast<std::chrono::microseconds>(clock_type::now() - from).count();
+        histogram.record(static_cast<uint64_t>(std::max<int64_t>(us, 0)));
+    }
+
+    void print_report(bool json, uint64_t frames, uint64_t failed, double seconds,
+                      const std::vector<std::pair<std::string, interfaces::stage_latency>>& stages)
+    {
+        auto fps = seconds > 0 ? frames / seconds : 0.0;
+        auto ms = [](uint64_t us) { return us / 1000.0; };
+
+        if (json) {
+            std::cerr << "{\"frames\":" << frames << ",\"failed\":" << failed << ",\"seconds\":" << seconds
+                      << ",\"fps\":" << fps << ",\"stages\":{";
+            for (size_t i = 0; i < stages.size(); ++i) {
+                auto& [name, s] = stages[i];
+                std::cerr << (i == 0 ? "" : ",") << "\"" << name << "\":{\"count\":" << s.count
+                          << ",\"mean_ms\":" << s.mean_us() / 1000.0 << ",\"p50_ms\":" << ms(s.p50_us)
+                          << ",\"p99_ms\":" << ms(s.p99_us) << ",\"max_ms\":" << ms(s.max_us) << "}";
+            }
+            std::cerr << "}}" << std::endl;
+            return;
+        }
+
+        std::cerr << "frames: " << frames << " (failed " << failed << "), " << seconds << " s, " << fps << " fps\n";
+        std::cerr << "stage           count   mean ms    p50 ms    p99 ms    max ms\n";
+        for (auto& [name, s] : stages) {
+            std::fprintf(stderr, "%-14s %6llu %9.3f %9.3f %9.3f %9.3f\n", name.c_str(),
+                         static_cast<unsigned long long>(s.count), s.mean_us() / 1000.0,
+                         ms(s.p50_us), ms(s.p99_us), ms(s.max_us));
+        }
+    }
+
+    int run_pipeline(const options& opts)
+    {
+        std::optional<video_info> raw_info;
+        if (opts.raw_input.has_value()) {
+            video_info info;
+            info.width = opts.width;
+            info.height = opts.height;
+            info.layout = *opts.raw_input;
+            info.fps_num = opts.fps > 0 ? opts.fps : 30;
+            raw_info = info;
+        }
+
+        auto reader = frame_reader::open(opts.input, raw_info);
+        if (reader == nullptr) {
+            return EXIT_FAILURE;
+        }
+        auto info = reader->info();
+        if (opts.fps > 0) {
+            info.fps_num = opts.fps;
+            info.fps_den = 1;
+        }
+
+        video_info output_info = info;
+        output_info.layout = opts.output_layout;
+        auto writer = frame_writer::open(opts.output, opts.output_container, output_info);
+        if (writer == nullptr) {
+            return EXIT_FAILURE;
+        }
+
+        // the SDK is initialized while the context is created, the startup phases are logged
+        auto oep = offscreen_effect_player::create(opts.resources, opts.token,
+            static_cast<int32_t>(info.width), static_cast<int32_t>(info.height), false,
+            interfaces::startup_options{opts.effect, 0});
+        oep->set_processing_mode(interfaces::processing_mode::lossless, opts.frames_in_flight);
+
+        auto pool = plane_pool::create(opts.frames_in_flight + 4);
+        blocking_queue<std::pair<uint64_t, full_image_t>> read_queue(4);
+        blocking_queue<output_frame> write_queue(4);
+
+        metrics::latency_histogram read_stage;
+        metrics::latency_histogram write_stage;
+        std::atomic<uint64_t> written{0};
+        std::atomic<uint64_t> failed{0};
+
+        auto start = clock_type::now();
+
+        // stage 1: reading and parsing of the input
+        std::thread read_thread([&]() {
+            for (uint64_t index = 0; opts.max_frames == 0 || index < opts.max_frames; ++index) {
+                auto read_start = clock_type::now();
+                auto image = reader->read(*pool);
+                if (!image.has_value()) {
+                    break;
+                }
+                record_since(read_stage, read_start);
+                if (!read_queue.push({index, std::move(*image)})) {
+                    break;
+                }
+            }
+            read_queue.close();
+        });
+
+        // stage 3: conversion to the output format and writing
+        std::thread write_thread([&]() {
+            while (auto frame = write_queue.pop()) {
+                auto write_start = clock_type::now();
+                auto& rgba = frame->image.get_data<bpc8_image_t>();
+                if (writer->write_rgba(rgba.get_data(), static_cast<int32_t>(info.width * 4))) {
+                    ++written;
+                } else {
+                    WRITE_LOG_MESSAGE(error, "Failed to write frame " << frame->index);
+                    ++failed;
+                }
+                record_since(write_stage, write_start);
+            }
+        });
+
+        // stage 2: rendering, process_image_async blocks while the render queue is full
+        uint64_t submitted = 0;
+        std::atomic<uint64_t> completed{0};
+        while (auto frame = read_queue.pop()) {
+            auto index = frame->first;
+            auto image = std::make_shared<full_image_t>(std::move(frame->second));
+            auto timestamp_us = static_cast<int64_t>(index * 1000000ull * info.fps_den / std::max(info.fps_num, 1u));
+
+            auto callback = [&write_queue, &failed, &completed, index](std::optional<pb_sptr> pb) {
+                if (pb.has_value()) {
+                    // the pixel buffer is read within the callback, as the lossless mode requires
+                    (*pb)->get_image(interfaces::output_image_format::rgba, [&write_queue, &failed, index](std::optional<full_image_t> image) {
+                        if (image.has_value()) {
+                            write_queue.push({index, std::move(*image)});
+                        } else {
+                            ++failed;
+                        }
+                    });
+                } else {
+                    ++failed;
+                }
+                ++completed;
+            };
+            oep->process_image_async(image, callback, std::nullopt, interfaces::frame_timing{timestamp_us});
+            ++submitted;
+        }
+
+        while (completed < submitted) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        write_queue.close();
+        read_thread.join();
+        write_thread.join();
+
+        auto seconds = std::chrono::duration<double>(clock_type::now() - start).count();
+        auto pipeline_metrics = oep->get_metrics();
+        oep.reset();
+
+        using stage = interfaces::pipeline_stage;
+        print_report(opts.json, written, failed, seconds, {
+            {"read", oep_metrics::to_stage_latency(read_stage.snapshot())},
+            {"queue_wait", pipeline_metrics.latency[size_t(stage::queue_wait)]},
+            {"render", pipeline_metrics.latency[size_t(stage::render)]},
+            {"orientation", pipeline_metrics.latency[size_t(stage::orientation)]},
+            {"readback", pipeline_metrics.latency[size_t(stage::readback)]},
+            {"write", oep_metrics::to_stage_latency(write_stage.snapshot())},
+        });
+        return failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+} // anonymous namespace
+
+int main(int argc, char** argv)
+{
+    std::optional<options> opts;
+    try {
+        opts = parse_options(argc, argv);
+    } catch (const std::exception& e) {
+        std::cerr << "[ERROR] " << e.what() << std::endl;
+        print_usage();
+        return EXIT_FAILURE;
+    }
+    if (!opts.has_value()) {
+        print_usage();
+        return EXIT_SUCCESS;
+    }
+
+    // stdout may carry the video
+    logger::instance().set_sink([](log_severity, const std::string& text) { std::cerr << text << std::flush; });
+
+    std::atomic<bool> done{false};
+    int exit_code = EXIT_FAILURE;
+    std::thread pipeline([&]() {
+        try {
+            exit_code = run_pipeline(*opts);
+        } catch (const std::exception& e) {
+            WRITE_LOG_MESSAGE(error, e.what());
+        }
+        done = true;
+    });
+
+    run_main_loop_until(done);
+    pipeline.join();
+    logger::instance().flush();
+    return exit_code;
+}
@@ -0,0 +1,57 @@
+#include "allocation_counter.hpp"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+namespace
+{
+    std::atomic<uint64_t> allocations{0};
+
+    void* counted_malloc(std::size_t size)
+    {
+        allocations.fetch_add(1, std::memory_order_relaxed);
+        if (auto ptr = std::malloc(size > 0 ? size : 1)) {
+            return ptr;
+        }
+        throw std::bad_alloc();
+    }
+} // anonymous namespace
+
+namespace bnb::bench
+{
+    uint64_t allocation_count()
+    {
+        return allocations.load(std::memory_order_relaxed);
+    }
+} // bnb::bench
+
+void* operator new(std::size_t size)
+{
+    return counted_malloc(size);
+}
+
+void* operator new[](std::size_t size)
+{
+    return counted_malloc(size);
+}
+
+void operator delete(void* ptr) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete[](void* ptr) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete(void* ptr, std::size_t) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete[](void* ptr, std::size_t) noexcept
+{
+    std::free(ptr);
+}
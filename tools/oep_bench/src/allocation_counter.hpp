@@ -0,0 +1,9 @@
+#pragma once
+
+#include <cstdint>
+
+namespace bnb::bench
+{
+    // number of calls of the global operator new since the start, replaced in allocation_counter.cpp
+    uint64_t allocation_count();
+} // bnb::bench
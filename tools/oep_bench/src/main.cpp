@@ -0,0 +1,356 @@
+#include "allocation_counter.hpp"
+#include "synthetic_effect_renderer.hpp"
+
+#include "main_loop.hpp"
+
+#include "offscreen_effect_player.hpp"
+
+#include "logger.hpp"
+#include "metrics.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <numeric>
+#include <thread>
+
+using namespace bnb;
+using namespace bnb::bench;
+using namespace bnb::tools;
+
+namespace
+{
+    using clock_type = std::chrono::steady_clock;
+
+    struct resolution
+    {
+        std::string name;
+        uint32_t width;
+        uint32_t height;
+    };
+
+    struct options
+    {
+        std::vector<resolution> resolutions{{"720p", 1280, 720}, {"1080p", 1920, 1080}, {"4k", 3840, 2160}};
+        uint32_t fps{30};
+        uint64_t frames{300};
+        uint64_t warmup_frames{30};
+        interfaces::processing_mode mode{interfaces::processing_mode::realtime};
+        uint32_t frames_in_flight{2};
+        int64_t latency_budget_us{0};
+        // streams composited into tiles of one output frame, 0 processes a single stream
+        uint32_t grid_streams{0};
+        std::optional<interfaces::output_image_format> readback{interfaces::output_image_format::rgba};
+        draw_cost cost;
+        bool json{false};
+    };
+
+    struct result
+    {
+        resolution res;
+        uint64_t submitted{0};
+        uint64_t rendered{0};
+        uint64_t dropped{0};
+        double seconds{0};
+        double allocations_per_frame{0};
+        metrics::latency_histogram::snapshot_t latency;
+    };
+
+    void print_usage()
+    {
+        std::cerr << "Usage: oep_bench [options]\n"
+                  << "  --resolution 720p|1080p|4k|<W>x<H>  may be repeated, all three by default\n"
+                  << "  --fps <N>                 arrival rate, 0 submits back to back, 30 by default\n"
+                  << "  --frames <N>              measured frames per resolution, 300 by default\n"
+                  << "  --warmup <N>              frames before the measurement, 30 by default\n"
+                  << "  --mode realtime|lossless\n"
+                  << "  --in-flight <N>           frames queued for rendering in the lossless mode\n"
+                  << "  --budget-ms <N>           latency budget of the frames, late ones are dropped\n"
+                  << "  --grid <N>                composite N streams into the tiles of the output\n"
+                  << "  --readback rgba|nv12|i420|none\n"
+                  << "  --passes <N>              full screen passes of the stand-in effect, 1 by default\n"
+                  << "  --iterations <N>          ALU iterations per fragment, 16 by default\n"
+                  << "  --cpu-us <N>              CPU time of the stand-in effect per frame\n"
+                  << "  --no-upload               don't upload the frames to a texture\n"
+                  << "  --json                    print the report as JSON\n";
+    }
+
+    resolution parse_resolution(const std::string& value)
+    {
+        if (value == "720p") {
+            return {value, 1280, 720};
+        }
+        if (value == "1080p") {
+            return {value, 1920, 1080};
+        }
+        if (value == "4k") {
+            return {value, 3840, 2160};
+        }
+        auto x = value.find('x');
+        if (x == std::string::npos) {
+            throw std::runtime_error("unknown resolution " + value);
+        }
+        return {value, static_cast<uint32_t>(std::stoul(value.substr(0, x))), static_cast<uint32_t>(std::stoul(value.substr(x + 1)))};
+    }
+
+    std::optional<options> parse_options(int argc, char** argv)
+    {
+        options result;
+        bool default_resolutions = true;
+
+        for (int i = 1; i < argc; ++i) {
+            std::string arg = argv[i];
+            auto next = [&]() -> std::string {
+                if (i + 1 >= argc) {
+                    throw std::runtime_error("missing value of " + arg);
+                }
+                return argv[++i];
+            };
+
+            if (arg == "--resolution") {
+                if (default_resolutions) {
+                    result.resolutions.clear();
+                    default_resolutions = false;
+                }
+                result.resolutions.push_back(parse_resolution(next()));
+            } else if (arg == "--fps") {
+                result.fps = static_cast<uint32_t>(std::stoul(next()));
+            } else if (arg == "--frames") {
+                result.frames = std::max<uint64_t>(std::stoull(next()), 1);
+            } else if (arg == "--warmup") {
+                result.warmup_frames = std::stoull(next());
+            } else if (arg == "--mode") {
+                auto value = next();
+                if (value == "lossless") {
+                    result.mode = interfaces::processing_mode::lossless;
+                } else if (value != "realtime") {
+                    throw std::runtime_error("unknown mode " + value);
+                }
+            } else if (arg == "--in-flight") {
+                result.frames_in_flight = static_cast<uint32_t>(std::stoul(next()));
+            } else if (arg == "--grid") {
+                result.grid_streams = static_cast<uint32_t>(std::stoul(next()));
+            } else if (arg == "--budget-ms") {
+                result.latency_budget_us = static_cast<int64_t>(std::stod(next()) * 1000.0);
+            } else if (arg == "--readback") {
+                auto value = next();
+                if (value == "rgba") {
+                    result.readback = interfaces::output_image_format::rgba;
+                } else if (value == "nv12") {
+                    result.readback = interfaces::output_image_format::nv12;
+                } else if (value == "i420") {
+                    result.readback = interfaces::output_image_format::i420;
+                } else if (value == "none") {
+                    result.readback.reset();
+                } else {
+                    throw std::runtime_error("unknown readback format " + value);
+                }
+            } else if (arg == "--passes") {
+                result.cost.gpu_passes = static_cast<uint32_t>(std::stoul(next()));
+            } else if (arg == "--iterations") {
+                result.cost.shader_iterations = static_cast<uint32_t>(std::stoul(next()));
+            } else if (arg == "--cpu-us") {
+                result.cost.cpu_us = static_cast<uint32_t>(std::stoul(next()));
+            } else if (arg == "--no-upload") {
+                result.cost.upload_frame = false;
+            } else if (arg == "--json") {
+                result.json = true;
+            } else if (arg == "--help" || arg == "-h") {
+                return std::nullopt;
+            } else {
+                throw std::runtime_error("unknown option " + arg);
+            }
+        }
+        return result;
+    }
+
+    int64_t now_us()
+    {
+        return std::chrono::duration_cast<std::chrono::microseconds>(clock_type::now().time_since_epoch()).count();
+    }
+
+    // NV12 camera-like frames, the planes are shared by all the submitted copies
+    std::vector<full_image_t> make_source_frames(const resolution& res, size_t count)
+    {
+        std::vector<full_image_t> frames;
+        for (size_t n = 0; n < count; ++n) {
+            std::vector<uint8_t> y(size_t(res.width) * res.height);
+            std::vector<uint8_t> uv(size_t(res.width) * (res.height / 2));
+            for (uint32_t row = 0; row < res.height; ++row) {
+                for (uint32_t col = 0; col < res.width; ++col) {
+                    y[size_t(row) * res.width + col] = static_cast<uint8_t>(col + row + n * 8);
+                }
+            }
+            std::iota(uv.begin(), uv.end(), static_cast<uint8_t>(n));
+
+            image_format format;
+            format.width = res.width;
+            format.height = res.height;
+            format.orientation = camera_orientation::deg_0;
+            format.require_mirroring = false;
+            frames.emplace_back(yuv_image_t(color_plane_vector(std::move(y)), color_plane_vector(std::move(uv)), format,
+                                            yuv_format_t{color_range::full, color_std::bt601, yuv_format::yuv_nv12}));
+        }
+        return frames;
+    }
+
+    uint64_t total_dropped(const interfaces::metrics_snapshot& snapshot)
+    {
+        return std::accumulate(snapshot.frames_dropped.begin(), snapshot.frames_dropped.end(), uint64_t(0));
+    }
+
+    result run_case(const options& opts, const resolution& res)
+    {
+        auto renderer = std::make_shared<synthetic_effect_renderer>(opts.cost);
+        auto grid_renderers = [cost = opts.cost]() -> effect_renderer_sptr { return std::make_shared<synthetic_effect_renderer>(cost); };
+        auto oep = offscreen_effect_player::create(renderer, int32_t(res.width), int32_t(res.height), std::nullopt, grid_renderers);
+        oep->set_processing_mode(opts.mode, opts.frames_in_flight);
+        std::vector<uint32_t> streams;
+        for (uint32_t i = 0; i < opts.grid_streams; ++i) {
+            streams.push_back(oep->add_grid_stream(""));
+        }
+
+        auto sources = make_source_frames(res, 4);
+        metrics::latency_histogram latency;
+        std::atomic<int64_t> measure_start_us{INT64_MAX};
+
+        auto callback = [&opts, &latency, &measure_start_us](std::optional<pb_sptr> pb) {
+            if (!pb.has_value()) {
+                return;
+            }
+            if (opts.readback.has_value()) {
+                (*pb)->get_image(*opts.readback, [](std::optional<full_image_t>) {});
+            }
+            auto submitted_us = (*pb)->get_frame_timing().capture_timestamp_us;
+            if (submitted_us >= measure_start_us.load(std::memory_order_relaxed)) {
+                latency.record(static_cast<uint64_t>(std::max<int64_t>(now_us() - submitted_us, 0)));
+            }
+        };
+
+        auto wait_idle = [&oep]() {
+            for (;;) {
+                auto snapshot = oep->get_metrics();
+                if (snapshot.frames_rendered + total_dropped(snapshot) >= snapshot.frames_submitted) {
+                    return snapshot;
+                }
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+        };
+
+        auto period = opts.fps > 0 ? std::chrono::microseconds(1000000 / opts.fps) : std::chrono::microseconds(0);
+        auto submit = [&](uint64_t count, uint64_t first) {
+            auto next_arrival = clock_type::now();
+            for (uint64_t i = 0; i < count; ++i) {
+                if (period.count() > 0) {
+                    std::this_thread::sleep_until(next_arrival);
+                    next_arrival += period;
+                }
+                if (!streams.empty()) {
+                    // every stream gets a frame, the composite is one output frame
+                    for (size_t s = 0; s < streams.size(); ++s) {
+                        oep->push_grid_frame(streams[s], std::make_shared<full_image_t>(sources[(first + i + s) % sources.size()]));
+                    }
+                    oep->composite_grid_async(callback, interfaces::frame_timing{now_us(), opts.latency_budget_us});
+                    continue;
+                }
+                auto image = std::make_shared<full_image_t>(sources[(first + i) % sources.size()]);
+                oep->process_image_async(image, callback, std::nullopt, interfaces::frame_timing{now_us(), opts.latency_budget_us});
+            }
+        };
+
+        submit(opts.warmup_frames, 0);
+        auto before = wait_idle();
+
+        result r;
+        r.res = res;
+        measure_start_us = now_us();
+        auto allocations_before = allocation_count();
+        auto start = clock_type::now();
+        submit(opts.frames, opts.warmup_frames);
+        auto after = wait_idle();
+        r.seconds = std::chrono::duration<double>(clock_type::now() - start).count();
+        auto allocations = allocation_count() - allocations_before;
+
+        r.submitted = after.frames_submitted - before.frames_submitted;
+        r.rendered = after.frames_rendered - before.frames_rendered;
+        r.dropped = total_dropped(after) - total_dropped(before);
+        r.allocations_per_frame = double(allocations) / double(std::max<uint64_t>(r.submitted, 1));
+        r.latency = latency.snapshot();
+        return r;
+    }
+
+    void print_report(bool json, const std::vector<result>& results)
+    {
+        auto ms = [](uint64_t us) { return us / 1000.0; };
+
+        if (json) {
+            std::cout << "{\"results\":[";
+            for (size_t i = 0; i < results.size(); ++i) {
+                auto& r = results[i];
+                std::cout << (i == 0 ? "" : ",") << "{\"resolution\":\"" << r.res.name << "\",\"width\":" << r.res.width
+                          << ",\"height\":" << r.res.height << ",\"submitted\":" << r.submitted
+                          << ",\"rendered\":" << r.rendered << ",\"dropped\":" << r.dropped
+                          << ",\"fps\":" << r.rendered / r.seconds
+                          << ",\"drop_rate\":" << double(r.dropped) / std::max<uint64_t>(r.submitted, 1)
+                          << ",\"p50_ms\":" << ms(r.latency.percentile_us(0.5))
+                          << ",\"p99_ms\":" << ms(r.latency.percentile_us(0.99))
+                          << ",\"p999_ms\":" << ms(r.latency.percentile_us(0.999))
+                          << ",\"max_ms\":" << ms(r.latency.max_us())
+                          << ",\"allocations_per_frame\":" << r.allocations_per_frame << "}";
+            }
+            std::cout << "]}" << std::endl;
+            return;
+        }
+
+        std::printf("resolution      fps  drop %%   p50 ms   p99 ms  p999 ms   max ms  allocs/frame\n");
+        for (auto& r : results) {
+            std::printf("%-10s %8.1f %7.2f %8.2f %8.2f %8.2f %8.2f %13.1f\n", r.res.name.c_str(),
+                        r.rendered / r.seconds, 100.0 * r.dropped / std::max<uint64_t>(r.submitted, 1),
+                        ms(r.latency.percentile_us(0.5)), ms(r.latency.percentile_us(0.99)),
+                        ms(r.latency.percentile_us(0.999)), ms(r.latency.max_us()), r.allocations_per_frame);
+        }
+    }
+} // anonymous namespace
+
+int main(int argc, char** argv)
+{
+    std::optional<options> opts;
+    try {
+        opts = parse_options(argc, argv);
+    } catch (const std::exception& e) {
+        std::cerr << "[ERROR] " << e.what() << std::endl;
+        print_usage();
+        return EXIT_FAILURE;
+    }
+    if (!opts.has_value()) {
+        print_usage();
+        return EXIT_SUCCESS;
+    }
+
+    // keep stdout for the report
+    logger::instance().set_sink([](log_severity, const std::string& text) { std::cerr << text << std::flush; });
+
+    std::atomic<bool> done{false};
+    int exit_code = EXIT_FAILURE;
+    std::vector<result> results;
+    std::thread benchmark([&]() {
+        try {
+            for (auto& res : opts->resolutions) {
+                results.push_back(run_case(*opts, res));
+            }
+            exit_code = EXIT_SUCCESS;
+        } catch (const std::exception& e) {
+            WRITE_LOG_MESSAGE(error, e.what());
+        }
+        done = true;
+    });
+
+    run_main_loop_until(done);
+    benchmark.join();
+    logger::instance().flush();
+    print_report(opts->json, results);
+    return exit_code;
+}
@@ -0,0 +1,142 @@
+#include "synthetic_effect_renderer.hpp"
+
+#include "opengl.hpp"
+
+#include <chrono>
+
+namespace
+{
+    // a full screen triangle without vertex buffers
+    const char* vs_fullscreen =
+        "out vec2 vTexCoord;\n"
+        "void main()\n"
+        "{\n"
+            "vec2 pos = vec2(float((gl_VertexID << 1) & 2), float(gl_VertexID & 2));\n"
+            "vTexCoord = pos;\n"
+            "gl_Position = vec4(pos * 2.0 - 1.0, 0.0, 1.0);\n"
+        "}\n";
+
+    const char* ps_synthetic =
+        "precision highp float;\n"
+        "in vec2 vTexCoord;\n"
+        "out vec4 FragColor;\n"
+        "uniform sampler2D uTexture;\n"
+        "uniform int uIterations;\n"
+        "uniform float uPass;\n"
+        "void main()\n"
+        "{\n"
+            "float luma = texture(uTexture, vTexCoord).r;\n"
+            "vec3 color = vec3(luma, vTexCoord);\n"
+            "for (int i = 0; i < uIterations; ++i) {\n"
+                "color = fract(sin(color * 12.9898 + uPass) * 0.5 + color.yzx);\n"
+            "}\n"
+            "FragColor = vec4(mix(vec3(luma), color, 0.25), 1.0);\n"
+        "}\n";
+} // anonymous namespace
+
+namespace bnb::bench
+{
+    synthetic_effect_renderer::synthetic_effect_renderer(draw_cost cost)
+        : m_cost(cost) {}
+
+    void synthetic_effect_renderer::surface_created(int32_t width, int32_t height)
+    {
+        m_width = width;
+        m_height = height;
+
+        m_program = std::make_unique<program>("SyntheticEffect", vs_fullscreen, ps_synthetic);
+        m_iterations_location = glGetUniformLocation(m_program->handle(), "uIterations");
+        m_pass_location = glGetUniformLocation(m_program->handle(), "uPass");
+
+        GL_CALL(glGenVertexArrays(1, &m_vao));
+        GL_CALL(glGenTextures(1, &m_texture));
+        GL_CALL(glBindTexture(GL_TEXTURE_2D, m_texture));
+        GL_CALL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR));
+        GL_CALL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR));
+        GL_CALL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE));
+        GL_CALL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE));
+        GL_CALL(glBindTexture(GL_TEXTURE_2D, 0));
+    }
+
+    void synthetic_effect_renderer::surface_changed(int32_t width, int32_t height)
+    {
+        m_width = width;
+        m_height = height;
+    }
+
+    void synthetic_effect_renderer::surface_destroyed()
+    {
+        m_program.reset();
+        if (m_vao != 0) {
+            glDeleteVertexArrays(1, &m_vao);
+            m_vao = 0;
+        }
+        if (m_texture != 0) {
+            glDeleteTextures(1, &m_texture);
+            m_texture = 0;
+        }
+    }
+
+    void synthetic_effect_renderer::push_frame(full_image_t image)
+    {
+        m_frame = std::move(image);
+    }
+
+    int64_t synthetic_effect_renderer::draw()
+    {
+        if (!m_frame.has_value() || m_program == nullptr) {
+            return -1;
+        }
+
+        auto cpu_deadline = std::chrono::steady_clock::now() + std::chrono::microseconds(m_cost.cpu_us);
+
+        GL_CALL(glBindTexture(GL_TEXTURE_2D, m_texture));
+        if (m_cost.upload_frame) {
+            upload(*m_frame);
+        }
+        m_frame.reset();
+
+        GL_CALL(glViewport(0, 0, m_width, m_height));
+        m_program->use();
+        GL_CALL(glUniform1i(m_iterations_location, static_cast<GLint>(m_cost.shader_iterations)));
+        GL_CALL(glBindVertexArray(m_vao));
+        for (uint32_t pass = 0; pass < m_cost.gpu_passes; ++pass) {
+            GL_CALL(glUniform1f(m_pass_location, static_cast<float>(pass)));
+            GL_CALL(glDrawArrays(GL_TRIANGLES, 0, 3));
+        }
+        GL_CALL(glBindVertexArray(0));
+        m_program->unuse();
+        GL_CALL(glBindTexture(GL_TEXTURE_2D, 0));
+
+        while (std::chrono::steady_clock::now() < cpu_deadline) {
+            // busy wait, as the CPU work of a real effect would keep the thread busy
+        }
+        return ++m_frame_number;
+    }
+
+    void synthetic_effect_renderer::upload(const full_image_t& image)
+    {
+        auto format = image.get_format();
+        const uint8_t* luma = nullptr;
+        GLenum pixel_format = GL_RED;
+        if (image.has_data<yuv_image_t>()) {
+            luma = image.get_data<yuv_image_t>().get_y_plane();
+        } else {
+            luma = image.get_data<bpc8_image_t>().get_data();
+            pixel_format = GL_RGBA;
+        }
+
+        GL_CALL(glPixelStorei(GL_UNPACK_ALIGNMENT, 1));
+        if (format.width != m_texture_width || format.height != m_texture_height || pixel_format != m_texture_format) {
+            m_texture_width = format.width;
+            m_texture_height = format.height;
+            m_texture_format = pixel_format;
+            GL_CALL(glTexImage2D(GL_TEXTURE_2D, 0, pixel_format == GL_RED ? GL_R8 : GL_RGBA8,
+                                 GLsizei(format.width), GLsizei(format.height), 0, pixel_format, GL_UNSIGNED_BYTE, luma));
+        } else {
+            GL_CALL(glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, GLsizei(format.width), GLsizei(format.height),
+                                    pixel_format, GL_UNSIGNED_BYTE, luma));
+        }
+        GL_CALL(glPixelStorei(GL_UNPACK_ALIGNMENT, 4));
+    }
+} // bnb::bench
@@ -0,0 +1,67 @@
+#pragma once
+
+#include "interfaces/effect_renderer.hpp"
+
+#include "program.hpp"
+
+#include <optional>
+
+namespace bnb::bench
+{
+    struct draw_cost
+    {
+        // full screen passes per frame
+        uint32_t gpu_passes{1};
+        // ALU loop iterations per fragment in every pass
+        uint32_t shader_iterations{16};
+        // CPU time spent in draw(), stands for face tracking and the scripts of an effect
+        uint32_t cpu_us{0};
+        // upload the luma plane of every frame to a texture as effect_player does with the camera frame
+        bool upload_frame{true};
+    };
+
+    /**
+     * effect_renderer with a configurable cost instead of a real effect, so the
+     * pipeline of the offscreen effect player is measured independently of the SDK.
+     */
+    class synthetic_effect_renderer: public interfaces::effect_renderer
+    {
+    public:
+        explicit synthetic_effect_renderer(draw_cost cost);
+
+        void surface_created(int32_t width, int32_t height) override;
+        void surface_changed(int32_t width, int32_t height) override;
+        void surface_destroyed() override;
+
+        void push_frame(full_image_t image) override;
+        int64_t draw() override;
+
+        void set_max_faces(int32_t max_faces) override {}
+
+        bool load_effect(const std::string& effect_path) override { return true; }
+        // the synthetic cost is the effect
+        bool has_effect() const override { return true; }
+        void call_js_method(const std::string& method, const std::string& param) override {}
+
+    private:
+        void upload(const full_image_t& image);
+
+    private:
+        const draw_cost m_cost;
+
+        int32_t m_width{0};
+        int32_t m_height{0};
+
+        std::unique_ptr<program> m_program;
+        int m_iterations_location{-1};
+        int m_pass_location{-1};
+        unsigned int m_vao{0};
+        unsigned int m_texture{0};
+        uint32_t m_texture_width{0};
+        uint32_t m_texture_height{0};
+        unsigned int m_texture_format{0};
+
+        std::optional<full_image_t> m_frame;
+        int64_t m_frame_number{0};
+    };
+} // bnb::bench
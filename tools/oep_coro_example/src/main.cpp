@@ -0,0 +1,198 @@
+#include "main_loop.hpp"
+
+#include "offscreen_effect_player.hpp"
+#include "oep_coroutines.hpp"
+
+#include "logger.hpp"
+#include "thread_pool.h"
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <future>
+#include <iostream>
+#include <thread>
+
+#ifdef __APPLE__
+    #include <CoreVideo/CoreVideo.h>
+#endif
+
+#if __cplusplus < 202002L
+    #error "oep_coro_example needs C++20 coroutines"
+#endif
+
+using namespace bnb;
+using namespace bnb::tools;
+
+namespace
+{
+    struct options
+    {
+        std::string effect;
+        uint32_t width{1280};
+        uint32_t height{720};
+        uint32_t frames{30};
+        std::string token;
+        std::vector<std::string> resources{BNB_RESOURCES_FOLDER};
+    };
+
+    struct summary
+    {
+        bool effect_loaded{false};
+        uint32_t processed{0};
+        uint32_t dropped{0};
+        uint32_t images{0};
+        uint32_t pixel_buffers{0};
+    };
+
+    void print_usage()
+    {
+        std::cerr << "Usage: oep_coro_example [options]\n"
+                  << "Processes synthetic frames through the coroutine API of offscreen_effect_player.\n"
+                  << "  --effect <path>             effect to load, none by default\n"
+                  << "  --size <W>x<H>              frame size, 1280x720 by default\n"
+                  << "  --frames <N>                frames to process, 30 by default\n"
+                  << "  --resources <dir>           additional resources folder\n"
+                  << "  --token <token>             client token, BNB_CLIENT_TOKEN by default\n";
+    }
+
+    std::optional<options> parse_options(int argc, char** argv)
+    {
+        options result;
+        if (auto token = std::getenv("BNB_CLIENT_TOKEN")) {
+            result.token = token;
+        }
+
+        for (int i = 1; i < argc; ++i) {
+            std::string arg = argv[i];
+            auto next = [&]() -> std::string {
+                if (i + 1 >= argc) {
+                    throw std::runtime_error("missing value of " + arg);
+                }
+                return argv[++i];
+            };
+
+            if (arg == "--effect") {
+                result.effect = next();
+            } else if (arg == "--size") {
+                auto value = next();
+                auto x = value.find('x');
+                if (x == std::string::npos) {
+                    throw std::runtime_error("the size must be <W>x<H>");
+                }
+                result.width = static_cast<uint32_t>(std::stoul(value.substr(0, x)));
+                result.height = static_cast<uint32_t>(std::stoul(value.substr(x + 1)));
+            } else if (arg == "--frames") {
+                result.frames = static_cast<uint32_t>(std::stoul(next()));
+            } else if (arg == "--token") {
+                result.token = next();
+            } else if (arg == "--resources") {
+                result.resources.push_back(next());
+            } else if (arg == "--help" || arg == "-h") {
+                return std::nullopt;
+            } else {
+                throw std::runtime_error("unknown option " + arg);
+            }
+        }
+        return result;
+    }
+
+    std::shared_ptr<full_image_t> make_frame(const options& opts, uint32_t index)
+    {
+        std::vector<uint8_t> y(size_t(opts.width) * opts.height, static_cast<uint8_t>(index * 8));
+        std::vector<uint8_t> uv(size_t((opts.width + 1) / 2) * ((opts.height + 1) / 2) * 2, 128);
+
+        auto format = image_format();
+        format.width = opts.width;
+        format.height = opts.height;
+        format.orientation = camera_orientation::deg_0;
+        format.require_mirroring = false;
+        return std::make_shared<full_image_t>(yuv_image_t(color_plane_vector(std::move(y)), color_plane_vector(std::move(uv)), format,
+                                                          yuv_format_t{color_range::full, color_std::bt601, yuv_format::yuv_nv12}));
+    }
+
+    // every awaitable of the layer: load_effect, process, read and read_pixel_buffer
+    coro::task<summary> run(coro::awaitable_effect_player& player, const options& opts)
+    {
+        summary result;
+        if (!opts.effect.empty()) {
+            result.effect_loaded = co_await player.load_effect(opts.effect);
+        }
+
+        for (uint32_t i = 0; i < opts.frames; ++i) {
+            auto frame = co_await player.process(make_frame(opts, i));
+            if (!frame.has_value()) {
+                ++result.dropped;
+                continue;
+            }
+            ++result.processed;
+
+            if (auto image = co_await frame->read(interfaces::output_image_format::nv12)) {
+                ++result.images;
+            }
+            void* pixel_buffer = co_await frame->read_pixel_buffer();
+            if (pixel_buffer != nullptr) {
+                ++result.pixel_buffers;
+#ifdef __APPLE__
+                CVPixelBufferRelease(static_cast<CVPixelBufferRef>(pixel_buffer));
+#endif
+            }
+        }
+        co_return result;
+    }
+
+    int run_example(const options& opts)
+    {
+        auto oep = offscreen_effect_player::create(opts.resources, opts.token,
+            static_cast<int32_t>(opts.width), static_cast<int32_t>(opts.height), false, std::nullopt);
+        // every frame is rendered, the coroutine awaits one at a time anyway
+        oep->set_processing_mode(interfaces::processing_mode::lossless, 1);
+
+        // the coroutine resumes on a thread of its own instead of the render thread
+        thread_pool pool(1);
+        coro::awaitable_effect_player player(oep, coro::pool_executor(pool));
+
+        std::promise<summary> result;
+        coro::spawn([](coro::awaitable_effect_player& player, const options& opts, std::promise<summary>& result) -> coro::task<> {
+            result.set_value(co_await run(player, opts));
+        }(player, opts, result));
+        auto s = result.get_future().get();
+
+        std::printf("effect loaded: %s\nprocessed: %u, dropped: %u, images: %u, pixel buffers: %u\n",
+                    opts.effect.empty() ? "none" : (s.effect_loaded ? "yes" : "no"),
+                    s.processed, s.dropped, s.images, s.pixel_buffers);
+        return s.processed == opts.frames && s.images == s.processed ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+} // anonymous namespace
+
+int main(int argc, char** argv)
+{
+    std::optional<options> opts;
+    try {
+        opts = parse_options(argc, argv);
+    } catch (const std::exception& e) {
+        std::cerr << "[ERROR] " << e.what() << std::endl;
+        print_usage();
+        return EXIT_FAILURE;
+    }
+    if (!opts.has_value()) {
+        print_usage();
+        return EXIT_SUCCESS;
+    }
+
+    std::atomic<bool> done{false};
+    int exit_code = EXIT_FAILURE;
+    std::thread example([&]() {
+        try {
+            exit_code = run_example(*opts);
+        } catch (const std::exception& e) {
+            WRITE_LOG_MESSAGE(error, e.what());
+        }
+        done = true;
+    });
+
+    run_main_loop_until(done);
+    example.join();
+    logger::instance().flush();
+    return exit_code;
+}
@@ -0,0 +1,254 @@
+#include "main_loop.hpp"
+
+#include "offscreen_effect_player.hpp"
+#include "session_file.hpp"
+
+#include "logger.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <numeric>
+#include <thread>
+
+using namespace bnb;
+using namespace bnb::tools;
+
+namespace
+{
+    using clock_type = std::chrono::steady_clock;
+
+    struct options
+    {
+        std::string session;
+        std::string token;
+        std::vector<std::string> resources{BNB_RESOURCES_FOLDER};
+        // false replays as fast as possible
+        bool recorded_speed{false};
+        uint32_t loops{1};
+        std::optional<interfaces::output_image_format> readback{interfaces::output_image_format::nv12};
+        bool json{false};
+    };
+
+    void print_usage()
+    {
+        std::cerr << "Usage: oep_replay --session <file> [options]\n"
+                  << "  --speed recorded|max        max by default, every frame is rendered then\n"
+                  << "  --loops <N>                 replay the session N times\n"
+                  << "  --readback rgba|nv12|i420|none  read the frames in the callback, nv12 by default\n"
+                  << "  --resources <dir>           additional resources folder\n"
+                  << "  --token <token>             client token, BNB_CLIENT_TOKEN by default\n"
+                  << "  --json                      print the report as JSON\n";
+    }
+
+    std::optional<options> parse_options(int argc, char** argv)
+    {
+        options result;
+        if (auto token = std::getenv("BNB_CLIENT_TOKEN")) {
+            result.token = token;
+        }
+
+        for (int i = 1; i < argc; ++i) {
+            std::string arg = argv[i];
+            auto next = [&]() -> std::string {
+                if (i + 1 >= argc) {
+                    throw std::runtime_error("missing value of " + arg);
+                }
+                return argv[++i];
+            };
+
+            if (arg == "--session") {
+                result.session = next();
+            } else if (arg == "--speed") {
+                auto value = next();
+                if (value == "recorded") {
+                    result.recorded_speed = true;
+                } else if (value != "max") {
+                    throw std::runtime_error("unknown speed " + value);
+                }
+            } else if (arg == "--loops") {
+                result.loops = std::max(1u, static_cast<uint32_t>(std::stoul(next())));
+            } else if (arg == "--readback") {
+                auto value = next();
+                if (value == "rgba") {
+                    result.readback = interfaces::output_image_format::rgba;
+                } else if (value == "nv12") {
+                    result.readback = interfaces::output_image_format::nv12;
+                } else if (value == "i420") {
+                    result.readback = interfaces::output_image_format::i420;
+                } else if (value == "none") {
+                    result.readback.reset();
+                } else {
+                    throw std::runtime_error("unknown readback format " + value);
+                }
+            } else if (arg == "--resources") {
+                result.resources.push_back(next());
+            } else if (arg == "--token") {
+                result.token = next();
+            } else if (arg == "--json") {
+                result.json = true;
+            } else if (arg == "--help" || arg == "-h") {
+                return std::nullopt;
+            } else {
+                throw std::runtime_error("unknown option " + arg);
+            }
+        }
+
+        if (result.session.empty()) {
+            throw std::runtime_error("--session is required");
+        }
+        return result;
+    }
+
+    uint64_t total_dropped(const interfaces::metrics_snapshot& snapshot)
+    {
+        return std::accumulate(snapshot.frames_dropped.begin(), snapshot.frames_dropped.end(), uint64_t(0));
+    }
+
+    void print_report(bool json, const interfaces::metrics_snapshot& m, double seconds)
+    {
+        const char* stage_names[] = {"queue_wait", "render", "orientation", "readback", "callback", "total"};
+        auto ms = [](uint64_t us) { return us / 1000.0; };
+        auto fps = seconds > 0 ? m.frames_rendered / seconds : 0.0;
+
+        if (json) {
+            std::cout << "{\"submitted\":" << m.frames_submitted << ",\"rendered\":" << m.frames_rendered
+                      << ",\"dropped\":" << total_dropped(m) << ",\"seconds\":" << seconds << ",\"fps\":" << fps
+                      << ",\"stages\":{";
+            for (size_t i = 0; i < m.latency.size(); ++i) {
+                auto& s = m.latency[i];
+                std::cout << (i == 0 ? "" : ",") << "\"" << stage_names[i] << "\":{\"count\":" << s.count
+                          << ",\"p50_ms\":" << ms(s.p50_us) << ",\"p99_ms\":" << ms(s.p99_us)
+                          << ",\"max_ms\":" << ms(s.max_us) << "}";
+            }
+            std::cout << "}}" << std::endl;
+            return;
+        }
+
+        std::printf("frames: %llu submitted, %llu rendered, %llu dropped, %.2f s, %.1f fps\n",
+                    static_cast<unsigned long long>(m.frames_submitted), static_cast<unsigned long long>(m.frames_rendered),
+                    static_cast<unsigned long long>(total_dropped(m)), seconds, fps);
+        std::printf("stage           count    p50 ms    p99 ms    max ms\n");
+        for (size_t i = 0; i < m.latency.size(); ++i) {
+            auto& s = m.latency[i];
+            std::printf("%-14s %6llu %9.3f %9.3f %9.3f\n", stage_names[i], static_cast<unsigned long long>(s.count),
+                        ms(s.p50_us), ms(s.p99_us), ms(s.max_us));
+        }
+    }
+
+    int replay(const options& opts)
+    {
+        auto reader = session_reader::open(opts.session);
+        if (reader == nullptr) {
+            return EXIT_FAILURE;
+        }
+        auto format = reader->first_frame_format();
+        if (!format.has_value()) {
+            WRITE_LOG_MESSAGE(error, "The session has no frames");
+            return EXIT_FAILURE;
+        }
+
+        auto oep = offscreen_effect_player::create(opts.resources, opts.token,
+            static_cast<int32_t>(format->width), static_cast<int32_t>(format->height), false, std::nullopt);
+        // as fast as possible means no frame may be dropped, otherwise the replay would not be repeatable
+        if (!opts.recorded_speed) {
+            oep->set_processing_mode(interfaces::processing_mode::lossless);
+        }
+
+        auto readback = opts.readback;
+        auto callback = [readback](std::optional<pb_sptr> pb) {
+            if (pb.has_value() && readback.has_value()) {
+                (*pb)->get_image(*readback, [](std::optional<full_image_t>) {});
+            }
+        };
+
+        auto start = clock_type::now();
+        for (uint32_t loop = 0; loop < opts.loops; ++loop) {
+            reader->rewind();
+            auto loop_start = clock_type::now();
+            while (auto event = reader->next()) {
+                if (opts.recorded_speed) {
+                    std::this_thread::sleep_until(loop_start + std::chrono::microseconds(event->timestamp_us));
+                }
+                switch (event->type) {
+                    case session_event_type::frame:
+                        oep->process_image_async(event->image, callback, event->target_orient, event->timing);
+                        break;
+                    case session_event_type::load_effect:
+                        if (event->text.empty()) {
+                            oep->unload_effect();
+                        } else {
+                            oep->load_effect(event->text);
+                        }
+                        break;
+                    case session_event_type::surface_changed:
+                        oep->surface_changed(event->width, event->height);
+                        break;
+                    case session_event_type::call_js_method:
+                        oep->call_js_method(event->text, event->param);
+                        break;
+                    case session_event_type::processing_mode:
+                        if (opts.recorded_speed) {
+                            oep->set_processing_mode(event->mode, event->max_frames_in_flight);
+                        }
+                        break;
+                    case session_event_type::render_scale:
+                        oep->set_render_scale(event->scale, event->filter);
+                        break;
+                }
+            }
+        }
+
+        interfaces::metrics_snapshot metrics;
+        for (;;) {
+            metrics = oep->get_metrics();
+            if (metrics.frames_rendered + total_dropped(metrics) >= metrics.frames_submitted) {
+                break;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        auto seconds = std::chrono::duration<double>(clock_type::now() - start).count();
+        oep.reset();
+
+        print_report(opts.json, metrics, seconds);
+        return EXIT_SUCCESS;
+    }
+} // anonymous namespace
+
+int main(int argc, char** argv)
+{
+    std::optional<options> opts;
+    try {
+        opts = parse_options(argc, argv);
+    } catch (const std::exception& e) {
+        std::cerr << "[ERROR] " << e.what() << std::endl;
+        print_usage();
+        return EXIT_FAILURE;
+    }
+    if (!opts.has_value()) {
+        print_usage();
+        return EXIT_SUCCESS;
+    }
+
+    // keep stdout for the report
+    logger::instance().set_sink([](log_severity, const std::string& text) { std::cerr << text << std::flush; });
+
+    std::atomic<bool> done{false};
+    int exit_code = EXIT_FAILURE;
+    std::thread replay_thread([&]() {
+        try {
+            exit_code = replay(*opts);
+        } catch (const std::exception& e) {
+            WRITE_LOG_MESSAGE(error, e.what());
+        }
+        done = true;
+    });
+
+    run_main_loop_until(done);
+    replay_thread.join();
+    logger::instance().flush();
+    return exit_code;
+}